@@ -41,12 +41,29 @@ NMF.initMode     = 2;                            % initialization mode (1: noise
 NMF.numIter      = 10;                           % number of iterations
 NMF.gain         = 1.0;                          % light field amplification factor
 NMF.fixFrontMask = false;                        % fix the front mask (i.e., do not update)
+NMF.minPSNR      = 1000;                         % minimum PSNR (i.e., stop once exceeded)
+NMF.numThreads   = 0;                            % number of solver threads (0: all cores, MEX only)
+NMF.precision    = 'double';                     % numerical precision of the solver ('double' or 'single', MEX only)
+NMF.evalMode     = 'full';                       % PSNR evaluation mode ('full', 'fused', or 'sampled', MEX only)
+NMF.evalInterval = 1;                            % number of iterations between PSNR evaluations (MEX only)
+NMF.tolObjective = 0;                            % minimum relative objective change (0 to disable, MEX only)
+NMF.tolFactor    = 0;                            % minimum relative mask change (0 to disable, MEX only)
+NMF.plateau      = 0;                            % maximum iterations without improvement (0 to disable, MEX only)
+NMF.logFile      = '';                           % telemetry file (e.g., 'nmf_log.csv', MEX only)
+NMF.numLevels    = 1;                            % number of resolution levels (coarse-to-fine if > 1, MEX only; needs a single view along one axis)
+NMF.levelIter    = 25;                           % number of iterations at each coarser level (MEX only)
+NMF.updateRule   = 'mu';                         % update rule ('mu', 'hals', or 'amu', MEX only)
+NMF.innerIter    = 3;                            % number of inner passes of the 'hals' and 'amu' rules (MEX only)
+NMF.gram         = false;                        % evaluate denominators from window Gram matrices (MEX only)
+NMF.schedule     = 'jacobi';                     % update schedule ('jacobi' or 'gs', MEX only)
+NMF.lfClass      = 'double';                     % light field storage class ('double', 'uint16', or 'uint8', MEX only)
 
 % Define multi-view skewed orthographic images (i.e, the input light field).
 image.frameDir   = './images/teapot2/';          % base directory (e.g., './images/teapot/')
 image.frameBase  = 'teapot-0';                   % base file name (e.g., 'teapot-')
 image.frameCount = '%0.1d';                      % counter format (e.g., '%0.1d')
 image.frameExt   = 'png';                        % file format    (e.g., 'png')
+image.useMEX     = false;                        % load views with the native loader (PNG only, see make.m)
 
 % Define additional options.
 options.saveMasks = true; % enable/disable mask output
@@ -86,36 +103,56 @@ disp('> Loading light field...');
 
 % Load the pre-rendered light field (i.e., the skewed orthographic image set).
 % Note: Gamma-correct to convert input images to a linear intensity scale.
+%       Integer light fields store the gamma-compressed intensities instead
+%       (see decodeLF), which the MEX solver linearizes on the fly.
 if display.fullColor
    LF.dim = [display.res display.nAngles 3];
 else
    LF.dim = [display.res display.nAngles];
 end
-LF.data.ideal = zeros(LF.dim);
-k = 0;
-for bIdx = 1:LF.dim(3)
-   for aIdx = 1:LF.dim(4)
-      k = k+1;
-      disp(['  + Loading image ',int2str(k),'...']);
-      fileIdx = LF.dim(4)*(bIdx-1)+aIdx;
-      filename = [image.frameDir,image.frameBase,...
-         num2str(fileIdx,image.frameCount),'.',image.frameExt];
-      I = im2double(imread(filename));
-      I = I.^display.inGamma;
-      if display.fullColor
-         if size(I,3) == 1
-            I = repmat(I,[1 1 3]);
+if ~NMF.useMEX
+   NMF.lfClass = 'double';
+end
+if strcmp(NMF.lfClass,'double')
+   decodeLF = @(I) I;
+else
+   decodeLF = @(I) (double(I)/double(intmax(NMF.lfClass))).^display.inGamma;
+end
+if image.useMEX
+   pattern = strrep([image.frameDir,image.frameBase],'%','%%');
+   pattern = [pattern,image.frameCount,'.',image.frameExt];
+   LF.data.ideal = lf_nmf_load_mex(pattern,display.res,display.nAngles,...
+      display.fullColor,display.inGamma,NMF.lfClass,NMF.numThreads);
+else
+   LF.data.ideal = zeros(LF.dim,NMF.lfClass);
+   k = 0;
+   for bIdx = 1:LF.dim(3)
+      for aIdx = 1:LF.dim(4)
+         k = k+1;
+         disp(['  + Loading image ',int2str(k),'...']);
+         fileIdx = LF.dim(4)*(bIdx-1)+aIdx;
+         filename = [image.frameDir,image.frameBase,...
+            num2str(fileIdx,image.frameCount),'.',image.frameExt];
+         I = im2double(imread(filename));
+         I = I.^display.inGamma;
+         if display.fullColor
+            if size(I,3) == 1
+               I = repmat(I,[1 1 3]);
+            end
+         else
+            I = 0.3*I(:,:,1)+0.59*I(:,:,2)+0.11*I(:,:,3);
          end
-      else
-         I = 0.3*I(:,:,1)+0.59*I(:,:,2)+0.11*I(:,:,3);
+         I = imresize(I,display.res,'bilinear');
+         if ~strcmp(NMF.lfClass,'double')
+            I = cast(double(intmax(NMF.lfClass))*max(I,0).^(1/display.inGamma),NMF.lfClass);
+         end
+         LF.data.ideal(:,:,LF.dim(3)-bIdx+1,LF.dim(4)-aIdx+1,:) = I;
       end
-      I = imresize(I,display.res,'bilinear');
-      LF.data.ideal(:,:,LF.dim(3)-bIdx+1,LF.dim(4)-aIdx+1,:) = I;
    end
-end 
+end
 
 % Clear temporary variables.
-clear I;
+clear I pattern;
 
 %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 % Generate pinhole array masks.
@@ -123,46 +160,57 @@ clear I;
 % Display status.
 disp('> Generating pinhole array mask pairs...');
 
-% Allocate storage for translated pinhole array masks.
-for ch = 1:display.nChannels
-   LF.data.pinhole_W{ch} = zeros(prod(LF.dim(1:2)),prod(LF.dim(3:4)));
-   LF.data.pinhole_H{ch} = zeros(prod(LF.dim(3:4)),prod(LF.dim(1:2)));
-end
-
 % Generate pinhole array masks.
-k = 0;
-for bIdx = 1:display.nAngles(1)
-   for aIdx = 1:display.nAngles(2)
+% Note: The MEX generator writes the masks of all color channels at once
+%       (in the layout of the MEX solver), from the stored light field.
+if NMF.useMEX
+   [W,H] = lf_nmf_pinhole_mex(LF.data.ideal,display.inGamma,NMF.numThreads);
+   for ch = 1:display.nChannels
+      LF.data.pinhole_W{ch} = double(W(:,:,ch));
+      LF.data.pinhole_H{ch} = double(H(:,:,ch));
+   end
+else
+   % Allocate storage for translated pinhole array masks.
+   for ch = 1:display.nChannels
+      LF.data.pinhole_W{ch} = zeros(prod(LF.dim(1:2)),prod(LF.dim(3:4)));
+      LF.data.pinhole_H{ch} = zeros(prod(LF.dim(3:4)),prod(LF.dim(1:2)));
+   end
+
+   % Generate translated pinhole array masks.
+   k = 0;
+   for bIdx = 1:display.nAngles(1)
+      for aIdx = 1:display.nAngles(2)
       
-      % Generate front mask.
-      k = k+1;
-      H = zeros(display.res);
-      H(bIdx:display.nAngles(1):end,aIdx:display.nAngles(2):end) = 1.0;
-      for ch = 1:display.nChannels
-         LF.data.pinhole_H{ch}(k,:) = reshape(H',[],1);
-      end
+         % Generate front mask.
+         k = k+1;
+         H = zeros(display.res);
+         H(bIdx:display.nAngles(1):end,aIdx:display.nAngles(2):end) = 1.0;
+         for ch = 1:display.nChannels
+            LF.data.pinhole_H{ch}(k,:) = reshape(H',[],1);
+         end
       
-      % Generate rear mask.
-      W = zeros([display.res display.nChannels]);
-      W = padarray(W,display.nHalfAngles,0,'both');
-      for j = 1:display.nAngles(1)
-         for i = 1:display.nAngles(2)
-            I = squeeze(LF.data.ideal(:,:,display.nAngles(1)-j+1,display.nAngles(2)-i+1,:));
-            I = padarray(I,display.nHalfAngles,0,'both');
-            for chIdx = 1:3
-               W((bIdx+j-2)+(1:display.nAngles(1):display.res(1)),...
-                 (aIdx+i-2)+(1:display.nAngles(2):display.res(2)),:) = ...
-               I((bIdx+j-2)+(1:display.nAngles(1):display.res(1)),...
-                 (aIdx+i-2)+(1:display.nAngles(2):display.res(2)),:);
+         % Generate rear mask.
+         W = zeros([display.res display.nChannels]);
+         W = padarray(W,display.nHalfAngles,0,'both');
+         for j = 1:display.nAngles(1)
+            for i = 1:display.nAngles(2)
+               I = decodeLF(squeeze(LF.data.ideal(:,:,display.nAngles(1)-j+1,display.nAngles(2)-i+1,:)));
+               I = padarray(I,display.nHalfAngles,0,'both');
+               for chIdx = 1:3
+                  W((bIdx+j-2)+(1:display.nAngles(1):display.res(1)),...
+                    (aIdx+i-2)+(1:display.nAngles(2):display.res(2)),:) = ...
+                  I((bIdx+j-2)+(1:display.nAngles(1):display.res(1)),...
+                    (aIdx+i-2)+(1:display.nAngles(2):display.res(2)),:);
+               end
             end
          end
-      end
-      W = W((display.nHalfAngles(1)+1):(end-display.nHalfAngles(1)),...
-            (display.nHalfAngles(2)+1):(end-display.nHalfAngles(2)),:);
-      for ch = 1:display.nChannels       
-         LF.data.pinhole_W{ch}(:,k) = reshape(W(:,:,ch)',1,[]);
-      end
+         W = W((display.nHalfAngles(1)+1):(end-display.nHalfAngles(1)),...
+               (display.nHalfAngles(2)+1):(end-display.nHalfAngles(2)),:);
+         for ch = 1:display.nChannels       
+            LF.data.pinhole_W{ch}(:,k) = reshape(W(:,:,ch)',1,[]);
+         end
       
+      end
    end
 end
 
@@ -218,19 +266,43 @@ if NMF.enable
    end
    
    % Evaluate NMF of input light field.
-   for ch = 1:display.nChannels
-      if display.fullColor
-         colorOrder = {'red color','green color','blue color'};
+   % Note: The MEX solver factorizes all color channels in a single pass.
+   %       Integer light fields are passed as is (i.e., the gain, gamma, and
+   %       zero offset are applied by the solver, see NMFQuantized).
+   if NMF.useMEX
+      disp(' '); disp(['  <Processing ',int2str(display.nChannels),' color channel(s) jointly>']);
+      if strcmp(NMF.lfClass,'double')
+         lf = cast(NMF.gain*LF.data.ideal+1e-9*(LF.data.ideal == 0),NMF.precision);
       else
-         colorOrder = {'luminance'};
+         lf = LF.data.ideal;
       end
-      disp(' '); disp(['  <Processing ',colorOrder{ch},' channel>']);
-      if NMF.useMEX 
-         [LF.data.NMF_W{ch},LF.data.NMF_H{ch},LF.data.NMF_E{ch}] = ...
-            lf_nmf_2d_Euclidean_mex(...
-               NMF.gain*LF.data.ideal(:,:,:,:,ch)+1e-9*(LF.data.ideal(:,:,:,:,ch) == 0),...
-               W{ch},H{ch},NMF.numIter,NMF.fixFrontMask);
-      else
+      [NMF_W,NMF_H,NMF_E] = ...
+         lf_nmf_2d_Euclidean_mex(...
+            lf,...
+            cast(cat(3,W{:}),NMF.precision),cast(cat(3,H{:}),NMF.precision),...
+            NMF.numIter,NMF.fixFrontMask,NMF.minPSNR,...
+            struct('numThreads',NMF.numThreads,...
+                   'evalMode',NMF.evalMode,'evalInterval',NMF.evalInterval,...
+                   'tolObjective',NMF.tolObjective,'tolFactor',NMF.tolFactor,...
+                   'plateau',NMF.plateau,'logFile',NMF.logFile,...
+                   'numLevels',NMF.numLevels,'levelIter',NMF.levelIter,...
+                   'updateRule',NMF.updateRule,'innerIter',NMF.innerIter,...
+                   'gram',double(NMF.gram),'schedule',NMF.schedule,...
+                   'lfGamma',display.inGamma,'lfGain',NMF.gain,'lfEpsilon',1e-9));
+      for ch = 1:display.nChannels
+         LF.data.NMF_W{ch} = double(NMF_W(:,:,ch));
+         LF.data.NMF_H{ch} = double(NMF_H(:,:,ch));
+         LF.data.NMF_E{ch} = NMF_E(:,ch);
+      end
+      clear lf NMF_W NMF_H NMF_E;
+   else
+      for ch = 1:display.nChannels
+         if display.fullColor
+            colorOrder = {'red color','green color','blue color'};
+         else
+            colorOrder = {'luminance'};
+         end
+         disp(' '); disp(['  <Processing ',colorOrder{ch},' channel>']);
          [LF.data.NMF_W,LF.data.NMF_H] = ...
             lf_nmf_2d_Euclidean(...
                NMF.gain*LF.data.ideal(:,:,:,:,ch)+1e-9*(LF.data.ideal(:,:,:,:,ch) == 0),...
@@ -250,47 +322,69 @@ clear W H;
 % Display status.
 disp('> Evaluating reconstruction accuracy...');
 
-% Evaluate reconstruction using pinhole array mask pairs.
-LF.data.pinhole = zeros(LF.dim);
-for k = 1:prod(LF.dim(3:4))
-   for ch = 1:display.nChannels
-      W = reshape(LF.data.pinhole_W{ch}(:,k),LF.dim([2 1]))';
-      H = reshape(LF.data.pinhole_H{ch}(k,:),LF.dim([2 1]))';
-      for bIdx = 1:LF.dim(3)
-         for aIdx = 1:LF.dim(4)
-            bShift = bIdx-(LF.dim(3)+1)/2;
-            aShift = aIdx-(LF.dim(4)+1)/2;
-            LF.data.pinhole(:,:,bIdx,aIdx,ch) = ...
-               LF.data.pinhole(:,:,bIdx,aIdx,ch) + W.*zeroshift(H,-[bShift aShift]);
-         end
-      end
+% Evaluate reconstructions using pinhole array mask pairs and content-adaptive parallax barriers.
+% Note: The MEX evaluator reconstructs both in a single pass, and estimates
+%       the brightness gain from a histogram of the ratios (rather than
+%       the median of every ratio).
+if NMF.useMEX
+   W = []; H = [];
+   if NMF.enable
+      W = cat(3,LF.data.NMF_W{:});
+      H = cat(3,LF.data.NMF_H{:});
    end
-end
-
-% Evaluate reconstruction using content-adaptive parallax barriers.
-if 0
-   LF.data.NMF = zeros(LF.dim);
-   for k = 1:NMF.numPairs
+   [LF.data.pinhole,LF.data.NMF,LF.data.NMF_PSNR,LF.data.NMF_viewPSNR,gain] = ...
+      lf_nmf_evaluate_mex(LF.dim,...
+         cat(3,LF.data.pinhole_W{:}),cat(3,LF.data.pinhole_H{:}),W,H,...
+         NMF.gain,0.5,NMF.numThreads);
+   if NMF.enable
+      disp(['  + NMF achieves PSNR of ',num2str(LF.data.NMF_PSNR,'%0.1f'),' dB',...
+            ' (',num2str(min(LF.data.NMF_viewPSNR(:)),'%0.1f'),'-',...
+            num2str(max(LF.data.NMF_viewPSNR(:)),'%0.1f'),' dB per view)']);
+      disp(['  + NMF is ~',num2str(gain,'%0.1f'),'x brighter']);
+   end
+else
+   % Evaluate reconstruction using pinhole array mask pairs.
+   LF.data.pinhole = zeros(LF.dim);
+   for k = 1:prod(LF.dim(3:4))
       for ch = 1:display.nChannels
-         W = reshape(LF.data.NMF_W{ch}(:,k),LF.dim([2 1]))';
-         H = reshape(LF.data.NMF_H{ch}(k,:),LF.dim([2 1]))';
+         W = reshape(LF.data.pinhole_W{ch}(:,k),LF.dim([2 1]))';
+         H = reshape(LF.data.pinhole_H{ch}(k,:),LF.dim([2 1]))';
          for bIdx = 1:LF.dim(3)
             for aIdx = 1:LF.dim(4)
                bShift = bIdx-(LF.dim(3)+1)/2;
                aShift = aIdx-(LF.dim(4)+1)/2;
-               LF.data.NMF(:,:,bIdx,aIdx,ch) = ...
-                  LF.data.NMF(:,:,bIdx,aIdx,ch) + W.*zeroshift(H,-[bShift aShift]);
+               LF.data.pinhole(:,:,bIdx,aIdx,ch) = ...
+                  LF.data.pinhole(:,:,bIdx,aIdx,ch) + W.*zeroshift(H,-[bShift aShift]);
             end
          end
       end
    end
-   LF.data.NMF_MSE = sum((NMF.gain*LF.data.pinhole(:)-LF.data.NMF(:)).^2)/prod(LF.dim);
-   LF.data.NMF_PSNR = 10*log10((NMF.gain*max(LF.data.pinhole(:)))^2/LF.data.NMF_MSE);
-   disp(['  + NMF achieves PSNR of ',num2str(LF.data.NMF_PSNR,'%0.1f'),' dB']);
-   gain = LF.data.NMF(:)./LF.data.pinhole(:);
-   gain = gain(isfinite(gain));
-   gain = median(gain);
-   disp(['  + NMF is ~',num2str(gain,'%0.1f'),'x brighter']);
+
+   % Evaluate reconstruction using content-adaptive parallax barriers.
+   if 0
+      LF.data.NMF = zeros(LF.dim);
+      for k = 1:NMF.numPairs
+         for ch = 1:display.nChannels
+            W = reshape(LF.data.NMF_W{ch}(:,k),LF.dim([2 1]))';
+            H = reshape(LF.data.NMF_H{ch}(k,:),LF.dim([2 1]))';
+            for bIdx = 1:LF.dim(3)
+               for aIdx = 1:LF.dim(4)
+                  bShift = bIdx-(LF.dim(3)+1)/2;
+                  aShift = aIdx-(LF.dim(4)+1)/2;
+                  LF.data.NMF(:,:,bIdx,aIdx,ch) = ...
+                     LF.data.NMF(:,:,bIdx,aIdx,ch) + W.*zeroshift(H,-[bShift aShift]);
+               end
+            end
+         end
+      end
+      LF.data.NMF_MSE = sum((NMF.gain*LF.data.pinhole(:)-LF.data.NMF(:)).^2)/prod(LF.dim);
+      LF.data.NMF_PSNR = 10*log10((NMF.gain*max(LF.data.pinhole(:)))^2/LF.data.NMF_MSE);
+      disp(['  + NMF achieves PSNR of ',num2str(LF.data.NMF_PSNR,'%0.1f'),' dB']);
+      gain = LF.data.NMF(:)./LF.data.pinhole(:);
+      gain = gain(isfinite(gain));
+      gain = median(gain);
+      disp(['  + NMF is ~',num2str(gain,'%0.1f'),'x brighter']);
+   end
 end
 
 % Clear temporary variables.
@@ -300,11 +394,19 @@ clear W H gain;
 % Write images for each mask (if enabled).
 
 % Write images for each mask (if enabled).
-% Note: Gamma-compress depending on measured display gamma value.
+% Note: Gamma-compress depending on measured display gamma value. The MEX
+%       writer encodes PNG images in the background (i.e., the display
+%       below proceeds while the masks are saved); images queued by a
+%       previous run are written before the output directories are reset,
+%       and the queue is drained at the end of this script.
 if options.saveMasks
 
    % Display status.
    disp('> Saving mask images...');
+   useWriter = NMF.useMEX && strcmp(image.frameExt,'png');
+   if useWriter
+      lf_nmf_save_mex('wait');
+   end
    
    % Create output directory.
    outputDir = [image.frameDir,'masks/pinhole/'];
@@ -324,19 +426,27 @@ if options.saveMasks
 
    % Write pinhole array mask pairs.
    disp('  - Saving pinhole array mask pairs...');
-   for k = 1:prod(LF.dim(3:4))
-      W = zeros([display.res display.nChannels]);
-      H = zeros([display.res display.nChannels]);
-      for ch = 1:display.nChannels
-         W(:,:,ch) = reshape(LF.data.pinhole_W{ch}(:,k),LF.dim([2 1]))';
-         H(:,:,ch) = reshape(LF.data.pinhole_H{ch}(k,:),LF.dim([2 1]))';
+   if useWriter
+      pattern = [image.frameCount,'.',image.frameExt];
+      lf_nmf_save_mex('write',[strrep(outputDir,'%','%%'),'W/',pattern],...
+         [strrep(outputDir,'%','%%'),'H/',pattern],LF.dim(1:2),...
+         cat(3,LF.data.pinhole_W{:}),cat(3,LF.data.pinhole_H{:}),...
+         display.outGamma,NMF.numThreads);
+   else
+      for k = 1:prod(LF.dim(3:4))
+         W = zeros([display.res display.nChannels]);
+         H = zeros([display.res display.nChannels]);
+         for ch = 1:display.nChannels
+            W(:,:,ch) = reshape(LF.data.pinhole_W{ch}(:,k),LF.dim([2 1]))';
+            H(:,:,ch) = reshape(LF.data.pinhole_H{ch}(k,:),LF.dim([2 1]))';
+         end
+         W = W.^(1/display.outGamma);
+         H = H.^(1/display.outGamma);
+         imwrite(uint8(255*W),...
+            [outputDir,'W/',num2str(k,image.frameCount),'.',image.frameExt]);
+         imwrite(uint8(255*H),...
+            [outputDir,'H/',num2str(k,image.frameCount),'.',image.frameExt]);
       end
-      W = W.^(1/display.outGamma);
-      H = H.^(1/display.outGamma);
-      imwrite(uint8(255*W),...
-         [outputDir,'W/',num2str(k,image.frameCount),'.',image.frameExt]);
-      imwrite(uint8(255*H),...
-         [outputDir,'H/',num2str(k,image.frameCount),'.',image.frameExt]);
    end
 
    % Write content-adaptive parallax barriers.
@@ -361,24 +471,32 @@ if options.saveMasks
       % Write content-adaptive parallax barriers.
       disp('  - Saving content-adaptive parallax barriers...');
       delete('./masks/NMF/*.png');
-      for k = 1:NMF.numPairs
-         W = zeros([display.res display.nChannels]);
-         H = zeros([display.res display.nChannels]);
-         for ch = 1:display.nChannels
-            W(:,:,ch) = reshape(LF.data.NMF_W{ch}(:,k),LF.dim([2 1]))';
-            H(:,:,ch) = reshape(LF.data.NMF_H{ch}(k,:),LF.dim([2 1]))';
+      if useWriter
+         pattern = [image.frameCount,'.',image.frameExt];
+         lf_nmf_save_mex('write',[strrep(outputDir,'%','%%'),'W/',pattern],...
+            [strrep(outputDir,'%','%%'),'H/',pattern],LF.dim(1:2),...
+            cat(3,LF.data.NMF_W{:}),cat(3,LF.data.NMF_H{:}),...
+            display.outGamma,NMF.numThreads);
+      else
+         for k = 1:NMF.numPairs
+            W = zeros([display.res display.nChannels]);
+            H = zeros([display.res display.nChannels]);
+            for ch = 1:display.nChannels
+               W(:,:,ch) = reshape(LF.data.NMF_W{ch}(:,k),LF.dim([2 1]))';
+               H(:,:,ch) = reshape(LF.data.NMF_H{ch}(k,:),LF.dim([2 1]))';
+            end
+            W = W.^(1/display.outGamma);
+            H = H.^(1/display.outGamma);
+            imwrite(uint8(255*W),...
+               [outputDir,'W/',num2str(k,image.frameCount),'.',image.frameExt]);
+            imwrite(uint8(255*H),...
+               [outputDir,'H/',num2str(k,image.frameCount),'.',image.frameExt]);
          end
-         W = W.^(1/display.outGamma);
-         H = H.^(1/display.outGamma);
-         imwrite(uint8(255*W),...
-            [outputDir,'W/',num2str(k,image.frameCount),'.',image.frameExt]);
-         imwrite(uint8(255*H),...
-            [outputDir,'H/',num2str(k,image.frameCount),'.',image.frameExt]);
       end
    end
 
    % Clear temporary variables.
-   clear W H;
+   clear W H pattern;
    
 end
 
@@ -465,8 +583,9 @@ if NMF.enable && NMF.useMEX
          maxE = 1000;
       end
       E = LF.data.NMF_E{ch};
-      E(~isfinite(E)) = 1.1*maxE;
-      plot(1:length(E),E,'-',...
+      E(isinf(E)) = 1.1*maxE;
+      idx = find(~isnan(E));
+      plot(idx,E(idx),'-',...
          'LineWidth',3,'Color',colorOrder{ch});
       hold on;
    end
@@ -477,5 +596,11 @@ if NMF.enable && NMF.useMEX
    set(gca,'LineWidth',2,'FontWeight','bold','FontSize',14);
 end
 
+% Wait for the mask images queued above (if enabled).
+% Note: Errors raised by the background writer are reported here.
+if options.saveMasks && useWriter
+   lf_nmf_save_mex('wait');
+end
+
 % Clear temporary variables.
-clear W H E;
+clear W H E useWriter;
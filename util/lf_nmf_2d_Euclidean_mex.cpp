@@ -9,46 +9,43 @@
 
 // Define included files.
 #include <math.h>
+#include <stdio.h>
 #include <cstring>
 #include "mex.h"
+#include "lf_nmf_engine.h"
 
 // Define pointers to input/output arguments.
-#define LF_IN       prhs[0] // (input) 4D light fiel
+#define LF_IN       prhs[0] // (input) 4D light field (or 5D/6D, for several color channels/frames)
 #define W_IN        prhs[1] // (input) initial rear masks
 #define H_IN        prhs[2] // (input) initial front masks
 #define NITER_IN    prhs[3] // (input) number of iterations
 #define FIX_H_IN    prhs[4] // (input) flag to disable front mask update
 #define MIN_PSNR_IN prhs[5] // (input) minimum PSNR (stop if exceeded)
+#define OPTIONS_IN  prhs[6] // (input) solver options (e.g., number of threads)
 #define W_OUT       plhs[0] // (output) optimized rear mask pairs
 #define H_OUT       plhs[1] // (output) optimized front mask pairs
 #define E_OUT       plhs[2] // (output) PSNR as a function of iteration index
 
-// Define macros for element-wise minimum/maximum operations.
+// Define macro for element-wise maximum operation.
 #define MAX(a,b) ((a)>(b)?(a):(b))
-#define MIN(a,b) ((a)>(b)?(b):(a))
-
-// Define macro to determine if input is NaN.
-#ifndef isnan
-   #define isnan(x) ((x)!=(x))
-#endif
-
-// Declare structure for storing range of mask indices.
-typedef struct {
-   unsigned int start;
-   unsigned int finish;
-   unsigned int length;
-} MaskIndices;
 
 // Declare auxiliary functions.
 unsigned long mxArrayReadScalar(const mxArray*);
-inline unsigned int su_idx(unsigned int, unsigned int);
-inline unsigned int tv_idx(unsigned int, unsigned int);
-inline MaskIndices SU_MaskIndices(unsigned int, unsigned int*, unsigned int);
-inline MaskIndices TV_MaskIndices(unsigned int, unsigned int*, unsigned int);
-inline unsigned int num_indices(MaskIndices*, MaskIndices*);
-inline unsigned int curr_idx(unsigned int, unsigned int, unsigned int, 
-        MaskIndices*, MaskIndices*, unsigned int*, unsigned int);
-inline int ab_idx(unsigned int, unsigned int, unsigned int, unsigned int);
+unsigned long mxStructReadScalar(const mxArray*, const char*, unsigned long);
+double mxStructReadDouble(const mxArray*, const char*, double);
+unsigned int mxStructReadPSNRMode(const mxArray*, const char*, unsigned int);
+unsigned int mxStructReadRule(const mxArray*, const char*, unsigned int);
+unsigned int mxStructReadSchedule(const mxArray*, const char*, unsigned int);
+static void mex_print(const char*);
+static void mex_log(const char*);
+static void mex_release_plan();
+
+// Define persistent neighborhood geometry (see LF_NMF_PLAN).
+// Note: Consecutive calls (e.g., for each frame) share the same plan.
+static NMFPlan* plan = NULL;
+
+// Define telemetry output file (see NMFOptions).
+static FILE* log_file = NULL;
 
 // Define MEX-file gateway routine.
 void mexFunction(
@@ -56,43 +53,59 @@ void mexFunction(
     int nrhs, const mxArray* prhs[]){
    
    // Verify number of input arguments.
-   if(nrhs < 4 || nrhs > 6 )
-      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected four, five, or six).");
+   if(nrhs < 4 || nrhs > 7 )
+      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected four to seven).");
    
    // Verify first input argument (i.e., a 4D light field matrix).
-   double* lf = mxGetPr(LF_IN);
-   if(lf == NULL)
+   // Note: Single-precision inputs are factorized in single precision. A 5D
+   //       light field [v u b a ch] factorizes all color channels jointly,
+   //       and a 6D light field [v u b a ch F] factorizes F frames in turn
+   //       (warm-starting each frame with the masks of the previous one).
+   //       A uint8 or uint16 light field is dequantized by the solver (see
+   //       NMFQuantized), in the precision of the initial masks.
+   if(mxGetData(LF_IN) == NULL)
       mexErrMsgTxt("Input light field is invalid.");
-   if(mxGetNumberOfDimensions(LF_IN) != 4)
-      mexErrMsgTxt("Input light field must be four-dimensional.");
-   if(!mxIsDouble(LF_IN))
-      mexErrMsgTxt("Input light field must be of type double.");
+   if(mxGetNumberOfDimensions(LF_IN) < 4 || mxGetNumberOfDimensions(LF_IN) > 6)
+      mexErrMsgTxt("Input light field must be four-, five-, or six-dimensional.");
+   if(!mxIsDouble(LF_IN) && !mxIsSingle(LF_IN) && !mxIsUint8(LF_IN) && !mxIsUint16(LF_IN))
+      mexErrMsgTxt("Input light field must be of type double, single, uint8, or uint16.");
+   bool quantized = mxIsUint8(LF_IN) || mxIsUint16(LF_IN);
+   mxClassID lf_class = quantized ? mxGetClassID(W_IN) : mxGetClassID(LF_IN);
+   if(quantized && lf_class != mxDOUBLE_CLASS && lf_class != mxSINGLE_CLASS)
+      mexErrMsgTxt("Input masks must be of type double or single.");
    const mwSize* mw_lf_dim = mxGetDimensions(LF_IN);
    unsigned int lf_dim[4];
    for(int i=0; i<4; i++)
       lf_dim[i] = mw_lf_dim[i];
    unsigned long N = lf_dim[0]*lf_dim[1];
+   unsigned int C = (mxGetNumberOfDimensions(LF_IN) >= 5) ? mw_lf_dim[4] : 1;
+   unsigned int F = (mxGetNumberOfDimensions(LF_IN) == 6) ? mw_lf_dim[5] : 1;
       
    // Verify second and third input arguments (i.e., initial mask pairs).
-   if(mxGetNumberOfDimensions(W_IN) != 2)
-      mexErrMsgTxt("Input rear masks W must be two-dimensional.");
-   if(mxGetNumberOfDimensions(H_IN) != 2)
-      mexErrMsgTxt("Input front masks H must be two-dimensional.");
-   if(!mxIsDouble(W_IN))
-      mexErrMsgTxt("Input rear masks W must be of type double.");
-   if(!mxIsDouble(H_IN))
-      mexErrMsgTxt("Input front masks H must be of type double.");
-   if(mxGetN(W_IN) != mxGetM(H_IN))
+   // Note: Mask pairs for several color channels are stacked along the
+   //       third dimension (i.e., W is N x R x ch and H is R x N x ch). For
+   //       several frames, these are the initial masks of the first frame.
+   if(mxGetNumberOfDimensions(W_IN) != ((C > 1) ? 3 : 2))
+      mexErrMsgTxt("Input rear masks W must have one page per color channel.");
+   if(mxGetNumberOfDimensions(H_IN) != ((C > 1) ? 3 : 2))
+      mexErrMsgTxt("Input front masks H must have one page per color channel.");
+   if(mxGetClassID(W_IN) != lf_class)
+      mexErrMsgTxt("Input rear masks W must be of the same type as the light field.");
+   if(mxGetClassID(H_IN) != lf_class)
+      mexErrMsgTxt("Input front masks H must be of the same type as the light field.");
+   const mwSize* W_dim = mxGetDimensions(W_IN);
+   const mwSize* H_dim = mxGetDimensions(H_IN);
+   if(W_dim[1] != H_dim[0])
       mexErrMsgTxt("Number of columns in W must equal number of rows in H.");
-   unsigned long R = mxGetN(W_IN);  
-   if(mxGetM(W_IN) != N || mxGetN(W_IN) != R){
+   unsigned long R = W_dim[1];  
+   if(W_dim[0] != N || mxGetNumberOfElements(W_IN) != N*R*C){
       char msg[1024];
-      sprintf(msg,"Input rear masks W must have dimensions %dx%d.", N, R);
+      sprintf(msg,"Input rear masks W must have dimensions %lux%lux%u.", N, R, C);
       mexErrMsgTxt(msg);
    }  
-   if(mxGetM(H_IN) != R || mxGetN(H_IN) != N){
+   if(H_dim[1] != N || mxGetNumberOfElements(H_IN) != R*N*C){
       char msg[1024];
-      sprintf(msg,"Input front masks H must have dimensions %dx%d.", R, N);
+      sprintf(msg,"Input front masks H must have dimensions %lux%lux%u.", R, N, C);
       mexErrMsgTxt(msg);
    }
    
@@ -105,7 +118,7 @@ void mexFunction(
    
    // Verify fifth input argument (i.e., flag to enable/disable fixed front masks).
    bool fix_H = false;
-   if(nrhs == 5){
+   if(nrhs >= 5){
       if (!mxIsLogical(FIX_H_IN))
          mexErrMsgTxt("Input flag to disable front mask update must be Boolean.");
       if (mxGetNumberOfElements(FIX_H_IN) != 1)
@@ -114,183 +127,151 @@ void mexFunction(
    }
    
    // Verify sixth input argument (i.e., minimum PSNR).
+   // Note: Read as a double (i.e., fractional thresholds are preserved).
    double min_PSNR = 1000.0;
-   if(nrhs == 6){
+   if(nrhs >= 6){
       if(!mxIsNumeric(MIN_PSNR_IN))
          mexErrMsgTxt("Minimum PSNR (stopping criterion) be a numerical value.");
-      if(mxGetNumberOfElements(NITER_IN) != 1)
+      if(mxGetNumberOfElements(MIN_PSNR_IN) != 1)
          mexErrMsgTxt("Minimum PSNR (stopping criterion) must be scalar.");
-      min_PSNR = mxArrayReadScalar(MIN_PSNR_IN);   
+      min_PSNR = mxGetScalar(MIN_PSNR_IN);
    }
    
-   // Evaluate intermediate variables (e.g., angles and half-angles).
-   unsigned int nAngles[2];
-   nAngles[0] = lf_dim[2];
-   nAngles[1] = lf_dim[3];
-   unsigned int nHalfAngles[2];
-   nHalfAngles[0] = (nAngles[0]-1)/2;
-   nHalfAngles[1] = (nAngles[1]-1)/2;
+   // Verify seventh input argument (i.e., structure of solver options).
+   // Note: Supported fields are "numThreads" (0: all hardware threads),
+   //       "warmIter" and "warmTolObjective" (number of iterations and
+   //       relative objective change for warm-started frames, see
+   //       lf_nmf_warm_options),
+   //       "evalMode" ('full', 'fused', or 'sampled'), "evalInterval"
+   //       (iterations between PSNR evaluations), "evalSamples" (number
+   //       of rays sampled in 'sampled' mode), the stopping rules
+   //       "tolObjective", "tolFactor", and "plateau", "logFile" (name
+   //       of a comma-separated telemetry file, see NMFOptions), and
+   //       "numLevels" and "levelIter" (number of resolution levels and
+   //       iterations at each coarser level, see lf_nmf_2d_Euclidean), and
+   //       "updateRule" ('mu', 'hals', or 'amu') and "innerIter" (number
+   //       of inner passes, see LF_NMF_RULES), "gram" (nonzero to
+   //       evaluate the denominators from window Gram matrices), and
+   //       "schedule" ('jacobi' or 'gs', see NMFOptions), and "lfGamma",
+   //       "lfGain", and "lfEpsilon" (exponent, gain, and value of zero
+   //       elements of a uint8 or uint16 light field, see NMFQuantized).
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   NMFQuantized lf_quant;
+   lf_quant.type    = mxIsUint8(LF_IN) ? LF_NMF_QUANT_UINT8 : LF_NMF_QUANT_UINT16;
+   lf_quant.data    = mxGetData(LF_IN);
+   lf_quant.gamma   = 1.0;
+   lf_quant.gain    = 1.0;
+   lf_quant.epsilon = 1e-9;
+   unsigned long nthreads = 0;
+   unsigned long warm_niter = MAX(niter/4, 1);
+   double warm_tol = -1;
+   if(nrhs == 7){
+      if(!mxIsStruct(OPTIONS_IN))
+         mexErrMsgTxt("Solver options must be a structure.");
+      nthreads = mxStructReadScalar(OPTIONS_IN, "numThreads", nthreads);
+      opt.PSNR_mode = mxStructReadPSNRMode(OPTIONS_IN, "evalMode", opt.PSNR_mode);
+      opt.PSNR_interval = mxStructReadScalar(OPTIONS_IN, "evalInterval", opt.PSNR_interval);
+      opt.PSNR_samples = mxStructReadScalar(OPTIONS_IN, "evalSamples", opt.PSNR_samples);
+      opt.tol_objective = mxStructReadDouble(OPTIONS_IN, "tolObjective", opt.tol_objective);
+      opt.tol_factor = mxStructReadDouble(OPTIONS_IN, "tolFactor", opt.tol_factor);
+      opt.plateau = mxStructReadScalar(OPTIONS_IN, "plateau", opt.plateau);
+      opt.levels = mxStructReadScalar(OPTIONS_IN, "numLevels", opt.levels);
+      opt.level_iter = mxStructReadScalar(OPTIONS_IN, "levelIter", opt.level_iter);
+      if(opt.levels > 1 && lf_dim[2] != 1 && lf_dim[3] != 1)
+         mexErrMsgTxt("Solver option \"numLevels\" requires a single view along one axis.");
+      opt.rule = mxStructReadRule(OPTIONS_IN, "updateRule", opt.rule);
+      opt.inner_iter = mxStructReadScalar(OPTIONS_IN, "innerIter", opt.inner_iter);
+      opt.gram = mxStructReadScalar(OPTIONS_IN, "gram", opt.gram) != 0;
+      opt.schedule = mxStructReadSchedule(OPTIONS_IN, "schedule", opt.schedule);
+      mxArray* field = mxGetField(OPTIONS_IN, 0, "logFile");
+      if(field != NULL && !mxIsEmpty(field)){
+         char log_fn[1024];
+         if(!mxIsChar(field) || mxGetString(field, log_fn, sizeof(log_fn)))
+            mexErrMsgTxt("Solver option \"logFile\" must be a file name.");
+         log_file = fopen(log_fn, "w");
+         if(log_file == NULL)
+            mexErrMsgTxt("Solver option \"logFile\" could not be opened for writing.");
+         opt.log = mex_log;
+      }
+      warm_niter = mxStructReadScalar(OPTIONS_IN, "warmIter", warm_niter);
+      warm_tol = mxStructReadDouble(OPTIONS_IN, "warmTolObjective", warm_tol);
+      lf_quant.gamma = mxStructReadDouble(OPTIONS_IN, "lfGamma", lf_quant.gamma);
+      lf_quant.gain = mxStructReadDouble(OPTIONS_IN, "lfGain", lf_quant.gain);
+      lf_quant.epsilon = mxStructReadDouble(OPTIONS_IN, "lfEpsilon", lf_quant.epsilon);
+   }
    
    // Initialze the front/rear mask pairs (for each temporally-multiplexed frame).
-   mxArray* W = mxCreateNumericMatrix(mxGetM(W_IN), mxGetN(W_IN), mxDOUBLE_CLASS, mxREAL);
-   mxArray* H = mxCreateNumericMatrix(mxGetM(H_IN), mxGetN(H_IN), mxDOUBLE_CLASS, mxREAL);
-   memcpy((double*)mxGetData(W), 
-          (double*)mxGetData(W_IN), 
-          sizeof(double)*mxGetM(W)*mxGetN(W));
-   memcpy((double*)mxGetData(H), 
-          (double*)mxGetData(H_IN), 
-          sizeof(double)*mxGetM(H)*mxGetN(H));
-   double* W_data  = mxGetPr(W);
-   double* H_data  = mxGetPr(H);
-      
-   // Allocate intermediate variables for evaluating the update rule.
-   mxArray* W0 = mxCreateNumericMatrix(mxGetM(W), mxGetN(W), mxDOUBLE_CLASS, mxREAL);
-   mxArray* H0 = mxCreateNumericMatrix(mxGetM(H), mxGetN(H), mxDOUBLE_CLASS, mxREAL);
-   double* W0_data = mxGetPr(W0);
-   double* H0_data = mxGetPr(H0);
+   // Note: For several frames, the initial masks are copied to the first frame.
+   mwSize WF_dim[4] = {W_dim[0], W_dim[1], C, F};
+   mwSize HF_dim[4] = {H_dim[0], H_dim[1], C, F};
+   mxArray* W = mxCreateNumericArray((F > 1) ? 4 : mxGetNumberOfDimensions(W_IN), WF_dim, lf_class, mxREAL);
+   mxArray* H = mxCreateNumericArray((F > 1) ? 4 : mxGetNumberOfDimensions(H_IN), HF_dim, lf_class, mxREAL);
+   memcpy(mxGetData(W), 
+          mxGetData(W_IN), 
+          mxGetElementSize(W)*mxGetNumberOfElements(W_IN));
+   memcpy(mxGetData(H), 
+          mxGetData(H_IN), 
+          mxGetElementSize(H)*mxGetNumberOfElements(H_IN));
    
    // Allocate PSNR array (if necessary).
-   bool evaluate_PSNR = false;
+   // Note: Iterations skipped by the evaluation interval are set to NaN.
+   opt.niter    = niter;
+   opt.fix_H    = fix_H;
+   opt.min_PSNR = min_PSNR;
+   opt.nthreads = nthreads;
+   opt.print    = mex_print;
    mxArray* E = NULL;
    double* E_data = NULL;
    if(nlhs > 2 || nrhs > 5){
-      evaluate_PSNR = true;
-      E = mxCreateNumericMatrix(niter, 1, mxDOUBLE_CLASS, mxREAL);
+      opt.evaluate_PSNR = true;
+      mwSize E_dim[3] = {MAX(niter, warm_niter), C, F};
+      E = mxCreateNumericArray((F > 1) ? 3 : 2, E_dim, mxDOUBLE_CLASS, mxREAL);
       E_data = mxGetPr(E);
    }
    
-   // Apply the weighted multiplicative update rule.
-   for(unsigned int iter=0; iter<niter; iter++) {
-         
-      // Evaluate PSNR of light field approximation (if necessary).
-      if(evaluate_PSNR){
-         double MSE = 0;
-         double max_elem = 0;
-         double num_elem = 0;
-         for(unsigned int b=0; b<lf_dim[2]; b++){
-            for(unsigned int a=0; a<lf_dim[3]; a++){
-               for(unsigned int v=0; v<lf_dim[0]; v++){
-                  for(unsigned int u=0; u<lf_dim[1]; u++){
-                     unsigned int s = u+(a-nHalfAngles[1]);
-                     unsigned int t = v+(b-nHalfAngles[0]);
-                     if(s>=0 && s<lf_dim[1] && t>=0 && t<lf_dim[0]){    
-                        double lf_approx = 0;
-                        for(unsigned int r=0; r<R; r++){
-                           unsigned int i = mw_lf_dim[1]*v+u;
-                           unsigned int j = mw_lf_dim[1]*t+s;
-                           lf_approx += W_data[r*N+i]*H_data[j*R+r];            
-                        }
-                        MSE += pow(lf[mw_lf_dim[0]*(mw_lf_dim[1]*
-                                     (mw_lf_dim[2]*a+b)+u)+v] - lf_approx, 2);
-                        max_elem = MAX(max_elem, 
-                           lf[mw_lf_dim[0]*(mw_lf_dim[1]*(mw_lf_dim[2]*a+b)+u)+v]);
-                        num_elem++;
-                     }
-                  }
-               }
-            }
-         }
-         MSE /= num_elem;
-         E_data[iter] = (double)(10.0*log10(pow(max_elem, 2)/MSE));
-         if(E_data[iter] > min_PSNR){
-            mexPrintf("  + Stopping at iteration #%03d (PSNR = %4.1f dB > %4.1f dB)...\n",
-                      iter+1, E_data[iter], min_PSNR);
-            for(unsigned int i=iter+1; i<niter; i++)
-               E_data[i] = E_data[iter];
-            if(nlhs > 0)
-               W_OUT = W;
-            if(nlhs > 1)
-               H_OUT = H;
-            if(nlhs > 2)
-               E_OUT = E;
-            return;
-         }
-         if((iter%10)==0){
-            mexPrintf("  + Updating for iteration #%03d (initial PSNR = %4.1f dB)...\n", 
-                      iter+1, E_data[iter]);
-         }
-      }
-      else{
-         if((iter%10)==0)
-            mexPrintf("  + Updating for iteration #%d...\n", iter+1);
-      }
-      mexEvalString("drawnow");
-      
-      // Initialize factorization using previous result.
-      memcpy(W0_data, W_data, sizeof(double)*mxGetM(W)*mxGetN(W));
-      memcpy(H0_data, H_data, sizeof(double)*mxGetM(H)*mxGetN(H));
-         
-      // Update the front mask pairs (i.e., the "H" matrix).
-      if(!fix_H){
-         memset(H_data, 0, sizeof(double)*mxGetM(H)*mxGetN(H));
-         for(unsigned int j=0; j<N; j++) {
-            unsigned int s = su_idx(j, lf_dim[1]);
-            unsigned int t = tv_idx(j, lf_dim[1]);
-            MaskIndices S = SU_MaskIndices(s, nHalfAngles, lf_dim[1]);
-            MaskIndices T = TV_MaskIndices(t, nHalfAngles, lf_dim[0]);
-            for(unsigned int r=0; r<R; r++){
-               double num = 0;
-               double den = 0;
-               unsigned int I = num_indices(&S, &T);
-               for(unsigned int i=0; i<I; i++){
-                  unsigned int ii = curr_idx(i, s, t, &S, &T, nHalfAngles, lf_dim[1]);
-                  unsigned int u = su_idx(ii, lf_dim[1]);
-                  unsigned int v = tv_idx(ii, lf_dim[1]);
-                  int a = (nAngles[1]-1)-ab_idx(s, u, nHalfAngles[1], nAngles[1]);
-                  int b = (nAngles[0]-1)-ab_idx(t, v, nHalfAngles[0], nAngles[0]);
-                  double dotp = 0;
-                  for(unsigned int dp=0; dp<R; dp++)
-                     dotp += W0_data[dp*N+ii]*H0_data[j*R+dp];
-                  num += W0_data[ii+r*N]*
-                     lf[mw_lf_dim[0]*(mw_lf_dim[1]*(mw_lf_dim[2]*a+b)+u)+v];
-                  den += W0_data[r*N+ii]*dotp;
-               }
-               H_data[j*R+r] = H0_data[j*R+r]*(num/den);
-            }
-         }
-         for(unsigned int i=0; i<mxGetM(H)*mxGetN(H); i++){
-            H_data[i] = MIN(H_data[i], 1);
-            if(isnan(H_data[i])) 
-               H_data[i] = 1.0;
-         }
-      }
-
-      // Update the rear mask pairs (i.e., the "W" matrix).
-      memcpy(H0_data, H_data, sizeof(double)*mxGetM(H)*mxGetN(H));
-      memset(W_data, 0, sizeof(double)*mxGetM(W)*mxGetN(W));
-      for(unsigned int i=0; i<N; i++){
-         unsigned int u = su_idx(i, lf_dim[1]);
-         unsigned int v = tv_idx(i, lf_dim[1]);
-         MaskIndices U = SU_MaskIndices(u, nHalfAngles, lf_dim[1]);
-         MaskIndices V = TV_MaskIndices(v, nHalfAngles, lf_dim[0]);
-         for(unsigned int r=0; r<R; r++){
-            double num = 0;
-            double den = 0;
-            unsigned int J = num_indices(&U, &V);
-            for(unsigned int j=0; j<J; j++){
-               unsigned int jj = curr_idx(j, u, v, &U, &V, nHalfAngles, lf_dim[1]);
-               unsigned int s = su_idx(jj, lf_dim[1]);
-               unsigned int t = tv_idx(jj, lf_dim[1]);
-               int a = (nAngles[1]-1)-ab_idx(s, u, nHalfAngles[1], nAngles[1]);
-               int b = (nAngles[0]-1)-ab_idx(t, v, nHalfAngles[0], nAngles[0]);
-               double dotp = 0;
-               for(unsigned int dp=0; dp<R; dp++)
-                  dotp += W0_data[dp*N+i]*H0_data[jj*R+dp];
-               num += H0_data[jj*R+r]*
-                  lf[mw_lf_dim[0]*(mw_lf_dim[1]*(mw_lf_dim[2]*a+b)+u)+v];
-               den += H0_data[jj*R+r]*dotp;
-            }
-            W_data[r*N+i] = W0_data[r*N+i]*(num/den);
-         }
-      }
-      for(unsigned int i=0; i<mxGetM(W)*mxGetN(W); i++){
-         W_data[i] = MIN(W_data[i], 1);
-         if(isnan(W_data[i]))
-            W_data[i] = 1.0;
-      }
-      
+   // Initialize options for warm-started frames (if necessary).
+   // Note: Only the first frame reports the progress of each iteration.
+   NMFOptions opt_warm;
+   lf_nmf_warm_options(&opt, &opt_warm);
+   opt_warm.niter = warm_niter;
+   if(warm_tol >= 0)
+      opt_warm.tol_objective = warm_tol;
+   opt_warm.print = NULL;   
+   // Create neighborhood geometry (unless cached by a previous call).
+   if(plan == NULL || !lf_nmf_plan_matches(plan, lf_dim)){
+      mex_release_plan();
+      plan = lf_nmf_create_plan(lf_dim);
+      mexAtExit(mex_release_plan);
    }
    
+   // Apply the weighted multiplicative update rule (to all color channels).
+   if(quantized && lf_class == mxSINGLE_CLASS)
+      lf_nmf_2d_Euclidean_quantized(plan, &lf_quant, C, F,
+                                    (float*)mxGetData(W), (float*)mxGetData(H), R,
+                                    &opt, &opt_warm, E_data);
+   else if(quantized)
+      lf_nmf_2d_Euclidean_quantized(plan, &lf_quant, C, F,
+                                    mxGetPr(W), mxGetPr(H), R, &opt, &opt_warm, E_data);
+   else if(lf_class == mxSINGLE_CLASS && F > 1)
+      lf_nmf_2d_Euclidean_video(plan, (float*)mxGetData(LF_IN), C, F,
+                                (float*)mxGetData(W), (float*)mxGetData(H), R,
+                                &opt, &opt_warm, E_data);
+   else if(lf_class == mxSINGLE_CLASS)
+      lf_nmf_2d_Euclidean_channels(plan, (float*)mxGetData(LF_IN), C,
+                                   (float*)mxGetData(W), (float*)mxGetData(H), R, &opt, E_data);
+   else if(F > 1)
+      lf_nmf_2d_Euclidean_video(plan, mxGetPr(LF_IN), C, F,
+                                mxGetPr(W), mxGetPr(H), R, &opt, &opt_warm, E_data);
+   else
+      lf_nmf_2d_Euclidean_channels(plan, mxGetPr(LF_IN), C,
+                                   mxGetPr(W), mxGetPr(H), R, &opt, E_data);
+   
+   // Close telemetry output (if necessary).
+   if(log_file != NULL)
+      fclose(log_file);
+   log_file = NULL;
+   
    // Return optimized front/rear mask pairs.
    if(nlhs > 0)
       W_OUT = W;
@@ -303,54 +284,106 @@ void mexFunction(
    return;
 }
 
-// Define inline function to return row index, given linear index.
-// Note: Assumes linear index into mask, wrapped in "row-major" order.
-inline unsigned int su_idx(unsigned int i, unsigned int N){
-   return i%(unsigned int)N;
+// Define status output routine (flushes the Matlab command window).
+static void mex_print(const char* msg){
+   mexPrintf("%s", msg);
+   mexEvalString("drawnow");
+}
+
+// Define telemetry output routine.
+static void mex_log(const char* msg){
+   fputs(msg, log_file);
 }
 
-// Define inline function to return column index, given linear index.
-// Note: Assumes linear index into mask, wrapped in "row-major" order.
-inline unsigned int tv_idx(unsigned int i, unsigned int N){
-   return i/(unsigned int)N;
+// Define routine to release the cached neighborhood geometry.
+static void mex_release_plan(){
+   if(plan != NULL)
+      lf_nmf_destroy_plan(plan);
+   plan = NULL;
 }
 
-// Define inline function to evaluate range of mask column indices.
-inline MaskIndices SU_MaskIndices(
-        unsigned int s, unsigned int* nHalfAngles, unsigned int N){
-   MaskIndices mskIdx;
-   mskIdx.start  = MAX(0, (int)s-(int)nHalfAngles[1]);
-   mskIdx.finish = MIN(N-1, s+nHalfAngles[1]);
-   mskIdx.length = mskIdx.finish-mskIdx.start+1;
-   return mskIdx;
+// Define function to read a scalar field of a structure (if present).
+unsigned long mxStructReadScalar(const mxArray* s, const char* name, unsigned long value){
+   mxArray* field = mxGetField(s, 0, name);
+   if(field == NULL)
+      return value;
+   if(!mxIsNumeric(field) || mxGetNumberOfElements(field) != 1){
+      char msg[1024];
+      sprintf(msg,"Solver option \"%s\" must be a numerical scalar.", name);
+      mexErrMsgTxt(msg);
+   }
+   return mxArrayReadScalar(field);
 }
 
-// Define inline function to evaluate range of mask row indices.
-inline MaskIndices TV_MaskIndices(
-        unsigned int t, unsigned int* nHalfAngles, unsigned int N){
-   MaskIndices mskIdx;
-   mskIdx.start  = MAX(0, (int)t-(int)nHalfAngles[0]);
-   mskIdx.finish = MIN(N-1, t+nHalfAngles[0]);
-   mskIdx.length = mskIdx.finish-mskIdx.start+1;
-   return mskIdx;
+// Define function to read a real-valued scalar field of a structure (if present).
+double mxStructReadDouble(const mxArray* s, const char* name, double value){
+   mxArray* field = mxGetField(s, 0, name);
+   if(field == NULL)
+      return value;
+   if(!mxIsNumeric(field) || mxGetNumberOfElements(field) != 1){
+      char msg[1024];
+      sprintf(msg,"Solver option \"%s\" must be a numerical scalar.", name);
+      mexErrMsgTxt(msg);
+   }
+   return mxGetScalar(field);
 }
 
-// Define inline function to evaluate number of mask indices.
-inline unsigned int num_indices(MaskIndices* S, MaskIndices* T){
-  return S->length*T->length;
+// Define function to read a PSNR evaluation mode field of a structure (if present).
+unsigned int mxStructReadPSNRMode(const mxArray* s, const char* name, unsigned int value){
+   mxArray* field = mxGetField(s, 0, name);
+   if(field == NULL)
+      return value;
+   char mode[16] = "";
+   if(mxIsChar(field))
+      mxGetString(field, mode, sizeof(mode));
+   if(!strcmp(mode, "full"))
+      return LF_NMF_PSNR_FULL;
+   if(!strcmp(mode, "fused"))
+      return LF_NMF_PSNR_FUSED;
+   if(!strcmp(mode, "sampled"))
+      return LF_NMF_PSNR_SAMPLED;
+   char msg[1024];
+   sprintf(msg,"Solver option \"%s\" must be 'full', 'fused', or 'sampled'.", name);
+   mexErrMsgTxt(msg);
+   return value;
 }
 
-// Define inline function to return linear index, given ranges of mask row/colmn indices.
-inline unsigned int curr_idx(
-        unsigned int i, unsigned int s, unsigned int t, 
-        MaskIndices* S, MaskIndices* T, 
-        unsigned int* nHalfAngles, unsigned int N){
-   return ((S->start)+(i%S->length)+((i/S->length)+T->start)*N);
+// Define function to read an update rule field of a structure (if present).
+unsigned int mxStructReadRule(const mxArray* s, const char* name, unsigned int value){
+   mxArray* field = mxGetField(s, 0, name);
+   if(field == NULL)
+      return value;
+   char rule[16] = "";
+   if(mxIsChar(field))
+      mxGetString(field, rule, sizeof(rule));
+   if(!strcmp(rule, "mu"))
+      return LF_NMF_RULE_MU;
+   if(!strcmp(rule, "hals"))
+      return LF_NMF_RULE_HALS;
+   if(!strcmp(rule, "amu"))
+      return LF_NMF_RULE_AMU;
+   char msg[1024];
+   sprintf(msg,"Solver option \"%s\" must be 'mu', 'hals', or 'amu'.", name);
+   mexErrMsgTxt(msg);
+   return value;
 }
 
-// Define inline function to return linear index, given row/columnr indices.
-inline int ab_idx(unsigned int s, unsigned int u, unsigned int nHalfAngles, unsigned int nAngles){
-   return ((int)((int)u-(int)s)+nHalfAngles)%nAngles;
+// Define function to read an update schedule field of a structure (if present).
+unsigned int mxStructReadSchedule(const mxArray* s, const char* name, unsigned int value){
+   mxArray* field = mxGetField(s, 0, name);
+   if(field == NULL)
+      return value;
+   char schedule[16] = "";
+   if(mxIsChar(field))
+      mxGetString(field, schedule, sizeof(schedule));
+   if(!strcmp(schedule, "jacobi"))
+      return LF_NMF_SCHEDULE_JACOBI;
+   if(!strcmp(schedule, "gs"))
+      return LF_NMF_SCHEDULE_GAUSS_SEIDEL;
+   char msg[1024];
+   sprintf(msg,"Solver option \"%s\" must be 'jacobi' or 'gs'.", name);
+   mexErrMsgTxt(msg);
+   return value;
 }
 
 // Define function to read a 64-bit scalar input argument.
@@ -0,0 +1,497 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_CLI
+//    Command-line front end for light field factorization using NMF.
+//    Reads a 4D light field (see LF_WRITE_ARRAY), applies the weighted
+//    multiplicative update rule, and writes the optimized mask pairs.
+//    A 5D light field [v u b a ch] is factorized for all color channels
+//    jointly, producing N x R x ch rear masks and R x N x ch front masks.
+//    A 6D light field [v u b a ch F] is factorized frame by frame (e.g.,
+//    for video), warm-starting each frame with the masks of the previous
+//    one, producing N x R x ch x F rear masks and R x N x ch x F front masks.
+//    With "-tile", the light field is streamed from disk in bands of mask
+//    rows (see LF_NMF_OOC), rather than loaded into memory.
+//    With "-views", the light field is loaded from its oblique views
+//    (see LF_NMF_LOAD), rather than from a light field array.
+//    With "-evaluate", the factorization is compared against the pinhole
+//    array mask pairs of the light field (see LF_NMF_EVAL).
+//    With "-masks", the mask pairs are also written as images for the
+//    player (i.e., "<dir>/W/k.png", "<dir>/H/k.png", and properties.txt),
+//    gamma-compressed for the display (see LF_NMF_SAVE). Both "-evaluate"
+//    and "-masks" require an in-core factorization (i.e., without "-tile").
+//
+//    g++ -O3 -pthread lf_nmf_cli.cpp lf_nmf_engine.cpp lf_nmf_plan.cpp lf_nmf_threads.cpp lf_nmf_io.cpp lf_nmf_ooc.cpp lf_nmf_load.cpp lf_nmf_pinhole.cpp lf_nmf_eval.cpp lf_nmf_save.cpp -lpng -o lf_nmf
+//
+//    Usage: lf_nmf -lf <light field> -W <rear masks> -H <front masks>
+//           lf_nmf -views <pattern> -res ROWS COLS -angles B A [-gray]
+//                  [-inGamma G] -W <rear masks> -H <front masks>
+//                  [-rank R] [-iter N] [-W0 <file>] [-H0 <file>]
+//                  [-fixH] [-minPSNR dB] [-E <PSNR>] [-seed S] [-quiet]
+//                  [-threads P] [-single] [-evalMode full|fused|sampled]
+//                  [-evalInterval N] [-evalSamples S] [-tolObj T]
+//                  [-tolFactor T] [-plateau N] [-log <file.csv>]
+//                  [-warmIter N] [-warmTol T] [-tile ROWS]
+//                  [-levels L] [-levelIter N] [-rule mu|hals|amu]
+//                  [-innerIter N] [-gram] [-schedule jacobi|gs]
+//                  [-views <pattern> -res ROWS COLS -angles B A]
+//                  [-gray] [-inGamma G] [-evaluate]
+//                  [-masks <dir>] [-outGamma G]
+//
+//    Compile with -march=native to enable the vectorized kernels (see
+//    LF_NMF_SIMD); "-single" factorizes in single precision.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <stdlib.h>
+#include <stdio.h>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+#include "lf_nmf_engine.h"
+#include "lf_nmf_io.h"
+#include "lf_nmf_load.h"
+#include "lf_nmf_pinhole.h"
+#include "lf_nmf_eval.h"
+#include "lf_nmf_save.h"
+#include "lf_nmf_threads.h"
+#include "lf_nmf_ooc.h"
+#include "lf_nmf_simd.h"
+
+// Define macro for element-wise maximum operation.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+
+// Define status output routine.
+static void print_status(const char* msg){
+   printf("%s", msg);
+   fflush(stdout);
+}
+
+// Define telemetry output routine (see NMFOptions).
+static FILE* log_file = NULL;
+static void write_log(const char* msg){
+   fputs(msg, log_file);
+}
+
+// Define usage message.
+static void print_usage(const char* name){
+   fprintf(stderr,
+      "Usage: %s -lf <light field> -W <rear masks> -H <front masks>\n"
+      "          [-rank R] [-iter N] [-W0 <file>] [-H0 <file>]\n"
+      "          [-fixH] [-minPSNR dB] [-E <PSNR>] [-seed S] [-quiet]\n"
+      "          [-threads P] [-single] [-evalMode full|fused|sampled]\n"
+      "          [-evalInterval N] [-evalSamples S] [-tolObj T]\n"
+      "          [-tolFactor T] [-plateau N] [-log <file.csv>]\n"
+      "          [-warmIter N] [-warmTol T] [-tile ROWS]\n"
+      "          [-levels L] [-levelIter N] [-rule mu|hals|amu]\n"
+      "          [-innerIter N] [-gram] [-schedule jacobi|gs]\n"
+      "          [-views <pattern> -res ROWS COLS -angles B A]\n"
+      "          [-gray] [-inGamma G] [-evaluate]\n"
+      "          [-masks <dir>] [-outGamma G]\n",
+      name);
+}
+
+// Load initial mask matrices (or fill with random noise if not specified).
+// Note: A single M x N matrix is replicated for each of the C channels.
+//       For F > 1 frames, the initial masks are stored as the first frame.
+//       The noise is drawn from stream "key" (see lf_random_value), as by
+//       the out-of-core solver, so both start from the same masks.
+static bool init_masks(const char* filename, LFArray* A, unsigned int M, unsigned int N,
+                       unsigned int C, unsigned int F, unsigned long long key){
+   unsigned int dim[4] = {M, N, C, F};
+   lf_alloc_array(A, (F > 1) ? 4 : ((C > 1) ? 3 : 2), dim);
+   unsigned long numel = (unsigned long)M*N;
+   if(filename == NULL){
+      for(unsigned long i=0; i<numel; i++)
+         A->data[i] = lf_random_value(key, i);
+   }
+   else{
+      LFArray B;
+      if(!lf_read_array(filename, &B))
+         return false;
+      if(B.dim[0] != M || B.dim[1] != N || (B.numel != numel && B.numel != numel*C)){
+         fprintf(stderr, "%s must have dimensions %ux%u (or %ux%ux%u)\n",
+                 filename, M, N, M, N, C);
+         lf_free_array(&B);
+         return false;
+      }
+      memcpy(A->data, B.data, sizeof(double)*B.numel);
+      if(B.numel != numel)
+         C = 1; // one matrix per channel (i.e., nothing to replicate)
+      lf_free_array(&B);
+   }
+   for(unsigned int ch=1; ch<C; ch++)
+      memcpy(A->data+ch*numel, A->data, sizeof(double)*numel);
+   return true;
+}
+
+int main(int argc, char* argv[]){
+
+   // Parse command-line arguments.
+   const char* lf_fn = NULL;
+   const char* views = NULL;
+   const char* W_fn  = NULL;
+   const char* H_fn  = NULL;
+   const char* W0_fn = NULL;
+   const char* H0_fn = NULL;
+   const char* E_fn  = NULL;
+   const char* log_fn = NULL;
+   const char* mask_dir = NULL;
+   const char* in_core_option = NULL; // last option not supported out of core
+   double out_gamma = 1;
+   long warm_iter = -1;
+   double warm_tol = -1;
+   unsigned long R = 0;
+   unsigned int seed = 0;
+   unsigned int band_rows = 0;
+   bool single = false;
+   bool evaluate = false;
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   opt.print = print_status;
+   NMFLoadOptions load_opt;
+   lf_nmf_default_load_options(&load_opt);
+   load_opt.nAngles[0] = load_opt.nAngles[1] = 0;
+   for(int i=1; i<argc; i++){
+      bool has_arg = (i+1 < argc);
+      if(!strcmp(argv[i],"-lf") && has_arg)
+         lf_fn = argv[++i];
+      else if(!strcmp(argv[i],"-views") && has_arg)
+         views = argv[++i];
+      else if(!strcmp(argv[i],"-res") && i+2 < argc){
+         load_opt.res[0] = strtoul(argv[++i], NULL, 10);
+         load_opt.res[1] = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-angles") && i+2 < argc){
+         load_opt.nAngles[0] = strtoul(argv[++i], NULL, 10);
+         load_opt.nAngles[1] = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-gray"))
+         load_opt.fullColor = false;
+      else if(!strcmp(argv[i],"-inGamma") && has_arg)
+         load_opt.inGamma = atof(argv[++i]);
+      else if(!strcmp(argv[i],"-W") && has_arg)
+         W_fn = argv[++i];
+      else if(!strcmp(argv[i],"-H") && has_arg)
+         H_fn = argv[++i];
+      else if(!strcmp(argv[i],"-W0") && has_arg)
+         W0_fn = argv[++i];
+      else if(!strcmp(argv[i],"-H0") && has_arg)
+         H0_fn = argv[++i];
+      else if(!strcmp(argv[i],"-E") && has_arg)
+         E_fn = argv[++i];
+      else if(!strcmp(argv[i],"-rank") && has_arg)
+         R = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-iter") && has_arg)
+         opt.niter = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-minPSNR") && has_arg){
+         opt.min_PSNR = atof(argv[++i]);
+         opt.evaluate_PSNR = true;
+      }
+      else if(!strcmp(argv[i],"-evalMode") && has_arg){
+         in_core_option = argv[i];
+         const char* mode = argv[++i];
+         if(!strcmp(mode,"full"))
+            opt.PSNR_mode = LF_NMF_PSNR_FULL;
+         else if(!strcmp(mode,"fused"))
+            opt.PSNR_mode = LF_NMF_PSNR_FUSED;
+         else if(!strcmp(mode,"sampled"))
+            opt.PSNR_mode = LF_NMF_PSNR_SAMPLED;
+         else{
+            print_usage(argv[0]);
+            return 1;
+         }
+      }
+      else if(!strcmp(argv[i],"-evalInterval") && has_arg){
+         in_core_option = argv[i];
+         opt.PSNR_interval = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-evalSamples") && has_arg){
+         in_core_option = argv[i];
+         opt.PSNR_samples = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-tolObj") && has_arg){
+         in_core_option = argv[i];
+         opt.tol_objective = atof(argv[++i]);
+      }
+      else if(!strcmp(argv[i],"-tolFactor") && has_arg){
+         in_core_option = argv[i];
+         opt.tol_factor = atof(argv[++i]);
+      }
+      else if(!strcmp(argv[i],"-plateau") && has_arg){
+         in_core_option = argv[i];
+         opt.plateau = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-log") && has_arg){
+         in_core_option = argv[i];
+         log_fn = argv[++i];
+      }
+      else if(!strcmp(argv[i],"-warmIter") && has_arg){
+         in_core_option = argv[i];
+         warm_iter = strtol(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-warmTol") && has_arg){
+         in_core_option = argv[i];
+         warm_tol = atof(argv[++i]);
+      }
+      else if(!strcmp(argv[i],"-rule") && has_arg){
+         const char* rule = argv[++i];
+         if(!strcmp(rule,"mu"))
+            opt.rule = LF_NMF_RULE_MU;
+         else if(!strcmp(rule,"hals"))
+            opt.rule = LF_NMF_RULE_HALS;
+         else if(!strcmp(rule,"amu"))
+            opt.rule = LF_NMF_RULE_AMU;
+         else{
+            print_usage(argv[0]);
+            return 1;
+         }
+      }
+      else if(!strcmp(argv[i],"-innerIter") && has_arg)
+         opt.inner_iter = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-gram"))
+         opt.gram = true;
+      else if(!strcmp(argv[i],"-schedule") && has_arg){
+         in_core_option = argv[i];
+         const char* schedule = argv[++i];
+         if(!strcmp(schedule,"jacobi"))
+            opt.schedule = LF_NMF_SCHEDULE_JACOBI;
+         else if(!strcmp(schedule,"gs"))
+            opt.schedule = LF_NMF_SCHEDULE_GAUSS_SEIDEL;
+         else{
+            print_usage(argv[0]);
+            return 1;
+         }
+      }
+      else if(!strcmp(argv[i],"-levels") && has_arg){
+         in_core_option = argv[i];
+         opt.levels = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-levelIter") && has_arg){
+         in_core_option = argv[i];
+         opt.level_iter = strtoul(argv[++i], NULL, 10);
+      }
+      else if(!strcmp(argv[i],"-tile") && has_arg)
+         band_rows = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-threads") && has_arg)
+         opt.nthreads = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-seed") && has_arg)
+         seed = strtoul(argv[++i], NULL, 10);
+      else if(!strcmp(argv[i],"-fixH"))
+         opt.fix_H = true;
+      else if(!strcmp(argv[i],"-single"))
+         single = true;
+      else if(!strcmp(argv[i],"-evaluate"))
+         evaluate = true;
+      else if(!strcmp(argv[i],"-masks") && has_arg)
+         mask_dir = argv[++i];
+      else if(!strcmp(argv[i],"-outGamma") && has_arg)
+         out_gamma = atof(argv[++i]);
+      else if(!strcmp(argv[i],"-quiet"))
+         opt.print = NULL;
+      else{
+         print_usage(argv[0]);
+         return 1;
+      }
+   }
+   if((lf_fn == NULL) == (views == NULL) || W_fn == NULL || H_fn == NULL){
+      print_usage(argv[0]);
+      return 1;
+   }
+   if(views != NULL && (load_opt.res[0] == 0 || load_opt.res[1] == 0 ||
+                        load_opt.nAngles[0] == 0 || load_opt.nAngles[1] == 0)){
+      fprintf(stderr, "Loading views requires -res and -angles.\n");
+      return 1;
+   }
+   if(evaluate && band_rows > 0){
+      fprintf(stderr, "Evaluation requires an in-core factorization (i.e., without -tile).\n");
+      return 1;
+   }
+   if(in_core_option != NULL && band_rows > 0){
+      fprintf(stderr, "%s requires an in-core factorization (i.e., without -tile).\n", in_core_option);
+      return 1;
+   }
+   if(mask_dir != NULL && band_rows > 0){
+      fprintf(stderr, "Mask images require an in-core factorization (i.e., without -tile).\n");
+      return 1;
+   }
+   if(views != NULL && band_rows > 0){
+      fprintf(stderr, "Out-of-core factorization requires a light field array (-lf).\n");
+      return 1;
+   }
+   if(E_fn != NULL)
+      opt.evaluate_PSNR = true;
+   if(log_fn != NULL){
+      log_file = fopen(log_fn, "w");
+      if(log_file == NULL){
+         fprintf(stderr, "Could not open %s for writing.\n", log_fn);
+         return 1;
+      }
+      opt.log = write_log;
+   }
+
+   // Factorize the light field out of core (if requested).
+   // Note: Only the header of the light field is read here.
+   if(band_rows > 0){
+      LFArray lf, E;
+      FILE* fid = lf_open_array(lf_fn, &lf);
+      if(fid == NULL)
+         return 1;
+      fclose(fid);
+      unsigned int C = (lf.ndims == 5) ? lf.dim[4] : 1;
+      if(R == 0)
+         R = lf.dim[2]*lf.dim[3];
+      unsigned int E_dim[2] = {(unsigned int)opt.niter, C};
+      lf_alloc_array(&E, 2, E_dim);
+      if(opt.print != NULL)
+         printf("Factorizing %ux%ux%ux%u light field out of core (%u channel(s), rank %lu, %lu iterations, %s %s)...\n",
+                lf.dim[0], lf.dim[1], lf.dim[2], lf.dim[3], C, R, opt.niter,
+                single ? "single" : "double", LF_NMF_SIMD);
+      bool ok = lf_nmf_2d_Euclidean_ooc(lf_fn, W0_fn, H0_fn, W_fn, H_fn, R, band_rows, seed,
+                                        single, &opt, E.data);
+      if(log_file != NULL)
+         fclose(log_file);
+      if(ok && E_fn != NULL)
+         ok = lf_write_array(E_fn, &E);
+      lf_free_array(&E);
+      return ok ? 0 : 1;
+   }
+
+   // Load light field (from its oblique views, if requested).
+   // Note: The views are loaded with the same threads as the solver.
+   LFArray lf;
+   if(views != NULL){
+      unsigned int lf_dim[5] = {load_opt.res[0], load_opt.res[1],
+                                load_opt.nAngles[0], load_opt.nAngles[1], 3};
+      lf_alloc_array(&lf, load_opt.fullColor ? 5 : 4, lf_dim);
+      load_opt.nthreads = opt.nthreads;
+      if(!lf_nmf_load_views(views, &load_opt, lf.data, NULL)){
+         lf_free_array(&lf);
+         return 1;
+      }
+   }
+   else if(!lf_read_array(lf_fn, &lf))
+      return 1;
+   if(lf.ndims < 4 || lf.ndims > 6){
+      fprintf(stderr, "Input light field must be four-, five-, or six-dimensional.\n");
+      return 1;
+   }
+   unsigned int N = lf.dim[0]*lf.dim[1];
+   unsigned int C = (lf.ndims >= 5) ? lf.dim[4] : 1;
+   unsigned int F = (lf.ndims == 6) ? lf.dim[5] : 1;
+   if(R == 0)
+      R = lf.dim[2]*lf.dim[3];
+   if(opt.levels > 1 && lf.dim[2] != 1 && lf.dim[3] != 1){
+      fprintf(stderr, "Coarse-to-fine factorization (-levels) requires a single view along one axis.\n");
+      return 1;
+   }
+   if(evaluate && (F > 1 || lf.dim[2]%2 == 0 || lf.dim[3]%2 == 0)){
+      fprintf(stderr, "Evaluation requires a single frame with an odd angular resolution.\n");
+      return 1;
+   }
+   if(mask_dir != NULL && (F > 1 || (C != 1 && C != 3))){
+      fprintf(stderr, "Mask images require a single frame with one or three channels.\n");
+      return 1;
+   }
+
+   // Initialize mask pairs.
+   LFArray W, H, E;
+   if(!init_masks(W0_fn, &W, N, R, C, F, 2ULL*seed) ||
+      !init_masks(H0_fn, &H, R, N, C, F, 2ULL*seed+1))
+      return 1;
+
+   // Initialize options for warm-started frames (if necessary).
+   // Note: Only the first frame reports the progress of each iteration.
+   NMFOptions opt_warm;
+   lf_nmf_warm_options(&opt, &opt_warm);
+   if(warm_iter >= 0)
+      opt_warm.niter = warm_iter;
+   if(warm_tol >= 0)
+      opt_warm.tol_objective = warm_tol;
+   opt_warm.print = NULL;
+   unsigned int E_dim[3] = {(unsigned int)MAX(opt.niter, opt_warm.niter), C, F};
+   lf_alloc_array(&E, (F > 1) ? 3 : 2, E_dim);
+
+   // Apply the weighted multiplicative update rule (to all color channels).
+   // Note: The channels are factorized jointly, in a single pass.
+   NMFPlan* plan = lf_nmf_create_plan(lf.dim);
+   if(opt.print != NULL)
+      printf("Factorizing %ux%ux%ux%u light field (%u channel(s), %u frame(s), rank %lu, %lu iterations, %s %s)...\n",
+             lf.dim[0], lf.dim[1], lf.dim[2], lf.dim[3], C, F, R, opt.niter,
+             single ? "single" : "double", LF_NMF_SIMD);
+   if(single){
+      std::vector<float> lf_f(lf.data, lf.data+lf.numel);
+      std::vector<float> W_f(W.data, W.data+W.numel);
+      std::vector<float> H_f(H.data, H.data+H.numel);
+      if(F > 1)
+         lf_nmf_2d_Euclidean_video(plan, &lf_f[0], C, F, &W_f[0], &H_f[0], R,
+                                   &opt, &opt_warm, E.data);
+      else
+         lf_nmf_2d_Euclidean_channels(plan, &lf_f[0], C, &W_f[0], &H_f[0], R, &opt, E.data);
+      std::copy(W_f.begin(), W_f.end(), W.data);
+      std::copy(H_f.begin(), H_f.end(), H.data);
+   }
+   else if(F > 1)
+      lf_nmf_2d_Euclidean_video(plan, lf.data, C, F, W.data, H.data, R,
+                                &opt, &opt_warm, E.data);
+   else
+      lf_nmf_2d_Euclidean_channels(plan, lf.data, C, W.data, H.data, R, &opt, E.data);
+   lf_nmf_destroy_plan(plan);
+   if(log_file != NULL)
+      fclose(log_file);
+
+   // Evaluate the factorization against the pinhole array mask pairs (if requested).
+   if(evaluate){
+      unsigned long K = lf.dim[2]*lf.dim[3];
+      std::vector<double> W_ref((unsigned long)N*K*C), H_ref((unsigned long)N*K*C), view_PSNR(K);
+      lf_nmf_pinhole_masks(lf.dim, C, lf.data, &W_ref[0], &H_ref[0], opt.nthreads);
+      NMFEvalOptions eval_opt;
+      NMFEvalResult result;
+      lf_nmf_default_eval_options(&eval_opt);
+      eval_opt.nthreads = opt.nthreads;
+      lf_nmf_evaluate(lf.dim, C, &W_ref[0], &H_ref[0], K, W.data, H.data, R,
+                      &eval_opt, NULL, NULL, &result, &view_PSNR[0]);
+      printf("Reconstruction PSNR is %0.2f dB (%0.2f-%0.2f dB per view), ~%0.2fx brighter than pinholes.\n",
+             result.PSNR, *std::min_element(view_PSNR.begin(), view_PSNR.end()),
+             *std::max_element(view_PSNR.begin(), view_PSNR.end()), result.brightness);
+   }
+
+   // Write mask images for the player (if requested).
+   // Note: The images are written in the background, while the mask
+   //       arrays are written below.
+   NMFMaskWriter* writer = NULL;
+   bool ok = true;
+   if(mask_dir != NULL){
+      std::string dir(mask_dir);
+      mkdir(dir.c_str(), 0777);
+      mkdir((dir+"/W").c_str(), 0777);
+      mkdir((dir+"/H").c_str(), 0777);
+      ok = lf_nmf_write_properties((dir+"/properties.txt").c_str(), "NMF", R, lf.dim+2);
+      if(ok){
+         std::string escaped;
+         for(unsigned int i=0; i<dir.size(); i++)
+            escaped += (dir[i] == '%') ? std::string("%%") : std::string(1, dir[i]);
+         writer = new NMFMaskWriter((opt.nthreads > 0) ? opt.nthreads : lf_nmf_default_threads());
+         writer->write((escaped+"/W/%d.png").c_str(), (escaped+"/H/%d.png").c_str(),
+                       lf.dim, C, W.data, H.data, R, out_gamma);
+      }
+   }
+
+   // Write optimized mask pairs (and PSNR, if requested).
+   ok = ok && lf_write_array(W_fn, &W) && lf_write_array(H_fn, &H);
+   if(ok && E_fn != NULL)
+      ok = lf_write_array(E_fn, &E);
+   if(writer != NULL){
+      ok = writer->wait(NULL) && ok;
+      delete writer;
+   }
+
+   // Release storage.
+   lf_free_array(&lf);
+   lf_free_array(&W);
+   lf_free_array(&H);
+   lf_free_array(&E);
+   return ok ? 0 : 1;
+}
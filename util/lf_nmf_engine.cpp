@@ -0,0 +1,2142 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_ENGINE
+//    Factorizes 4D light fields for display on dual-stacked LCDs using
+//    NMF for a frustrum of rays nearly perpendicular to the display.
+//    Accepts as input a (relative) two-plane light field parameterization.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "lf_nmf_engine.h"
+#include "lf_nmf_threads.h"
+#include "lf_nmf_simd.h"
+#include "lf_nmf_rules.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Define cache budget for the working set of each tile (in bytes).
+#ifndef LF_NMF_L2_BYTES
+   #define LF_NMF_L2_BYTES (1<<20)
+#endif
+
+// Define default maximum fraction of nonzero mask pixels for the sparse
+// kernels (see NMFOptions).
+#ifndef LF_NMF_SPARSE_DENSITY
+   #define LF_NMF_SPARSE_DENSITY 0.75
+#endif
+
+// Declare structure for storing a rectangular tile of mask pixels.
+typedef struct {
+   unsigned int row0, row1; // first/last+1 row
+   unsigned int col0, col1; // first/last+1 column
+} NMFTile;
+
+// Declare structure for storing a band of mask rows (see partition_bands).
+// Note: Tiles tile0..tile1-1 partition the rows of the band, and tiles
+//       halo0..halo1-1 the rows whose rays reach its front masks (i.e., the
+//       band with nHalfAngles[0] rows on either side, Gauss-Seidel only).
+typedef struct {
+   unsigned int tile0, tile1; // first/last+1 tile of the band
+   unsigned int halo0, halo1; // first/last+1 tile of the band and its halo
+} NMFBand;
+
+// Declare structure for storing update statistics (per tile and channel).
+// Note: Index 0 refers to the front masks (H) and index 1 to the rear
+//       masks (W). Elements set to one were either clamped or reset from
+//       NaN (i.e., if the update ratio is undefined).
+typedef struct {
+   double        change[2];  // squared change of the updated elements
+   double        norm[2];    // squared norm of the updated elements
+   unsigned long clamped[2]; // number of elements clamped to one
+   unsigned long reset[2];   // number of elements reset from NaN
+} NMFTileStats;
+
+// Declare structure for storing the state shared by the update sweeps.
+// Note: The scalar type T is either float or double. The light field and
+//       its reconstruction are stored as angular bundles (see LF_NMF_PLAN),
+//       interleaving the C channels of each ray, and the mask pairs store
+//       the C*R elements of each pixel contiguously (i.e., the R elements
+//       of each channel in turn). Pixels are indexed in row-major order.
+//       If the front masks are fixed, "normal" holds the normal equations
+//       of each rear mask pixel (see init_fixed_block). If the masks are
+//       sparse, "nz_W" and "nz_H" hold the bit masks of their nonzero
+//       elements (see init_sparse), and "nnz" the number of nonzero
+//       pixels of each side. "bands" holds the bands of mask rows. With the
+//       Gauss-Seidel schedule, "color" selects the bands being updated (i.e.,
+//       even or odd bands). Otherwise, "chunks" holds the first band of each
+//       thread's share of the pipelined sweep (see pipeline_block), and
+//       "refresh" is set if the reconstruction is refreshed after the front
+//       mask update.
+template<typename T>
+struct NMFSweep {
+   const NMFPlan*            plan;
+   const T*                  lf;
+   unsigned long             N;
+   unsigned long             R;
+   unsigned int              C;
+   T*                        W_data;
+   T*                        H_data;
+   T*                        lf_approx;
+   std::vector<int>          lane;
+   std::vector<char>         frozen;
+   bool                      any_frozen;
+   std::vector<NMFTile>      tiles;
+   std::vector<NMFBand>      bands;
+   unsigned int              color;
+   std::vector<unsigned int> chunks;
+   bool                      refresh;
+   std::vector<double>       peak;
+   double                    nvalid;
+   std::vector<unsigned long> samples;
+   bool                      accumulate;
+   std::vector<double>       tile_SSE;
+   bool                      track;
+   bool                      count_clamped;
+   std::vector<NMFTileStats> tile_stats;
+   typename NMFRule<T>::Update update;
+   unsigned int              inner_iter;
+   bool                      inline_update;
+   bool                      gram;
+   bool                      fixed_H;
+   std::vector<T>            normal;
+   bool                      sparse;
+   double                    sparse_density;
+   unsigned long             nwords;
+   std::vector<NMFBits>      nz_W;
+   std::vector<NMFBits>      nz_H;
+   std::vector<NMFBits>      channel_bits;
+   unsigned long             nnz[2];
+   std::vector<unsigned long> tile_nnz;
+   NMFTask                   reconstruct_task;
+   NMFTask                   update_H_task;
+   NMFTask                   update_W_task;
+};
+
+// Declare auxiliary functions.
+template<typename T, typename S> static unsigned long lf_nmf_solve(
+   const NMFPlan*, const S*, const T*, unsigned int, T*, T*, unsigned long, const NMFOptions*, double*);
+template<typename T, typename S> static unsigned long lf_nmf_solve_levels(
+   const NMFPlan*, const S*, const T*, unsigned int, T*, T*, unsigned long, const NMFOptions*, double*);
+template<typename T, typename S> static unsigned long lf_nmf_solve_video(
+   const NMFPlan*, const S*, const T*, unsigned int, unsigned int, T*, T*, unsigned long,
+   const NMFOptions*, const NMFOptions*, double*);
+template<typename T> static unsigned long lf_nmf_solve_quantized(
+   const NMFPlan*, const NMFQuantized*, unsigned int, unsigned int, T*, T*, unsigned long,
+   const NMFOptions*, const NMFOptions*, double*);
+template<typename T> static void quantized_lut(const NMFQuantized*, std::vector<T>*);
+static float half_to_float(unsigned short);
+template<typename T> static inline T lf_value(T, const T*);
+template<typename T, typename S> static inline T lf_value(S, const T*);
+template<typename T> static unsigned long lf_nmf_band(
+   const NMFPlan*, const T*, unsigned int, T*, T*, unsigned long,
+   unsigned int, unsigned int, unsigned int, const char*, const NMFOptions*,
+   NMFThreadPool*, double*);
+template<typename T> static void select_rule(NMFSweep<T>*, const NMFOptions*);
+template<typename T> static void select_kernels(NMFSweep<T>*);
+template<typename T> static void partition_tiles(NMFSweep<T>*, unsigned int, unsigned int, unsigned int);
+template<typename T> static unsigned long tile_columns(const NMFSweep<T>*);
+template<typename T> static unsigned int partition_bands(NMFSweep<T>*, unsigned int, bool);
+template<typename T> static void update_band_block(void*, unsigned int);
+template<typename T> static void pipeline_block(void*, unsigned int);
+template<typename T> static void pipeline_seam_block(void*, unsigned int);
+template<typename T> static inline void update_W_band(NMFSweep<T>*, unsigned int);
+template<typename T> static void init_PSNR(NMFSweep<T>*, unsigned long);
+template<typename T> static void evaluate_PSNR(const NMFSweep<T>*, unsigned int, double*, double*);
+template<typename T> static void row_SSE(const NMFSweep<T>*, unsigned int, double*);
+template<typename T> static void evaluate_row_block(void*, unsigned int);
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+   static void reconstruct_block(void*, unsigned int);
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+   static void update_H_block(void*, unsigned int);
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+   static void update_W_block(void*, unsigned int);
+template<typename T> static void gram_columns(
+   const NMFSweep<T>*, const T*, unsigned int, unsigned int, unsigned int, T*);
+template<typename T> static inline void gram_window(
+   const NMFSweep<T>*, const T*, unsigned int, unsigned int, T*);
+template<typename T> static void init_fixed_block(void*, unsigned int);
+template<typename T> static void init_sparse(NMFSweep<T>*, const NMFOptions*, unsigned int);
+template<typename T> static void check_sparse(NMFSweep<T>*, unsigned int, unsigned int);
+template<typename T> static void reconstruct_sparse_block(void*, unsigned int);
+template<typename T> static void update_H_sparse_block(void*, unsigned int);
+template<typename T> static void update_W_sparse_block(void*, unsigned int);
+static inline bool sparse_any(const NMFBits*, unsigned long);
+template<typename T> static inline void sparse_ray(const NMFSweep<T>*, const T*, const NMFBits*,
+   const T*, const NMFBits*, T*);
+template<typename T> static void update_W_fixed_block(void*, unsigned int);
+template<typename T> static inline void gram_unpack(const T*, unsigned long, unsigned int, T*);
+template<typename T> static inline double fixed_SSE(const T*, const T*, T, const T*, unsigned long, T*);
+template<typename T> static void track_update(const NMFSweep<T>*, unsigned int,
+   const T*, const T*, const T* const*, const T*, const T*, const T*, const T*,
+   unsigned int, NMFTileStats*);
+static void log_iteration(const NMFOptions*, unsigned int, unsigned int,
+   double, double, double, const NMFTileStats*, double);
+static void format_PSNR(char*, const double*, unsigned int);
+static void lf_nmf_printf(const NMFOptions*, const char*, ...);
+
+// Initialize factorization options to their default values.
+void lf_nmf_default_options(NMFOptions* opt){
+   opt->niter         = 10;
+   opt->fix_H         = false;
+   opt->min_PSNR      = 1000.0;
+   opt->evaluate_PSNR = false;
+   opt->PSNR_mode     = LF_NMF_PSNR_FULL;
+   opt->PSNR_interval = 1;
+   opt->PSNR_samples  = 1<<16;
+   opt->tol_objective = 0;
+   opt->tol_factor    = 0;
+   opt->plateau       = 0;
+   opt->levels        = 1;
+   opt->level_iter    = 25;
+   opt->rule          = LF_NMF_RULE_MU;
+   opt->inner_iter    = 3;
+   opt->gram          = false;
+   opt->sparse_density = LF_NMF_SPARSE_DENSITY;
+   opt->schedule      = LF_NMF_SCHEDULE_JACOBI;
+   opt->nthreads      = 0;
+   opt->print         = NULL;
+   opt->log           = NULL;
+}
+
+// Initialize options for warm-started frames.
+void lf_nmf_warm_options(const NMFOptions* opt, NMFOptions* opt_warm){
+   *opt_warm = *opt;
+   opt_warm->niter = MAX(opt->niter/4, 1);
+   opt_warm->levels = 1;
+   if(opt_warm->tol_objective <= 0)
+      opt_warm->tol_objective = 1e-3;
+}
+
+// Apply the weighted multiplicative update rule.
+unsigned long lf_nmf_2d_Euclidean(
+        const double* lf, const unsigned int* lf_dim,
+        double* W_data, double* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   NMFPlan* plan = lf_nmf_create_plan(lf_dim);
+   unsigned long niter = lf_nmf_solve(plan, lf, (const double*)NULL, 1, W_data, H_data, R, opt, E_data);
+   lf_nmf_destroy_plan(plan);
+   return niter;
+}
+
+// Apply the weighted multiplicative update rule (in single precision).
+unsigned long lf_nmf_2d_Euclidean(
+        const float* lf, const unsigned int* lf_dim,
+        float* W_data, float* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   NMFPlan* plan = lf_nmf_create_plan(lf_dim);
+   unsigned long niter = lf_nmf_solve(plan, lf, (const float*)NULL, 1, W_data, H_data, R, opt, E_data);
+   lf_nmf_destroy_plan(plan);
+   return niter;
+}
+
+// Apply the weighted multiplicative update rule (using a precomputed plan).
+unsigned long lf_nmf_2d_Euclidean_plan(
+        const NMFPlan* plan, const double* lf,
+        double* W_data, double* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   return lf_nmf_solve(plan, lf, (const double*)NULL, 1, W_data, H_data, R, opt, E_data);
+}
+
+// Apply the weighted multiplicative update rule (in single precision).
+unsigned long lf_nmf_2d_Euclidean_plan(
+        const NMFPlan* plan, const float* lf,
+        float* W_data, float* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   return lf_nmf_solve(plan, lf, (const float*)NULL, 1, W_data, H_data, R, opt, E_data);
+}
+
+// Apply the weighted multiplicative update rule to C color channels jointly.
+unsigned long lf_nmf_2d_Euclidean_channels(
+        const NMFPlan* plan, const double* lf, unsigned int C,
+        double* W_data, double* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   return lf_nmf_solve(plan, lf, (const double*)NULL, C, W_data, H_data, R, opt, E_data);
+}
+
+// Apply the weighted multiplicative update rule to C color channels jointly.
+unsigned long lf_nmf_2d_Euclidean_channels(
+        const NMFPlan* plan, const float* lf, unsigned int C,
+        float* W_data, float* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+   return lf_nmf_solve(plan, lf, (const float*)NULL, C, W_data, H_data, R, opt, E_data);
+}
+
+// Apply the weighted multiplicative update rule to a light field sequence.
+unsigned long lf_nmf_2d_Euclidean_video(
+        const NMFPlan* plan, const double* lf, unsigned int C, unsigned int F,
+        double* W_data, double* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   return lf_nmf_solve_video(plan, lf, (const double*)NULL, C, F, W_data, H_data, R, opt, opt_warm, E_data);
+}
+
+// Apply the weighted multiplicative update rule to a light field sequence.
+unsigned long lf_nmf_2d_Euclidean_video(
+        const NMFPlan* plan, const float* lf, unsigned int C, unsigned int F,
+        float* W_data, float* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   return lf_nmf_solve_video(plan, lf, (const float*)NULL, C, F, W_data, H_data, R, opt, opt_warm, E_data);
+}
+
+// Apply the weighted multiplicative update rule to a quantized light field.
+unsigned long lf_nmf_2d_Euclidean_quantized(
+        const NMFPlan* plan, const NMFQuantized* lf, unsigned int C, unsigned int F,
+        double* W_data, double* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   return lf_nmf_solve_quantized(plan, lf, C, F, W_data, H_data, R, opt, opt_warm, E_data);
+}
+
+// Apply the weighted multiplicative update rule to a quantized light field.
+unsigned long lf_nmf_2d_Euclidean_quantized(
+        const NMFPlan* plan, const NMFQuantized* lf, unsigned int C, unsigned int F,
+        float* W_data, float* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   return lf_nmf_solve_quantized(plan, lf, C, F, W_data, H_data, R, opt, opt_warm, E_data);
+}
+
+// Apply the weighted multiplicative update rule to a quantized light field.
+// Note: A single frame is factorized without warm-start options, as for
+//       lf_nmf_2d_Euclidean_channels.
+template<typename T>
+static unsigned long lf_nmf_solve_quantized(
+        const NMFPlan* plan, const NMFQuantized* lf, unsigned int C, unsigned int F,
+        T* W_data, T* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   std::vector<T> lut;
+   quantized_lut(lf, &lut);
+   if(lf->type == LF_NMF_QUANT_UINT8){
+      const unsigned char* data = (const unsigned char*)lf->data;
+      if(F > 1)
+         return lf_nmf_solve_video(plan, data, &lut[0], C, F, W_data, H_data, R,
+                                   opt, opt_warm, E_data);
+      return lf_nmf_solve(plan, data, &lut[0], C, W_data, H_data, R, opt, E_data);
+   }
+   const unsigned short* data = (const unsigned short*)lf->data;
+   if(F > 1)
+      return lf_nmf_solve_video(plan, data, &lut[0], C, F, W_data, H_data, R,
+                                opt, opt_warm, E_data);
+   return lf_nmf_solve(plan, data, &lut[0], C, W_data, H_data, R, opt, E_data);
+}
+
+// Evaluate the lookup table of a quantized light field (for each mask type).
+void lf_nmf_quantized_lut(const NMFQuantized* lf, double* lut){
+   std::vector<double> table;
+   quantized_lut(lf, &table);
+   memcpy(lut, &table[0], sizeof(double)*table.size());
+}
+void lf_nmf_quantized_lut(const NMFQuantized* lf, float* lut){
+   std::vector<float> table;
+   quantized_lut(lf, &table);
+   memcpy(lut, &table[0], sizeof(float)*table.size());
+}
+
+// Evaluate the lookup table of a quantized light field (one entry per code).
+// Note: Negative and non-finite half-precision values are treated as zero.
+template<typename T>
+static void quantized_lut(const NMFQuantized* lf, std::vector<T>* lut){
+   unsigned long ncodes = (lf->type == LF_NMF_QUANT_UINT8) ? 256 : 65536;
+   lut->resize(ncodes);
+   for(unsigned long code=0; code<ncodes; code++){
+      double x;
+      if(lf->type == LF_NMF_QUANT_HALF)
+         x = half_to_float((unsigned short)code);
+      else
+         x = (double)code/(ncodes-1);
+      if(!(x > 0) || isinf(x))
+         x = 0;
+      double value = lf->gain*pow(x, lf->gamma);
+      (*lut)[code] = (T)((value > 0) ? value : lf->epsilon);
+   }
+}
+
+// Convert an IEEE half-precision value (i.e., its 16-bit code) to single precision.
+static float half_to_float(unsigned short h){
+   int sign = (h & 0x8000) ? -1 : 1;
+   int exponent = (h >> 10) & 0x1F;
+   int mantissa = h & 0x3FF;
+   if(exponent == 0)
+      return sign*ldexpf((float)mantissa, -24);
+   if(exponent == 31)
+      return (mantissa == 0) ? sign*std::numeric_limits<float>::infinity() :
+                               std::numeric_limits<float>::quiet_NaN();
+   return sign*ldexpf((float)(mantissa | 0x400), exponent-25);
+}
+
+// Read a light field element (dequantizing it, if necessary).
+template<typename T>
+static inline T lf_value(T x, const T*){
+   return x;
+}
+template<typename T, typename S>
+static inline T lf_value(S x, const T* lut){
+   return lut[x];
+}
+
+// Apply the weighted multiplicative update rule to a light field sequence.
+// Note: The neighborhood geometry is shared by all frames.
+template<typename T, typename S>
+static unsigned long lf_nmf_solve_video(
+        const NMFPlan* plan, const S* lf, const T* lut, unsigned int C, unsigned int F,
+        T* W_data, T* H_data, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E_data){
+   unsigned long nrays = plan->nrays*C;
+   unsigned long nmask = plan->N*R*C;
+   unsigned long niter = MAX(opt->niter, opt_warm->niter);
+   std::vector<double> E(niter*C);
+   unsigned long niter_total = 0;
+   std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+   for(unsigned int f=0; f<F; f++){
+      const NMFOptions* opt_f = (f == 0) ? opt : opt_warm;
+      T* W_f = W_data+f*nmask;
+      T* H_f = H_data+f*nmask;
+      if(f > 0){
+         memcpy(W_f, W_f-nmask, sizeof(T)*nmask);
+         memcpy(H_f, H_f-nmask, sizeof(T)*nmask);
+      }
+      std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+      unsigned long niter_f = lf_nmf_solve(plan, lf+f*nrays, lut, C, W_f, H_f, R, opt_f,
+                                           (E_data != NULL) ? &E[0] : NULL);
+      niter_total += niter_f;
+      if(E_data != NULL){
+         double* E_f = E_data+f*niter*C;
+         for(unsigned int c=0; c<C; c++)
+            for(unsigned long i=0; i<niter; i++)
+               E_f[c*niter+i] = (i < opt_f->niter) ? E[c*opt_f->niter+i] :
+                                std::numeric_limits<double>::quiet_NaN();
+      }
+      lf_nmf_printf(opt, "  + Factorized frame %u of %u (%lu iterations, %.2f s)...\n",
+                    f+1, F, niter_f, std::chrono::duration<double>(
+                       std::chrono::steady_clock::now()-t1).count());
+   }
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+   lf_nmf_printf(opt, "  + Factorized %u frames in %.1f s (%.1f frames/minute)...\n",
+                 F, elapsed, 60.0*F/elapsed);
+   return niter_total;
+}
+
+// Apply one half-step of the update rule to a band of mask rows.
+unsigned long lf_nmf_2d_Euclidean_band(
+        const NMFPlan* plan, const double* lf, unsigned int C,
+        double* W, double* H, unsigned long R,
+        unsigned int row0, unsigned int row1, unsigned int step,
+        const char* frozen, const NMFOptions* opt, NMFThreadPool* pool, double* SSE){
+   return lf_nmf_band(plan, lf, C, W, H, R, row0, row1, step, frozen, opt, pool, SSE);
+}
+
+// Apply one half-step of the update rule to a band of mask rows.
+unsigned long lf_nmf_2d_Euclidean_band(
+        const NMFPlan* plan, const float* lf, unsigned int C,
+        float* W, float* H, unsigned long R,
+        unsigned int row0, unsigned int row1, unsigned int step,
+        const char* frozen, const NMFOptions* opt, NMFThreadPool* pool, double* SSE){
+   return lf_nmf_band(plan, lf, C, W, H, R, row0, row1, step, frozen, opt, pool, SSE);
+}
+
+// Apply one half-step of the update rule to a band of mask rows.
+// Note: The front mask update reconstructs every row of the band, since
+//       the rays reaching rows row0..row1-1 of the front mask leave the
+//       rear mask up to nHalfAngles[0] rows away (i.e., in the halo). The
+//       rear mask update only reconstructs rows row0..row1-1.
+template<typename T>
+static unsigned long lf_nmf_band(
+        const NMFPlan* plan, const T* lf, unsigned int C,
+        T* W, T* H, unsigned long R,
+        unsigned int row0, unsigned int row1, unsigned int step,
+        const char* frozen, const NMFOptions* opt, NMFThreadPool* pool, double* SSE){
+   unsigned long CR = C*R;
+   std::vector<T> lf_approx(plan->nrays*C, 0);
+   NMFSweep<T> sweep;
+   sweep.plan       = plan;
+   sweep.lf         = lf;
+   sweep.N          = plan->N;
+   sweep.R          = R;
+   sweep.C          = C;
+   sweep.W_data     = W;
+   sweep.H_data     = H;
+   sweep.lf_approx  = &lf_approx[0];
+   sweep.lane.resize((CR+LF_NMF_SIMD_PAD-1)/LF_NMF_SIMD_PAD*LF_NMF_SIMD_PAD, 0);
+   for(unsigned long l=0; l<CR; l++)
+      sweep.lane[l] = (int)(l/R);
+   sweep.frozen.assign(C, 0);
+   sweep.any_frozen = false;
+   for(unsigned int c=0; c<C && frozen != NULL; c++){
+      sweep.frozen[c] = frozen[c];
+      sweep.any_frozen = sweep.any_frozen || frozen[c];
+   }
+   sweep.accumulate = false;
+   sweep.track = false;
+   sweep.count_clamped = false;
+   sweep.fixed_H = false;
+   sweep.sparse = false;
+   select_rule(&sweep, opt);
+   select_kernels(&sweep);
+
+   // Reconstruct the light field (for every row of the band, if the front
+   // masks are updated).
+   NMFTileStats zero_stats = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+   unsigned int nblocks;
+   if(step == LF_NMF_STEP_H){
+      partition_tiles(&sweep, pool->size(), 0, plan->lf_dim[0]);
+      nblocks = (unsigned int)sweep.tiles.size();
+      sweep.tile_SSE.assign(nblocks*C, 0);
+      pool->run(sweep.reconstruct_task, &sweep, nblocks);
+   }
+   partition_tiles(&sweep, pool->size(), row0, row1);
+   nblocks = (unsigned int)sweep.tiles.size();
+   sweep.tile_SSE.assign(nblocks*C, 0);
+   sweep.tile_stats.assign(nblocks*C, zero_stats);
+   if(step != LF_NMF_STEP_H)
+      pool->run(sweep.reconstruct_task, &sweep, nblocks);
+
+   // Update the front or rear mask pairs.
+   if(step == LF_NMF_STEP_H){
+      pool->run(sweep.update_H_task, &sweep, nblocks);
+      return nblocks;
+   }
+   if(step == LF_NMF_STEP_W)
+      pool->run(sweep.update_W_task, &sweep, nblocks);
+
+   // Accumulate the error of the rays leaving the band (if requested).
+   // Note: The rows are summed in order, as the full PSNR evaluation of the
+   //       in-core solver does (see evaluate_PSNR).
+   if(SSE != NULL){
+      unsigned int nrows = row1-row0;
+      NMFTile tile = {0, 0, 0, plan->lf_dim[1]};
+      sweep.tiles.assign(nrows, tile);
+      for(unsigned int v=row0; v<row1; v++){
+         sweep.tiles[v-row0].row0 = v;
+         sweep.tiles[v-row0].row1 = v+1;
+      }
+      sweep.tile_SSE.assign(nrows*C, 0);
+      pool->run(evaluate_row_block<T>, &sweep, nrows);
+      for(unsigned int n=0; n<nrows; n++)
+         for(unsigned int c=0; c<C; c++)
+            SSE[c] += sweep.tile_SSE[n*C+c];
+   }
+   return nblocks;
+}
+
+// Apply the weighted multiplicative update rule from coarse to fine resolution.
+// Note: The coarser level halves the spatial resolution along each axis
+//       with a single view (which is exact for masks that are constant over
+//       pairs of pixels), keeping every view. Axes with several views are
+//       kept, since halving them would also halve the offsets between the
+//       mask pixels of each ray (and keeping every other view converged more
+//       slowly than the full resolution alone). The coarse masks are
+//       initialized by averaging the initial masks, and the coarse result is
+//       replicated to initialize this level, which is then refined using the
+//       remaining options. The front masks are left unchanged if they are
+//       fixed. Returns the number of iterations applied at this level.
+template<typename T, typename S>
+static unsigned long lf_nmf_solve_levels(
+        const NMFPlan* plan, const S* lf, const T* lut, unsigned int C,
+        T* W_data, T* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+
+   // Determine the dimensions of the coarser level.
+   // Note: The coarser levels are skipped once the display is too small (or
+   //       if neither axis has a single view, see lf_nmf_2d_Euclidean).
+   const unsigned int* lf_dim = plan->lf_dim;
+   unsigned int s0 = (lf_dim[2] == 1) ? 2 : 1;
+   unsigned int s1 = (lf_dim[3] == 1) ? 2 : 1;
+   unsigned int lfc_dim[4] = {(lf_dim[0]+s0-1)/s0, (lf_dim[1]+s1-1)/s1, lf_dim[2], lf_dim[3]};
+   NMFOptions opt_f = *opt;
+   opt_f.levels = 1;
+   if(s0*s1 == 1 || lfc_dim[0] < 8*lfc_dim[2] || lfc_dim[1] < 8*lfc_dim[3]){
+      lf_nmf_printf(opt, "  + Factorizing %ux%ux%ux%u level (%lu iterations)...\n",
+                    lf_dim[0], lf_dim[1], lf_dim[2], lf_dim[3], opt_f.niter);
+      return lf_nmf_solve(plan, lf, lut, C, W_data, H_data, R, &opt_f, E_data);
+   }
+   NMFPlan* plan_c = lf_nmf_create_plan(lfc_dim);
+   unsigned long N = plan->N, Nc = plan_c->N, nrays_c = plan_c->nrays;
+
+   // Downsample the light field (averaging each block of s0 x s1 rays).
+   std::vector<T> lf_c(nrays_c*C);
+   T* lf_ci = &lf_c[0];
+   for(unsigned int c=0; c<C; c++){
+      for(unsigned int a=0; a<lfc_dim[3]; a++){
+         for(unsigned int b=0; b<lfc_dim[2]; b++){
+            const S* lf_f = lf+((c*lf_dim[3]+a)*lf_dim[2]+b)*N;
+            for(unsigned int u=0; u<lfc_dim[1]; u++){
+               for(unsigned int v=0; v<lfc_dim[0]; v++, lf_ci++){
+                  double sum = 0;
+                  int n = 0;
+                  for(unsigned int uf=s1*u; uf<MIN(s1*u+s1, lf_dim[1]); uf++)
+                     for(unsigned int vf=s0*v; vf<MIN(s0*v+s0, lf_dim[0]); vf++, n++)
+                        sum += lf_value(lf_f[(unsigned long)uf*lf_dim[0]+vf], lut);
+                  *lf_ci = (T)(sum/n);
+               }
+            }
+         }
+      }
+   }
+
+   // Downsample the initial mask pairs (averaging each block of s0 x s1 pixels).
+   // Note: Mask pixels are stored in row-major order (i.e., i = v*cols+u).
+   std::vector<T> W_c(Nc*R*C), H_c(Nc*R*C);
+   std::vector<unsigned long> parent(N);
+   std::vector<int> count(Nc, 0);
+   for(unsigned int v=0; v<lf_dim[0]; v++){
+      for(unsigned int u=0; u<lf_dim[1]; u++){
+         unsigned long i = (unsigned long)v*lf_dim[1]+u;
+         parent[i] = (unsigned long)(v/s0)*lfc_dim[1]+u/s1;
+         count[parent[i]]++;
+      }
+   }
+   for(unsigned int c=0; c<C; c++){
+      for(unsigned int r=0; r<R; r++){
+         for(unsigned long i=0; i<N; i++){
+            W_c[c*Nc*R+r*Nc+parent[i]] += W_data[c*N*R+r*N+i]/count[parent[i]];
+            H_c[c*R*Nc+parent[i]*R+r] += H_data[c*R*N+i*R+r]/count[parent[i]];
+         }
+      }
+   }
+
+   // Factorize the coarser level (and, recursively, the levels below it).
+   // Note: The PSNR and telemetry are only reported for the finest level.
+   NMFOptions opt_c = *opt;
+   opt_c.levels = opt->levels-1;
+   opt_c.niter = opt->level_iter;
+   opt_c.log = NULL;
+   if(opt_c.levels <= 1)
+      lf_nmf_printf(opt, "  + Factorizing %ux%ux%ux%u level (%lu iterations)...\n",
+                    lfc_dim[0], lfc_dim[1], lfc_dim[2], lfc_dim[3], opt_c.niter);
+   lf_nmf_solve(plan_c, &lf_c[0], (const T*)NULL, C, &W_c[0], &H_c[0], R, &opt_c, (double*)NULL);
+   lf_nmf_destroy_plan(plan_c);
+
+   // Initialize the mask pairs of this level (replicating each coarse pixel).
+   for(unsigned int c=0; c<C; c++){
+      for(unsigned int r=0; r<R; r++){
+         for(unsigned long i=0; i<N; i++){
+            W_data[c*N*R+r*N+i] = W_c[c*Nc*R+r*Nc+parent[i]];
+            if(!opt->fix_H)
+               H_data[c*R*N+i*R+r] = H_c[c*R*Nc+parent[i]*R+r];
+         }
+      }
+   }
+   lf_nmf_printf(opt, "  + Factorizing %ux%ux%ux%u level (%lu iterations)...\n",
+                 lf_dim[0], lf_dim[1], lf_dim[2], lf_dim[3], opt_f.niter);
+   return lf_nmf_solve(plan, lf, lut, C, W_data, H_data, R, &opt_f, E_data);
+}
+
+// Apply the weighted multiplicative update rule (for either scalar type).
+// Note: The light field elements are of type T, or are quantized codes of
+//       type S, mapped to T through the lookup table "lut" (see NMFQuantized).
+template<typename T, typename S>
+static unsigned long lf_nmf_solve(
+        const NMFPlan* plan, const S* lf, const T* lut, unsigned int C,
+        T* W_data, T* H_data, unsigned long R,
+        const NMFOptions* opt, double* E_data){
+
+   // Factorize the coarser levels first (if requested).
+   if(opt->levels > 1)
+      return lf_nmf_solve_levels(plan, lf, lut, C, W_data, H_data, R, opt, E_data);
+
+   // Extract light field dimensions.
+   unsigned long N = plan->N;
+   unsigned long nrays = plan->nrays;
+   unsigned long niter = opt->niter;
+   unsigned long CR = C*R;
+   bool fix_H = opt->fix_H;
+   bool fixed_H = fix_H && (plan->nAngles[0]%2) == 1 && (plan->nAngles[1]%2) == 1 &&
+                  (opt->rule != LF_NMF_RULE_MU || 2*R < plan->window.size());
+   bool gauss_seidel = !fix_H && opt->schedule == LF_NMF_SCHEDULE_GAUSS_SEIDEL;
+   double min_PSNR = opt->min_PSNR;
+   double tol_objective = opt->tol_objective;
+   double tol_factor = opt->tol_factor;
+   unsigned long plateau = opt->plateau;
+   bool evaluate = (opt->evaluate_PSNR && (E_data != NULL)) ||
+                   tol_objective > 0 || plateau > 0 || opt->log != NULL;
+   unsigned int PSNR_mode = fixed_H ? (unsigned int)LF_NMF_PSNR_FUSED : opt->PSNR_mode;
+   if((gauss_seidel && PSNR_mode == LF_NMF_PSNR_FUSED) || plan->ray0 > 0)
+      PSNR_mode = LF_NMF_PSNR_FULL; // see evaluate_PSNR
+   unsigned long PSNR_interval = MAX(opt->PSNR_interval, 1);
+
+   // Copy the light field into angular bundles (see LF_NMF_PLAN).
+   // Note: The channels of each ray are interleaved, so the update rules
+   //       read contiguous light field elements for each mask pixel. Quantized
+   //       light fields are dequantized here (i.e., only once per solve).
+   const unsigned int* lf_dim = plan->lf_dim;
+   unsigned long K = plan->K;
+   T* lf_data = new T[nrays*C];
+   for(unsigned int c=0; c<C; c++){
+      const S* lf_c = lf+c*nrays;
+      for(unsigned int a=0; a<lf_dim[3]; a++){
+         for(unsigned int b=0; b<lf_dim[2]; b++){
+            unsigned long q = b*lf_dim[3]+a;
+            for(unsigned int u=0; u<lf_dim[1]; u++){
+               for(unsigned int v=0; v<lf_dim[0]; v++, lf_c++){
+                  unsigned long i = (unsigned long)v*lf_dim[1]+u;
+                  lf_data[(i*K+q)*C+c] = lf_value(*lf_c, lut);
+               }
+            }
+         }
+      }
+   }
+
+   // Copy the mask pairs into pixel-major order.
+   // Note: The C*R elements of each pixel are contiguous (see LF_NMF_SIMD),
+   //       so the front masks of a single channel are used in place.
+   T* W = new T[N*CR];
+   T* H = (C > 1) ? new T[N*CR] : H_data;
+   for(unsigned int c=0; c<C; c++){
+      for(unsigned long i=0; i<N; i++){
+         for(unsigned int r=0; r<R; r++){
+            W[i*CR+c*R+r] = W_data[c*N*R+r*N+i];
+            if(H != H_data)
+               H[i*CR+c*R+r] = H_data[c*R*N+i*R+r];
+         }
+      }
+   }
+
+   // Allocate the light field reconstruction (i.e., one element per ray).
+   // Note: Rays that leave the display are not reconstructed. If the front
+   //       masks are fixed, the normal equations of each rear pixel are
+   //       used instead (see init_fixed_block), which need C*(R+1)*(R+2)/2
+   //       elements per pixel. Since the multiplicative update rule only
+   //       visits each ray twice, it only uses them for small ranks (i.e.,
+   //       2*R less than the number of views).
+   T* lf_approx = NULL;
+   if(!fixed_H){
+      lf_approx = new T[nrays*C];
+      memset(lf_approx, 0, sizeof(T)*nrays*C);
+   }
+
+   // Partition the mask pixels into tiles (sized for the L2 cache).
+   // Note: The first "nblocks" tiles cover bands of mask rows (see
+   //       partition_bands), followed by their halos with the Gauss-Seidel
+   //       schedule. Otherwise, the bands are split into one contiguous
+   //       chunk per thread (of at least two bands each) for the pipelined
+   //       sweep. The out-of-core solver uses plain tiles instead.
+   NMFThreadPool pool(opt->nthreads > 0 ? opt->nthreads : lf_nmf_default_threads());
+   NMFSweep<T> sweep;
+   sweep.plan       = plan;
+   sweep.lf         = lf_data;
+   sweep.N          = N;
+   sweep.R          = R;
+   sweep.C          = C;
+   sweep.W_data     = W;
+   sweep.H_data     = H;
+   sweep.lf_approx  = lf_approx;
+   sweep.lane.resize((CR+LF_NMF_SIMD_PAD-1)/LF_NMF_SIMD_PAD*LF_NMF_SIMD_PAD, 0);
+   for(unsigned long l=0; l<CR; l++)
+      sweep.lane[l] = (int)(l/R);
+   sweep.frozen.assign(C, 0);
+   sweep.any_frozen = false;
+   select_rule(&sweep, opt);
+   select_kernels(&sweep);
+   sweep.fixed_H = fixed_H;
+   if(fixed_H){
+      sweep.normal.resize(N*(CR*(R+1)/2+CR+C));
+      sweep.update_W_task = update_W_fixed_block<T>;
+   }
+   unsigned int nblocks = partition_bands(&sweep, pool.size(), gauss_seidel);
+   unsigned int ntiles = (unsigned int)sweep.tiles.size();
+   unsigned int nbands = (unsigned int)sweep.bands.size();
+   unsigned int nchunks = MAX(MIN(pool.size(), nbands/2), 1);
+   sweep.chunks.resize(nchunks+1);
+   for(unsigned int chunk=0; chunk<=nchunks; chunk++)
+      sweep.chunks[chunk] = (unsigned int)((unsigned long)nbands*chunk/nchunks);
+   sweep.accumulate = false;
+   sweep.tile_SSE.assign(ntiles*C, 0);
+   sweep.track = (opt->log != NULL) || tol_factor > 0;
+   sweep.count_clamped = (opt->log != NULL);
+   sweep.refresh = !sweep.gram || sweep.count_clamped;
+   NMFTileStats zero_stats = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+   sweep.tile_stats.assign(ntiles*C, zero_stats);
+   if(evaluate)
+      init_PSNR(&sweep, (PSNR_mode == LF_NMF_PSNR_SAMPLED) ? opt->PSNR_samples : 0);
+   init_sparse(&sweep, opt, nblocks);
+
+   // Reconstruct the light field using the initial mask pairs.
+   // Note: The rear mask update refreshes the reconstruction thereafter. If
+   //       the front masks are fixed, the normal equations of the rear masks
+   //       are evaluated instead (with the initial error, for fused mode).
+   if(fixed_H){
+      sweep.accumulate = evaluate;
+      pool.run(init_fixed_block<T>, &sweep, nblocks);
+      sweep.accumulate = false;
+   }
+   else
+      pool.run(sweep.reconstruct_task, &sweep, nblocks);
+
+   // Apply the weighted multiplicative update rule.
+   // Note: Each channel stops once it meets a stopping rule (see NMFOptions),
+   //       after which its mask pairs are left unchanged by the joint sweeps.
+   const double NaN = std::numeric_limits<double>::quiet_NaN();
+   std::vector<double> E(C, NaN), E_last(C, NaN);
+   std::vector<double> MSE(C, NaN), MSE_prev(C, NaN);
+   std::vector<double> MSE_best(C, HUGE_VAL);
+   std::vector<unsigned long> iter_best(C, 0);
+   std::vector<double> rel_objective(C, NaN), rel_factor(C, NaN);
+   std::vector<NMFTileStats> stats(C);
+   unsigned long nactive = C;
+   unsigned long niter_applied = 0;
+   char msg[1024];
+   if(opt->log != NULL)
+      opt->log("iter,channel,objective,PSNR,rel_objective,rel_W,rel_H,clamped,reset,time\n");
+   for(unsigned int iter=0; iter<niter; iter++) {
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+      // Evaluate PSNR of light field approximation (if necessary).
+      // Note: In fused mode, the error was accumulated by the previous
+      //       rear mask update (except for the first iteration, unless the
+      //       front masks are fixed).
+      bool evaluated = evaluate && (iter%PSNR_interval) == 0;
+      if(evaluated){
+         unsigned int mode = PSNR_mode;
+         if(mode == LF_NMF_PSNR_FUSED && iter == 0 && !fixed_H)
+            mode = LF_NMF_PSNR_FULL;
+         evaluate_PSNR(&sweep, mode, &E[0], &MSE[0]);
+      }
+
+      // Apply the stopping rules (for each active channel).
+      for(unsigned int c=0; c<C; c++){
+         if(sweep.frozen[c])
+            continue;
+         rel_objective[c] = NaN;
+         msg[0] = '\0';
+         if(evaluated){
+            E_last[c] = E[c];
+            rel_objective[c] = fabs(MSE_prev[c]-MSE[c])/MSE_prev[c];
+            MSE_prev[c] = MSE[c];
+            if(MSE[c] < MSE_best[c]*(1.0-tol_objective)){
+               MSE_best[c] = MSE[c];
+               iter_best[c] = iter;
+            }
+            if(E[c] > min_PSNR)
+               sprintf(msg, "PSNR = %4.1f dB > %4.1f dB", E[c], min_PSNR);
+            else if(tol_objective > 0 && rel_objective[c] < tol_objective)
+               sprintf(msg, "relative objective change = %.2e < %.2e",
+                       rel_objective[c], tol_objective);
+            else if(plateau > 0 && iter-iter_best[c] >= plateau)
+               sprintf(msg, "no improvement for %lu iterations",
+                       (unsigned long)(iter-iter_best[c]));
+         }
+         if(msg[0] == '\0' && tol_factor > 0 && rel_factor[c] < tol_factor)
+            sprintf(msg, "relative mask change = %.2e < %.2e", rel_factor[c], tol_factor);
+         if(E_data != NULL)
+            E_data[c*niter+iter] = evaluated ? E[c] : NaN;
+         if(msg[0] != '\0'){
+            if(C > 1)
+               lf_nmf_printf(opt, "  + Stopping channel %d at iteration #%03d (%s)...\n",
+                             c+1, iter+1, msg);
+            else
+               lf_nmf_printf(opt, "  + Stopping at iteration #%03d (%s)...\n",
+                             iter+1, msg);
+            if(E_data != NULL)
+               for(unsigned int i=iter; i<niter; i++)
+                  E_data[c*niter+i] = E_last[c];
+            log_iteration(opt, iter, c, evaluated ? MSE[c] : NaN, evaluated ? E[c] : NaN,
+                          rel_objective[c], NULL, NaN);
+            sweep.frozen[c] = 1;
+            sweep.any_frozen = true;
+            nactive--;
+         }
+      }
+      if(nactive == 0)
+         break;
+      if((iter%10)==0){
+         if(evaluated){
+            format_PSNR(msg, &E[0], C);
+            lf_nmf_printf(opt, "  + Updating for iteration #%03d (initial PSNR = %s dB)...\n",
+                          iter+1, msg);
+         }
+         else if(evaluate)
+            lf_nmf_printf(opt, "  + Updating for iteration #%03d...\n", iter+1);
+         else
+            lf_nmf_printf(opt, "  + Updating for iteration #%d...\n", iter+1);
+      }
+      niter_applied = iter+1;
+
+      // Update both mask pairs one band at a time (Gauss-Seidel schedule).
+      // Note: Even bands are updated first, and then odd bands (i.e., bands
+      //       of one color are updated in parallel), so the result does not
+      //       depend on the order in which threads pick up bands (nor on the
+      //       number of threads, see partition_bands).
+      if(gauss_seidel){
+         for(sweep.color=0; sweep.color<2; sweep.color++)
+            pool.run(update_band_block<T>, &sweep,
+                     (unsigned int)(sweep.bands.size()+1-sweep.color)/2);
+         check_sparse(&sweep, 0, nblocks);
+         check_sparse(&sweep, 1, nblocks);
+      }
+
+      // Update both mask pairs in a single pipelined pass (Jacobi schedule).
+      // Note: Each band of rear masks is updated as soon as the front masks
+      //       of the next band are updated (i.e., once every front mask and
+      //       ray it depends on is final, and no front mask update still
+      //       reads it), so the result is identical to separate sweeps, but
+      //       the rays of each band are still cached for the second half-step.
+      //       The bands at the seams between chunks are updated last. While
+      //       the masks are sparse, separate sweeps are used instead, since
+      //       the kernels may change after the front mask update.
+      sweep.accumulate = evaluate && PSNR_mode == LF_NMF_PSNR_FUSED &&
+                         ((iter+1)%PSNR_interval) == 0;
+      bool pipelined = !fix_H && !gauss_seidel && !sweep.sparse;
+      if(pipelined){
+         pool.run(pipeline_block<T>, &sweep, nchunks);
+         pool.run(pipeline_seam_block<T>, &sweep, nchunks-1);
+      }
+
+      // Update the front mask pairs (i.e., the "H" matrix).
+      // Note: The reconstruction is refreshed for the updated front masks,
+      //       unless the rear mask update uses Gram matrices instead (and
+      //       the telemetry does not classify the updated elements).
+      if(!fix_H && !gauss_seidel && !pipelined){
+         pool.run(sweep.update_H_task, &sweep, nblocks);
+         check_sparse(&sweep, 0, nblocks);
+         if(sweep.refresh)
+            pool.run(sweep.reconstruct_task, &sweep, nblocks);
+      }
+
+      // Update the rear mask pairs (i.e., the "W" matrix).
+      // Note: The reconstruction is refreshed for the updated rear masks
+      //       (accumulating the error for the next PSNR evaluation in
+      //       fused mode).
+      if(!gauss_seidel && !pipelined){
+         pool.run(sweep.update_W_task, &sweep, nblocks);
+         check_sparse(&sweep, 1, nblocks);
+      }
+
+      // Evaluate the relative change of the mask pairs (if necessary).
+      // Note: The statistics of each tile are reduced in a fixed order.
+      if(!sweep.track)
+         continue;
+      double step_time = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now()-t0).count();
+      for(unsigned int c=0; c<C; c++){
+         if(sweep.frozen[c])
+            continue;
+         stats[c] = zero_stats;
+         for(unsigned int block=0; block<nblocks; block++){
+            const NMFTileStats& tile = sweep.tile_stats[block*C+c];
+            for(int side=0; side<2; side++){
+               stats[c].change[side]  += tile.change[side];
+               stats[c].norm[side]    += tile.norm[side];
+               stats[c].clamped[side] += tile.clamped[side];
+               stats[c].reset[side]   += tile.reset[side];
+            }
+         }
+         double rel_H = fix_H ? 0 : sqrt(stats[c].change[0]/stats[c].norm[0]);
+         double rel_W = sqrt(stats[c].change[1]/stats[c].norm[1]);
+         rel_factor[c] = MAX(rel_H, rel_W);
+         log_iteration(opt, iter, c, evaluated ? MSE[c] : NaN, evaluated ? E[c] : NaN,
+                       rel_objective[c], &stats[c], step_time);
+      }
+
+   }
+
+   // Copy the mask pairs back into column-major order.
+   for(unsigned int c=0; c<C; c++){
+      for(unsigned long i=0; i<N; i++){
+         for(unsigned int r=0; r<R; r++){
+            W_data[c*N*R+r*N+i] = W[i*CR+c*R+r];
+            if(H != H_data)
+               H_data[c*R*N+i*R+r] = H[i*CR+c*R+r];
+         }
+      }
+   }
+
+   // Release intermediate variables.
+   delete[] W;
+   if(H != H_data)
+      delete[] H;
+   delete[] lf_data;
+   delete[] lf_approx;
+
+   // Return number of iterations.
+   return niter_applied;
+}
+
+// Select the update rule (see LF_NMF_RULES).
+// Note: Gram matrices are only used for odd numbers of views, since the
+//       rays of a window only return to the updated pixel if its window is
+//       symmetric (i.e., otherwise the denominators are not G*y).
+template<typename T>
+static void select_rule(NMFSweep<T>* sweep, const NMFOptions* opt){
+   sweep->inner_iter = MAX(opt->inner_iter, 1);
+   if(opt->rule == LF_NMF_RULE_HALS)
+      sweep->update = lf_nmf_update_hals<T>;
+   else if(opt->rule == LF_NMF_RULE_AMU)
+      sweep->update = lf_nmf_update_amu<T>;
+   else
+      sweep->update = lf_nmf_update_mu<T>;
+   sweep->gram = opt->gram && (sweep->plan->nAngles[0]%2) == 1 &&
+                 (sweep->plan->nAngles[1]%2) == 1;
+   sweep->inline_update = !opt->gram &&
+                          opt->rule != LF_NMF_RULE_HALS && opt->rule != LF_NMF_RULE_AMU;
+}
+
+// Select the sweep kernels for the display and rank.
+// Note: Every kernel visits the interior pixels (see NMFPlan) with a fixed
+//       window, and only the border frame with trimmed windows. The common
+//       configurations (i.e., 1x3 views with rank 3, and 3x3 views with rank
+//       9) use kernels specialized at compile time, with unrolled window
+//       loops (e.g., a single row of views reduces to a 1-D stencil). Any
+//       other configuration uses the generic kernels, with identical results.
+template<typename T>
+static void select_kernels(NMFSweep<T>* sweep){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int A0 = plan->nAngles[0];
+   unsigned int A1 = plan->nAngles[1];
+#ifndef LF_NMF_GENERIC_KERNELS
+   if(A0 == 1 && A1 == 3 && sweep->R == 3){
+      sweep->reconstruct_task = reconstruct_block<T, 1, 3, 3>;
+      sweep->update_H_task = update_H_block<T, 1, 3, 3>;
+      sweep->update_W_task = update_W_block<T, 1, 3, 3>;
+      return;
+   }
+   if(A0 == 3 && A1 == 3 && sweep->R == 9){
+      sweep->reconstruct_task = reconstruct_block<T, 3, 3, 9>;
+      sweep->update_H_task = update_H_block<T, 3, 3, 9>;
+      sweep->update_W_task = update_W_block<T, 3, 3, 9>;
+      return;
+   }
+#endif
+   sweep->reconstruct_task = reconstruct_block<T, 0, 0, 0>;
+   sweep->update_H_task = update_H_block<T, 0, 0, 0>;
+   sweep->update_W_task = update_W_block<T, 0, 0, 0>;
+}
+
+// Partition mask pixels (in rows row0..row1-1) into rectangular tiles.
+// Note: Each tile spans enough columns so that the mask and light field
+//       rows it touches (i.e., nAngles[0] rows of each) fit in the cache
+//       budget. If several threads are used, tiles are also split along
+//       rows, so that each thread receives several tiles.
+template<typename T>
+static void partition_tiles(NMFSweep<T>* sweep, unsigned int nthreads,
+                            unsigned int row0, unsigned int row1){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int rows = row1-row0;
+   unsigned int cols = plan->lf_dim[1];
+   unsigned long tile_cols = tile_columns(sweep);
+   unsigned int nstrips = (unsigned int)((cols+tile_cols-1)/tile_cols);
+   unsigned int nbands = 1;
+   if(nthreads > 1)
+      nbands = MIN(rows, (8*nthreads+nstrips-1)/nstrips);
+   sweep->tiles.clear();
+   for(unsigned int y=0; y<nbands; y++){
+      for(unsigned int x=0; x<nstrips; x++){
+         NMFTile tile;
+         tile.row0 = row0+(unsigned int)((unsigned long)rows*y/nbands);
+         tile.row1 = row0+(unsigned int)((unsigned long)rows*(y+1)/nbands);
+         tile.col0 = (unsigned int)((unsigned long)cols*x/nstrips);
+         tile.col1 = (unsigned int)((unsigned long)cols*(x+1)/nstrips);
+         sweep->tiles.push_back(tile);
+      }
+   }
+}
+
+// Determine the number of columns of each tile (see partition_tiles).
+template<typename T>
+static unsigned long tile_columns(const NMFSweep<T>* sweep){
+   const NMFPlan* plan = sweep->plan;
+   unsigned long pixel_bytes = sizeof(T)*sweep->C*(2*sweep->R+2*plan->K);
+   unsigned long tile_cols = LF_NMF_L2_BYTES/(plan->nAngles[0]*pixel_bytes);
+   return MIN(MAX(tile_cols, 16), plan->lf_dim[1]);
+}
+
+// Partition mask rows into bands (see NMFBand), with halos if requested.
+// Note: Each band spans enough rows so that its pixels fit in the cache
+//       budget (i.e., the passes over each band reuse the cache), or three
+//       bands without halos (i.e., a step of the pipelined sweep touches a
+//       band and both of its neighbors, see pipeline_block), but at
+//       least 2*nHalfAngles[0] rows, so that a band only exchanges rays and
+//       mask rows with its neighbors (e.g., bands of one color neither read
+//       nor write the rows updated by the others). If several threads are
+//       used, bands without halos are narrowed so that each thread receives
+//       several bands. Bands with halos (i.e., the Gauss-Seidel schedule,
+//       whose result depends on the bands) only depend on the geometry, so
+//       that the masks do not depend on the number of threads. The tiles of
+//       the bands come first, so that the first tiles returned partition the
+//       display (the halos follow).
+template<typename T>
+static unsigned int partition_bands(NMFSweep<T>* sweep, unsigned int nthreads, bool halos){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int rows = plan->lf_dim[0];
+   unsigned int cols = plan->lf_dim[1];
+   unsigned int halo = plan->nHalfAngles[0];
+   unsigned long pixel_bytes = sizeof(T)*sweep->C*(2*sweep->R+2*plan->K);
+   unsigned long band_rows = LF_NMF_L2_BYTES/((halos ? 1 : 3)*cols*pixel_bytes);
+   if(nthreads > 1 && !halos)
+      band_rows = MIN(band_rows, rows/(8*nthreads));
+   band_rows = MIN(MAX(band_rows, MAX(2*halo, 1)), rows);
+   unsigned int nbands = (unsigned int)(rows/band_rows);
+   unsigned long tile_cols = tile_columns(sweep);
+   unsigned int nstrips = (unsigned int)((cols+tile_cols-1)/tile_cols);
+   sweep->tiles.clear();
+   sweep->bands.resize(nbands);
+   for(int pass=0; pass<(halos ? 2 : 1); pass++){
+      for(unsigned int y=0; y<nbands; y++){
+         unsigned int row0 = (unsigned int)((unsigned long)rows*y/nbands);
+         unsigned int row1 = (unsigned int)((unsigned long)rows*(y+1)/nbands);
+         if(pass == 1){
+            row0 = (row0 > halo) ? row0-halo : 0;
+            row1 = MIN(row1+halo, rows);
+            sweep->bands[y].halo0 = (unsigned int)sweep->tiles.size();
+         }
+         else
+            sweep->bands[y].tile0 = (unsigned int)sweep->tiles.size();
+         for(unsigned int x=0; x<nstrips; x++){
+            NMFTile tile;
+            tile.row0 = row0;
+            tile.row1 = row1;
+            tile.col0 = (unsigned int)((unsigned long)cols*x/nstrips);
+            tile.col1 = (unsigned int)((unsigned long)cols*(x+1)/nstrips);
+            sweep->tiles.push_back(tile);
+         }
+         if(pass == 1)
+            sweep->bands[y].halo1 = (unsigned int)sweep->tiles.size();
+         else
+            sweep->bands[y].tile1 = (unsigned int)sweep->tiles.size();
+      }
+   }
+   return nbands*nstrips;
+}
+
+// Apply both half-steps of the update rule to one band (Gauss-Seidel schedule).
+// Note: Updates band 2*block+color. After the front masks of the band are
+//       updated, every ray that reaches them is reconstructed again (unless
+//       the reconstruction is not used, see lf_nmf_solve), so that the
+//       reconstruction is current for every band before and after each step.
+template<typename T>
+static void update_band_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFBand& band = sweep->bands[2*block+sweep->color];
+   for(unsigned int tile=band.tile0; tile<band.tile1; tile++)
+      sweep->update_H_task(ctx, tile);
+   if(sweep->refresh)
+      for(unsigned int tile=band.halo0; tile<band.halo1; tile++)
+         sweep->reconstruct_task(ctx, tile);
+   for(unsigned int tile=band.tile0; tile<band.tile1; tile++)
+      sweep->update_W_task(ctx, tile);
+}
+
+// Apply both half-steps of the update rule to one chunk of bands (Jacobi schedule).
+// Note: Updates the front masks of every band of the chunk, and the rear
+//       masks of each band one band behind (i.e., after the front masks of
+//       the next band). The rear masks of the first and last band are left
+//       for pipeline_seam_block, unless they lie on the border of the display,
+//       since the neighboring chunks still read and write their neighbors.
+template<typename T>
+static void pipeline_block(void* ctx, unsigned int chunk){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   unsigned int band0 = sweep->chunks[chunk];
+   unsigned int band1 = sweep->chunks[chunk+1];
+   for(unsigned int y=band0; y<band1; y++){
+      const NMFBand& band = sweep->bands[y];
+      for(unsigned int tile=band.tile0; tile<band.tile1; tile++)
+         sweep->update_H_task(ctx, tile);
+      if(y > band0+1 || (y > band0 && band0 == 0))
+         update_W_band(sweep, y-1);
+   }
+   if(band1 == sweep->bands.size() && (band1 > band0+1 || band0 == 0))
+      update_W_band(sweep, band1-1);
+}
+
+// Update the rear masks of the bands at the seam after chunk "block" (Jacobi schedule).
+// Note: Every chunk spans at least two bands, so each seam band is only
+//       updated once (see pipeline_block).
+template<typename T>
+static void pipeline_seam_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   unsigned int y = sweep->chunks[block+1];
+   update_W_band(sweep, y-1);
+   update_W_band(sweep, y);
+}
+
+// Update the rear masks of one band (refreshing its rays first, if necessary).
+template<typename T>
+static inline void update_W_band(NMFSweep<T>* sweep, unsigned int y){
+   const NMFBand& band = sweep->bands[y];
+   if(sweep->refresh)
+      for(unsigned int tile=band.tile0; tile<band.tile1; tile++)
+         sweep->reconstruct_task(sweep, tile);
+   for(unsigned int tile=band.tile0; tile<band.tile1; tile++)
+      sweep->update_W_task(sweep, tile);
+}
+
+// Initialize PSNR evaluation (i.e., peak value and number of valid rays).
+// Note: Only rays that intersect both masks are considered. If requested,
+//       a fixed subset of valid rays is drawn (uniformly, with a fixed seed)
+//       so that successive estimates are comparable. For even numbers of
+//       views, the original PSNR pairs view (b,a) of rear pixel (v,u) with
+//       front pixel (v+b-nHalfAngles[0],u+a-nHalfAngles[1]), rather than
+//       the view visited by the update rule (see LF_NMF_PLAN).
+template<typename T>
+static void init_PSNR(NMFSweep<T>* sweep, unsigned long nsamples){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int C = sweep->C;
+   unsigned long K = plan->K;
+   sweep->peak.assign(C, 0);
+   sweep->nvalid = 0;
+   unsigned long i = 0;
+   if(plan->ray0 > 0){
+      for(unsigned int v=0; v<plan->lf_dim[0]; v++){
+         for(unsigned int u=0; u<plan->lf_dim[1]; u++, i++){
+            for(unsigned int b=0; b<plan->nAngles[0]; b++){
+               if(v+b < plan->nHalfAngles[0] || v+b-plan->nHalfAngles[0] >= plan->lf_dim[0])
+                  continue;
+               for(unsigned int a=0; a<plan->nAngles[1]; a++){
+                  if(u+a < plan->nHalfAngles[1] || u+a-plan->nHalfAngles[1] >= plan->lf_dim[1])
+                     continue;
+                  const T* lf = sweep->lf+(i*K+b*plan->nAngles[1]+a)*C;
+                  for(unsigned int c=0; c<C; c++)
+                     sweep->peak[c] = MAX(sweep->peak[c], (double)lf[c]);
+                  sweep->nvalid++;
+               }
+            }
+         }
+      }
+      sweep->samples.clear();
+      return;
+   }
+   for(unsigned int v=0; v<plan->lf_dim[0]; v++){
+      for(unsigned int u=0; u<plan->lf_dim[1]; u++, i++){
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+               const T* lf = sweep->lf+(i*K+k)*C;
+               for(unsigned int c=0; c<C; c++)
+                  sweep->peak[c] = MAX(sweep->peak[c], (double)lf[c]);
+               sweep->nvalid++;
+            }
+         }
+      }
+   }
+   sweep->samples.clear();
+   if(nsamples == 0 || nsamples >= sweep->nvalid)
+      return;
+   unsigned long long state = 0x9E3779B97F4A7C15ULL;
+   while(sweep->samples.size() < nsamples){
+      state = state*6364136223846793005ULL+1442695040888963407ULL;
+      unsigned long ray = (unsigned long)((state>>17)%plan->nrays);
+      unsigned long i = ray/K;
+      int dv = (int)((ray%K)/plan->nAngles[1])-(int)plan->nHalfAngles[0];
+      int du = (int)((ray%K)%plan->nAngles[1])-(int)plan->nHalfAngles[1];
+      unsigned int v = (unsigned int)(i/plan->lf_dim[1]);
+      unsigned int u = (unsigned int)(i%plan->lf_dim[1]);
+      if(dv >= plan->row_lo[v] && dv <= plan->row_hi[v] &&
+         du >= plan->col_lo[u] && du <= plan->col_hi[u])
+         sweep->samples.push_back(ray);
+   }
+   std::sort(sweep->samples.begin(), sweep->samples.end());
+}
+
+// Evaluate PSNR (and mean squared error) of the light field reconstruction.
+// Note: The error is accumulated in double precision for either scalar
+//       type, using every valid ray (full), the error accumulated by the
+//       rear mask update (fused), or the sampled rays (sampled). In full
+//       mode, the error of each mask row is summed first, and the rows are
+//       then summed in order (see row_SSE), so the out-of-core solver finds
+//       the same value band by band. For even numbers of views, the
+//       reconstruction only holds the rays visited by the update rule, so
+//       the rays of the original PSNR are recomputed (in full mode, see
+//       init_PSNR).
+template<typename T>
+static void evaluate_PSNR(const NMFSweep<T>* sweep, unsigned int mode, double* E, double* MSE){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int C = sweep->C;
+   unsigned long K = plan->K;
+   unsigned long R = sweep->R;
+   unsigned long CR = C*R;
+   std::vector<double> SSE(C, 0);
+   double num_elem = sweep->nvalid;
+   if(mode == LF_NMF_PSNR_FUSED){
+      for(unsigned int block=0; block<sweep->tiles.size(); block++)
+         for(unsigned int c=0; c<C; c++)
+            SSE[c] += sweep->tile_SSE[block*C+c];
+   }
+   else if(mode == LF_NMF_PSNR_SAMPLED && !sweep->samples.empty()){
+      for(unsigned long n=0; n<sweep->samples.size(); n++){
+         unsigned long ray = sweep->samples[n]*C;
+         for(unsigned int c=0; c<C; c++)
+            SSE[c] += pow((double)sweep->lf[ray+c] - (double)sweep->lf_approx[ray+c], 2);
+      }
+      num_elem = (double)sweep->samples.size();
+   }
+   else if(plan->ray0 > 0){
+      unsigned long i = 0;
+      for(unsigned int v=0; v<plan->lf_dim[0]; v++){
+         for(unsigned int u=0; u<plan->lf_dim[1]; u++, i++){
+            const T* W_i = sweep->W_data+i*CR;
+            for(unsigned int b=0; b<plan->nAngles[0]; b++){
+               if(v+b < plan->nHalfAngles[0] || v+b-plan->nHalfAngles[0] >= plan->lf_dim[0])
+                  continue;
+               for(unsigned int a=0; a<plan->nAngles[1]; a++){
+                  if(u+a < plan->nHalfAngles[1] || u+a-plan->nHalfAngles[1] >= plan->lf_dim[1])
+                     continue;
+                  unsigned long j = (unsigned long)(v+b-plan->nHalfAngles[0])*plan->lf_dim[1]+
+                                    (u+a-plan->nHalfAngles[1]);
+                  const T* H_j = sweep->H_data+j*CR;
+                  const T* lf = sweep->lf+(i*K+b*plan->nAngles[1]+a)*C;
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[c] - (double)lf_nmf_dot(W_i+c*R, H_j+c*R, R), 2);
+               }
+            }
+         }
+      }
+   }
+   else{
+      std::vector<double> row(C);
+      for(unsigned int v=0; v<plan->lf_dim[0]; v++){
+         row_SSE(sweep, v, &row[0]);
+         for(unsigned int c=0; c<C; c++)
+            SSE[c] += row[c];
+      }
+   }
+   for(unsigned int c=0; c<C; c++){
+      MSE[c] = SSE[c]/num_elem;
+      E[c] = (double)(10.0*log10(pow(sweep->peak[c], 2)/MSE[c]));
+   }
+}
+
+// Evaluate the squared error of the rays leaving rear mask row v.
+// Note: The rays of each pixel are visited in the order of the stencil
+//       (i.e., the untrimmed window, see LF_NMF_PLAN), so the result only
+//       depends on the row (and not on the plan of the band holding it).
+template<typename T>
+static void row_SSE(const NMFSweep<T>* sweep, unsigned int v, double* SSE){
+   const NMFPlan* plan = sweep->plan;
+   unsigned int C = sweep->C;
+   unsigned long K = plan->K;
+   unsigned long i = (unsigned long)v*plan->lf_dim[1];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   for(unsigned int u=0; u<plan->lf_dim[1]; u++, i++){
+      for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+         unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                          (plan->col_lo[u]+plan->nHalfAngles[1]);
+         for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+            unsigned long ray = (i*K+k)*C;
+            for(unsigned int c=0; c<C; c++)
+               SSE[c] += pow((double)sweep->lf[ray+c] - (double)sweep->lf_approx[ray+c], 2);
+         }
+      }
+   }
+}
+
+// Evaluate the squared error of the mask row of a tile (see row_SSE).
+// Note: Each tile holds a single row (see lf_nmf_band).
+template<typename T>
+static void evaluate_row_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   row_SSE(sweep, sweep->tiles[block].row0, &sweep->tile_SSE[block*sweep->C]);
+}
+
+// Reconstruct the light field for a tile of rear mask pixels.
+// Note: Evaluates the approximation W*H once per ray, so that the update
+//       rules and the PSNR evaluation do not recompute it for each rank.
+//       The rays of each rear pixel are written to its angular bundle
+//       (accumulating the error of the tile, if requested). For A0 x A1
+//       views and rank RR (see select_kernels), the window loop of interior
+//       pixels is unrolled.
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+static void reconstruct_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = (RR > 0) ? RR : sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   const T* W_data = sweep->W_data;
+   const T* H_data = sweep->H_data;
+   double* SSE = &sweep->tile_SSE[block*C];
+   const unsigned int* win = &plan->window[0];
+   unsigned int nwin = (A0 > 0) ? A0*A1 : (unsigned int)plan->window.size();
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      bool row_in = v >= plan->row_in[0] && v < plan->row_in[1];
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* W_i = W_data+i*CR;
+         const T* lf = sweep->lf+(i*K+plan->ray0)*C;
+         T* approx = sweep->lf_approx+(i*K+plan->ray0)*C;
+         if(row_in && u >= plan->col_in[0] && u < plan->col_in[1]){
+            for(unsigned int n=0; n<nwin; n++){
+               unsigned int k = (A0 > 0) ? n : win[n];
+               const T* H_j = H_data+(i+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++)
+                  approx[k*C+c] = lf_nmf_dot(W_i+c*R, H_j+c*R, R);
+               if(sweep->accumulate)
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[k*C+c] - (double)approx[k*C+c], 2);
+            }
+            continue;
+         }
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+               const T* H_j = H_data+(i+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++)
+                  approx[k*C+c] = lf_nmf_dot(W_i+c*R, H_j+c*R, R);
+               if(sweep->accumulate)
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[k*C+c] - (double)approx[k*C+c], 2);
+            }
+         }
+      }
+   }
+}
+
+// Update the front mask pairs (i.e., the "H" matrix) for a tile of pixels.
+// Note: Each element only depends on W and its previous value, so
+//       tiles are independent.
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+static void update_H_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = (RR > 0) ? RR : sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   const T* lf = sweep->lf;
+   const T* lf_approx = sweep->lf_approx;
+   T* H_data = sweep->H_data;
+   const T* W_data = sweep->W_data;
+   std::vector<const T*> x(K);
+   std::vector<T> a(K*C+LF_NMF_SIMD_PAD);
+   std::vector<T> b(K*C+LF_NMF_SIMD_PAD);
+   std::vector<T> work(R*(R+2));
+   std::vector<T> H_prev(CR);
+   std::vector<T> V(sweep->gram ? (tile.col1-tile.col0+2*plan->nHalfAngles[1])*CR*(R+1)/2 : 0);
+   std::vector<T> G(sweep->gram ? CR*R+CR*(R+1)/2 : 0);
+   const T* G_win = sweep->gram ? &G[0] : NULL;
+   NMFTileStats* stats = &sweep->tile_stats[block*C];
+   for(unsigned int c=0; c<C; c++){
+      stats[c].change[0] = stats[c].norm[0] = 0;
+      stats[c].clamped[0] = stats[c].reset[0] = 0;
+   }
+   const unsigned int* win = &plan->window[0];
+   unsigned int nwin = (A0 > 0) ? A0*A1 : (unsigned int)plan->window.size();
+   for(unsigned int t=tile.row0; t<tile.row1; t++){
+      unsigned long j = (unsigned long)t*plan->lf_dim[1]+tile.col0;
+      bool row_in = t >= plan->row_in[0] && t < plan->row_in[1];
+      unsigned int u0 = tile.col0+plan->col_lo[tile.col0];
+      if(sweep->gram)
+         gram_columns(sweep, W_data, t, u0, tile.col1+plan->col_hi[tile.col1-1], &V[0]);
+      for(unsigned int s=tile.col0; s<tile.col1; s++, j++){
+         unsigned int n = 0;
+         bool full = row_in && s >= plan->col_in[0] && s < plan->col_in[1];
+         for(; full && n<nwin; n++){
+            unsigned int k = (A0 > 0) ? n : win[n];
+            long ray = (j*K+plan->ray_off_H[k])*C;
+            x[n] = W_data+(j+plan->pix_off[k])*CR;
+            for(unsigned int c=0; c<C; c++){
+               a[n*C+c] = lf[ray+c];
+               b[n*C+c] = lf_approx[ray+c];
+            }
+         }
+         for(int dv=plan->row_lo[t]; dv<=plan->row_hi[t] && !full; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[s]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[s]; du<=plan->col_hi[s]; du++, k++, n++){
+               long ray = (j*K+plan->ray_off_H[k])*C;
+               x[n] = W_data+(j+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++){
+                  a[n*C+c] = lf[ray+c];
+                  b[n*C+c] = lf_approx[ray+c];
+               }
+            }
+         }
+         T* H_j = H_data+j*CR;
+         if(sweep->gram)
+            gram_window(sweep, &V[0], s, u0, &G[0]);
+         if(sweep->any_frozen || sweep->track)
+            memcpy(&H_prev[0], H_j, sizeof(T)*CR);
+         if(A0 > 0 && full && sweep->inline_update)
+            lf_nmf_update_fixed<A0*A1, RR>(H_j, &x[0], &a[0], &b[0], C, &sweep->lane[0]);
+         else
+            sweep->update(H_j, &x[0], &a[0], &b[0], G_win, NULL, n, R, C,
+                          &sweep->lane[0], &work[0], sweep->inner_iter);
+         if(sweep->any_frozen)
+            for(unsigned int c=0; c<C; c++)
+               if(sweep->frozen[c])
+                  memcpy(H_j+c*R, &H_prev[c*R], sizeof(T)*R);
+         if(sweep->track)
+            track_update(sweep, 0, H_j, &H_prev[0], &x[0], &a[0], &b[0],
+                         (const T*)NULL, (const T*)NULL, n, stats);
+      }
+   }
+}
+
+// Update the rear mask pairs (i.e., the "W" matrix) for a tile of pixels.
+// Note: Each element only depends on H and its previous value, so
+//       tiles are independent. The rays of each rear pixel are read
+//       from its angular bundle, which is then reconstructed for the
+//       updated masks (i.e., no other pixel reads or writes these rays).
+template<typename T, unsigned int A0, unsigned int A1, unsigned long RR>
+static void update_W_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = (RR > 0) ? RR : sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   T* W_data = sweep->W_data;
+   const T* H_data = sweep->H_data;
+   std::vector<const T*> x(K);
+   std::vector<T> a(K*C+LF_NMF_SIMD_PAD);
+   std::vector<T> b(K*C+LF_NMF_SIMD_PAD);
+   std::vector<T> work(R*(R+2));
+   std::vector<T> W_prev(CR);
+   std::vector<T> V(sweep->gram ? (tile.col1-tile.col0+2*plan->nHalfAngles[1])*CR*(R+1)/2 : 0);
+   std::vector<T> G(sweep->gram ? CR*R+CR*(R+1)/2 : 0);
+   const T* G_win = sweep->gram ? &G[0] : NULL;
+   NMFTileStats* stats = &sweep->tile_stats[block*C];
+   for(unsigned int c=0; c<C; c++){
+      stats[c].change[1] = stats[c].norm[1] = 0;
+      stats[c].clamped[1] = stats[c].reset[1] = 0;
+   }
+   double* SSE = &sweep->tile_SSE[block*C];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   const unsigned int* win = &plan->window[0];
+   unsigned int nwin = (A0 > 0) ? A0*A1 : (unsigned int)plan->window.size();
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      bool row_in = v >= plan->row_in[0] && v < plan->row_in[1];
+      unsigned int u0 = tile.col0+plan->col_lo[tile.col0];
+      if(sweep->gram)
+         gram_columns(sweep, H_data, v, u0, tile.col1+plan->col_hi[tile.col1-1], &V[0]);
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* lf = sweep->lf+(i*K+plan->ray0)*C;
+         T* lf_approx = sweep->lf_approx+(i*K+plan->ray0)*C;
+         unsigned int n = 0;
+         bool full = row_in && u >= plan->col_in[0] && u < plan->col_in[1];
+         for(; full && n<nwin; n++){
+            unsigned int k = (A0 > 0) ? n : win[n];
+            x[n] = H_data+(i+plan->pix_off[k])*CR;
+            for(unsigned int c=0; c<C; c++){
+               a[n*C+c] = lf[k*C+c];
+               b[n*C+c] = lf_approx[k*C+c];
+            }
+         }
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v] && !full; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++, n++){
+               x[n] = H_data+(i+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++){
+                  a[n*C+c] = lf[k*C+c];
+                  b[n*C+c] = lf_approx[k*C+c];
+               }
+            }
+         }
+         T* W_i = W_data+i*CR;
+         if(sweep->gram)
+            gram_window(sweep, &V[0], u, u0, &G[0]);
+         if(sweep->any_frozen || sweep->track)
+            memcpy(&W_prev[0], W_i, sizeof(T)*CR);
+         if(A0 > 0 && full && sweep->inline_update)
+            lf_nmf_update_fixed<A0*A1, RR>(W_i, &x[0], &a[0], &b[0], C, &sweep->lane[0]);
+         else
+            sweep->update(W_i, &x[0], &a[0], &b[0], G_win, NULL, n, R, C,
+                          &sweep->lane[0], &work[0], sweep->inner_iter);
+         if(sweep->any_frozen)
+            for(unsigned int c=0; c<C; c++)
+               if(sweep->frozen[c])
+                  memcpy(W_i+c*R, &W_prev[c*R], sizeof(T)*R);
+         if(sweep->track)
+            track_update(sweep, 1, W_i, &W_prev[0], &x[0], &a[0], &b[0],
+                         (const T*)NULL, (const T*)NULL, n, stats);
+         for(n=0; full && n<nwin; n++){
+            unsigned int k = (A0 > 0) ? n : win[n];
+            for(unsigned int c=0; c<C; c++)
+               lf_approx[k*C+c] = lf_nmf_dot(W_i+c*R, x[n]+c*R, R);
+            if(sweep->accumulate)
+               for(unsigned int c=0; c<C; c++)
+                  SSE[c] += pow((double)lf[k*C+c] - (double)lf_approx[k*C+c], 2);
+         }
+         n = 0;
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v] && !full; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++, n++){
+               for(unsigned int c=0; c<C; c++)
+                  lf_approx[k*C+c] = lf_nmf_dot(W_i+c*R, x[n]+c*R, R);
+               if(sweep->accumulate)
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[k*C+c] - (double)lf_approx[k*C+c], 2);
+            }
+         }
+      }
+   }
+}
+
+// Accumulate the Gram matrices of the window rows of row v (for columns u0..u1-1).
+// Note: "X" holds the fixed masks (i.e., W for the front mask update, and H
+//       for the rear mask update), and V receives the C Gram matrices (i.e.,
+//       sum x*x') of each column, summed over rows v+row_lo[v] to
+//       v+row_hi[v] in a fixed order (so the result does not depend on the
+//       tiles). Only the upper triangle of each matrix is stored (i.e.,
+//       R*(R+1)/2 elements, row by row).
+template<typename T>
+static void gram_columns(const NMFSweep<T>* sweep, const T* X, unsigned int v,
+                         unsigned int u0, unsigned int u1, T* V){
+   const NMFPlan* plan = sweep->plan;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   unsigned long L = C*R*(R+1)/2;
+   memset(V, 0, sizeof(T)*(u1-u0)*L);
+   for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+      const T* X_row = X+(unsigned long)(v+dv)*plan->lf_dim[1]*CR;
+      for(unsigned int u=u0; u<u1; u++){
+         const T* x = X_row+u*CR;
+         T* V_r = V+(u-u0)*L;
+         for(unsigned int c=0; c<C; c++, x+=R){
+            for(unsigned long r=0; r<R; r++){
+               T x_r = x[r];
+               for(unsigned long s=r; s<R; s++)
+                  V_r[s-r] += x_r*x[s];
+               V_r += R-r;
+            }
+         }
+      }
+   }
+}
+
+// Evaluate the Gram matrices of the window of pixel (v,u) (see gram_columns).
+// Note: "G" receives the C full matrices (R x R each), and must hold
+//       C*R*(R+1)/2 more elements for the upper triangles.
+template<typename T>
+static inline void gram_window(const NMFSweep<T>* sweep, const T* V,
+                               unsigned int u, unsigned int u0, T* G){
+   const NMFPlan* plan = sweep->plan;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long L = C*R*(R+1)/2;
+   T* G_up = G+C*R*R;
+   const T* V_u = V+(u+plan->col_lo[u]-u0)*L;
+   memcpy(G_up, V_u, sizeof(T)*L);
+   for(int du=plan->col_lo[u]+1; du<=plan->col_hi[u]; du++){
+      V_u += L;
+      for(unsigned long l=0; l<L; l++)
+         G_up[l] += V_u[l];
+   }
+   gram_unpack(G_up, R, C, G);
+}
+
+// Unpack the upper triangles of C Gram matrices into full matrices (R x R each).
+template<typename T>
+static inline void gram_unpack(const T* G_up, unsigned long R, unsigned int C, T* G){
+   for(unsigned int c=0; c<C; c++, G+=R*R){
+      for(unsigned long r=0; r<R; r++){
+         for(unsigned long s=r; s<R; s++, G_up++)
+            G[r*R+s] = G[s*R+r] = *G_up;
+      }
+   }
+}
+
+// Evaluate the squared error of the rays of one rear pixel (and channel) from
+// its normal equations (i.e., a2 - 2*p'*y + y'*G*y, with a2 = sum a[k]^2).
+// Note: The terms are summed in double precision, and clamped at zero (since
+//       they nearly cancel once the error is small).
+//       "Gy" must hold R elements.
+template<typename T>
+static inline double fixed_SSE(const T* G, const T* p, T a2, const T* y,
+                               unsigned long R, T* Gy){
+   double SSE = a2;
+   lf_nmf_gram_product(Gy, G, y, R);
+   for(unsigned long r=0; r<R; r++)
+      SSE += (double)y[r]*((double)Gy[r]-2.0*(double)p[r]);
+   return MAX(SSE, 0.0);
+}
+
+// Precompute the normal equations of the rear masks for a tile of pixels.
+// Note: If the front masks are fixed, then the update of each rear pixel
+//       only depends on the Gram matrices of its window of front pixels
+//       (i.e., G = sum_k x[k]*x[k]') and the right-hand sides (i.e.,
+//       p = sum_k a[k]*x[k]), which are evaluated once. For each pixel,
+//       "normal" holds the C upper triangles of G (see gram_columns), the
+//       C*R elements of p, and the C sums of squared rays (for the error of
+//       the tile, accumulated if requested). The windows must be symmetric
+//       (i.e., odd numbers of views), as for Gram matrices (see select_rule).
+template<typename T>
+static void init_fixed_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   unsigned long L = CR*(R+1)/2;
+   const T* H_data = sweep->H_data;
+   std::vector<const T*> x(K);
+   std::vector<T> a(K*C);
+   std::vector<T> V((tile.col1-tile.col0+2*plan->nHalfAngles[1])*L);
+   std::vector<T> G(CR*R+L);
+   std::vector<T> Gy(R);
+   double* SSE = &sweep->tile_SSE[block*C];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      unsigned int u0 = tile.col0+plan->col_lo[tile.col0];
+      gram_columns(sweep, H_data, v, u0, tile.col1+plan->col_hi[tile.col1-1], &V[0]);
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* lf = sweep->lf+(i*K+plan->ray0)*C;
+         T* normal = &sweep->normal[i*(L+CR+C)];
+         unsigned int n = 0;
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++, n++){
+               x[n] = H_data+(i+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++)
+                  a[n*C+c] = lf[k*C+c];
+            }
+         }
+         gram_window(sweep, &V[0], u, u0, &G[0]);
+         memcpy(normal, &G[CR*R], sizeof(T)*L);
+         for(unsigned int c=0; c<C; c++){
+            T* p = normal+L+c*R;
+            double a2 = 0;
+            lf_nmf_normal((T*)NULL, p, &x[0], &a[0], n, R, C, c);
+            for(unsigned int m=0; m<n; m++)
+               a2 += (double)a[m*C+c]*(double)a[m*C+c];
+            normal[L+CR+c] = (T)a2;
+            if(sweep->accumulate)
+               SSE[c] += fixed_SSE(&G[c*R*R], p, normal[L+CR+c],
+                                   sweep->W_data+i*CR+c*R, R, &Gy[0]);
+         }
+      }
+   }
+}
+
+// Update the rear mask pairs (i.e., the "W" matrix) for a tile of pixels,
+// using the precomputed normal equations (see init_fixed_block).
+// Note: Neither the light field nor its reconstruction is visited, and the
+//       error of the tile is evaluated from the normal equations.
+template<typename T>
+static void update_W_fixed_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   unsigned long L = CR*(R+1)/2;
+   T* W_data = sweep->W_data;
+   std::vector<T> G(CR*R);
+   std::vector<T> work(R*(R+2));
+   std::vector<T> W_prev(CR);
+   NMFTileStats* stats = &sweep->tile_stats[block*C];
+   for(unsigned int c=0; c<C; c++){
+      stats[c].change[1] = stats[c].norm[1] = 0;
+      stats[c].clamped[1] = stats[c].reset[1] = 0;
+   }
+   double* SSE = &sweep->tile_SSE[block*C];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* normal = &sweep->normal[i*(L+CR+C)];
+         const T* p = normal+L;
+         T* W_i = W_data+i*CR;
+         gram_unpack(normal, R, C, &G[0]);
+         if(sweep->any_frozen || sweep->track)
+            memcpy(&W_prev[0], W_i, sizeof(T)*CR);
+         sweep->update(W_i, (const T* const*)NULL, (const T*)NULL, (const T*)NULL,
+                       &G[0], p, 0, R, C, &sweep->lane[0], &work[0], sweep->inner_iter);
+         if(sweep->any_frozen)
+            for(unsigned int c=0; c<C; c++)
+               if(sweep->frozen[c])
+                  memcpy(W_i+c*R, &W_prev[c*R], sizeof(T)*R);
+         if(sweep->track)
+            track_update(sweep, 1, W_i, &W_prev[0], (const T* const*)NULL,
+                         (const T*)NULL, (const T*)NULL, &G[0], p, 0, stats);
+         if(sweep->accumulate)
+            for(unsigned int c=0; c<C; c++)
+               SSE[c] += fixed_SSE(&G[c*R*R], p+c*R, normal[L+CR+c], W_i+c*R, R, &work[0]);
+      }
+   }
+}
+
+// Initialize the sparse kernels (if the masks are sparse).
+// Note: Only the multiplicative update rule keeps zero elements at zero
+//       (see lf_nmf_update_sparse), so other rules (and the fixed-mask and
+//       Gram variants) always use the dense kernels. The sparse kernels skip
+//       zero pixels and neighbors, and are used while the fraction of
+//       nonzero pixels of either mask is at most opt->sparse_density
+//       (e.g., for pinhole arrays with fewer mask pairs than views, where
+//       most front pixels are closed). Skipping individual elements does not
+//       pay off against the dense kernels, so the specialized kernels (see
+//       select_kernels) are kept.
+template<typename T>
+static void init_sparse(NMFSweep<T>* sweep, const NMFOptions* opt, unsigned int nblocks){
+   unsigned long N = sweep->N;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   sweep->sparse = false;
+   sweep->sparse_density = opt->sparse_density;
+   if(opt->rule != LF_NMF_RULE_MU || sweep->gram || sweep->fixed_H ||
+      sweep->update_W_task != update_W_block<T, 0, 0, 0> || opt->sparse_density <= 0)
+      return;
+   sweep->nwords = (CR+63)/64;
+   sweep->nz_W.resize(N*sweep->nwords);
+   sweep->nz_H.resize(N*sweep->nwords);
+   sweep->nnz[0] = sweep->nnz[1] = 0;
+   for(unsigned long i=0; i<N; i++){
+      sweep->nnz[0] += (lf_nmf_sparse_bits(sweep->H_data+i*CR, CR, &sweep->nz_H[i*sweep->nwords]) > 0);
+      sweep->nnz[1] += (lf_nmf_sparse_bits(sweep->W_data+i*CR, CR, &sweep->nz_W[i*sweep->nwords]) > 0);
+   }
+   if(MIN(sweep->nnz[0], sweep->nnz[1]) > sweep->sparse_density*N){
+      std::vector<NMFBits>().swap(sweep->nz_W);
+      std::vector<NMFBits>().swap(sweep->nz_H);
+      return;
+   }
+   sweep->channel_bits.assign(C*sweep->nwords, 0);
+   for(unsigned long l=0; l<CR; l++)
+      sweep->channel_bits[(l/R)*sweep->nwords+l/64] |= (NMFBits)1 << (l%64);
+   sweep->tile_nnz.assign(2*nblocks, 0);
+   sweep->reconstruct_task = reconstruct_sparse_block<T>;
+   sweep->update_H_task = update_H_sparse_block<T>;
+   sweep->update_W_task = update_W_sparse_block<T>;
+   sweep->sparse = true;
+}
+
+// Update the number of nonzero pixels of one side after its update.
+// Note: Returns to the dense kernels (see select_kernels) once both masks
+//       exceed the density of the sparse kernels.
+template<typename T>
+static void check_sparse(NMFSweep<T>* sweep, unsigned int side, unsigned int nblocks){
+   if(!sweep->sparse)
+      return;
+   sweep->nnz[side] = 0;
+   for(unsigned int block=0; block<nblocks; block++)
+      sweep->nnz[side] += sweep->tile_nnz[2*block+side];
+   if(MIN(sweep->nnz[0], sweep->nnz[1]) <= sweep->sparse_density*sweep->N)
+      return;
+   sweep->sparse = false;
+   select_kernels(sweep);
+}
+
+// Determine whether a mask pixel has any nonzero element (see NMFBits).
+static inline bool sparse_any(const NMFBits* nz, unsigned long nwords){
+   for(unsigned long w=0; w<nwords; w++)
+      if(nz[w] != 0)
+         return true;
+   return false;
+}
+
+// Evaluate the reconstruction of one ray from the nonzero elements of its
+// rear and front pixels (i.e., one dot product per channel).
+// Note: Channels with at most one nonzero product are evaluated directly,
+//       and the others using lf_nmf_dot (which matches both exactly).
+template<typename T>
+static inline void sparse_ray(const NMFSweep<T>* sweep, const T* W_i, const NMFBits* nz_i,
+                              const T* H_j, const NMFBits* nz_j, T* approx){
+   unsigned long R = sweep->R;
+   unsigned long nwords = sweep->nwords;
+   for(unsigned int c=0; c<sweep->C; c++){
+      const NMFBits* channel = &sweep->channel_bits[c*nwords];
+      unsigned int count = 0;
+      unsigned long l = 0;
+      for(unsigned long w=0; w<nwords && count<2; w++){
+         NMFBits bits = nz_i[w] & nz_j[w] & channel[w];
+         if(bits == 0)
+            continue;
+         count += ((bits & (bits-1)) == 0) ? 1 : 2;
+         l = w*64+lf_nmf_ctz(bits);
+      }
+      if(count == 0)
+         approx[c] = 0;
+      else if(count == 1)
+         approx[c] = W_i[l]*H_j[l];
+      else
+         approx[c] = lf_nmf_dot(W_i+c*R, H_j+c*R, R);
+   }
+}
+
+// Reconstruct the light field for a tile of rear mask pixels (sparse masks).
+// Note: Matches reconstruct_block, using sparse_ray for each ray.
+template<typename T>
+static void reconstruct_sparse_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*sweep->R;
+   unsigned long nwords = sweep->nwords;
+   double* SSE = &sweep->tile_SSE[block*C];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* W_i = sweep->W_data+i*CR;
+         const NMFBits* nz_i = &sweep->nz_W[i*nwords];
+         const T* lf = sweep->lf+(i*K+plan->ray0)*C;
+         T* approx = sweep->lf_approx+(i*K+plan->ray0)*C;
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+               unsigned long j = i+plan->pix_off[k];
+               sparse_ray(sweep, W_i, nz_i, sweep->H_data+j*CR, &sweep->nz_H[j*nwords],
+                          approx+k*C);
+               if(sweep->accumulate)
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[k*C+c] - (double)approx[k*C+c], 2);
+            }
+         }
+      }
+   }
+}
+
+// Update the front mask pairs (i.e., the "H" matrix) for a tile of pixels
+// (sparse masks).
+// Note: Matches update_H_block, using lf_nmf_update_sparse for each pixel,
+//       and counts the nonzero pixels of the tile.
+template<typename T>
+static void update_H_sparse_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   unsigned long nwords = sweep->nwords;
+   const T* lf = sweep->lf;
+   const T* lf_approx = sweep->lf_approx;
+   T* H_data = sweep->H_data;
+   const T* W_data = sweep->W_data;
+   std::vector<const T*> x(K);
+   std::vector<const NMFBits*> nz_x(K);
+   std::vector<T> a(K*C);
+   std::vector<T> b(K*C);
+   std::vector<NMFBits> D(nwords);
+   std::vector<T> H_prev(CR);
+   NMFTileStats* stats = &sweep->tile_stats[block*C];
+   for(unsigned int c=0; c<C; c++){
+      stats[c].change[0] = stats[c].norm[0] = 0;
+      stats[c].clamped[0] = stats[c].reset[0] = 0;
+   }
+   unsigned long nnz = 0;
+   for(unsigned int t=tile.row0; t<tile.row1; t++){
+      unsigned long j = (unsigned long)t*plan->lf_dim[1]+tile.col0;
+      for(unsigned int s=tile.col0; s<tile.col1; s++, j++){
+         unsigned int n = 0;
+         for(int dv=plan->row_lo[t]; dv<=plan->row_hi[t]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[s]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[s]; du<=plan->col_hi[s]; du++, k++){
+               long ray = (j*K+plan->ray_off_H[k])*C;
+               nz_x[n] = &sweep->nz_W[(j+plan->pix_off[k])*nwords];
+               if(!sparse_any(nz_x[n], nwords))
+                  continue;
+               x[n] = W_data+(j+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++){
+                  a[n*C+c] = lf[ray+c];
+                  b[n*C+c] = lf_approx[ray+c];
+               }
+               n++;
+            }
+         }
+         T* H_j = H_data+j*CR;
+         NMFBits* nz_j = &sweep->nz_H[j*nwords];
+         if(sweep->any_frozen || sweep->track)
+            memcpy(&H_prev[0], H_j, sizeof(T)*CR);
+         lf_nmf_update_sparse(H_j, nz_j, &x[0], &nz_x[0], &a[0], &b[0], n, R, C, nwords,
+                              &sweep->channel_bits[0], &sweep->lane[0], &D[0]);
+         if(sweep->any_frozen)
+            for(unsigned int c=0; c<C; c++)
+               if(sweep->frozen[c])
+                  memcpy(H_j+c*R, &H_prev[c*R], sizeof(T)*R);
+         nnz += (lf_nmf_sparse_bits(H_j, CR, nz_j) > 0);
+         if(sweep->track)
+            track_update(sweep, 0, H_j, &H_prev[0], &x[0], &a[0], &b[0],
+                         (const T*)NULL, (const T*)NULL, n, stats);
+      }
+   }
+   sweep->tile_nnz[2*block] = nnz;
+}
+
+// Update the rear mask pairs (i.e., the "W" matrix) for a tile of pixels
+// (sparse masks).
+// Note: Matches update_W_block, using lf_nmf_update_sparse for each pixel
+//       and sparse_ray for its rays, and counts the nonzero pixels of the
+//       tile.
+template<typename T>
+static void update_W_sparse_block(void* ctx, unsigned int block){
+   NMFSweep<T>* sweep = (NMFSweep<T>*)ctx;
+   const NMFPlan* plan = sweep->plan;
+   const NMFTile& tile = sweep->tiles[block];
+   unsigned long K = plan->K;
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   unsigned long CR = C*R;
+   unsigned long nwords = sweep->nwords;
+   T* W_data = sweep->W_data;
+   const T* H_data = sweep->H_data;
+   std::vector<const T*> x(K);
+   std::vector<const NMFBits*> nz_x(K);
+   std::vector<T> a(K*C);
+   std::vector<T> b(K*C);
+   std::vector<NMFBits> D(nwords);
+   std::vector<T> W_prev(CR);
+   NMFTileStats* stats = &sweep->tile_stats[block*C];
+   for(unsigned int c=0; c<C; c++){
+      stats[c].change[1] = stats[c].norm[1] = 0;
+      stats[c].clamped[1] = stats[c].reset[1] = 0;
+   }
+   double* SSE = &sweep->tile_SSE[block*C];
+   for(unsigned int c=0; c<C; c++)
+      SSE[c] = 0;
+   unsigned long nnz = 0;
+   for(unsigned int v=tile.row0; v<tile.row1; v++){
+      unsigned long i = (unsigned long)v*plan->lf_dim[1]+tile.col0;
+      for(unsigned int u=tile.col0; u<tile.col1; u++, i++){
+         const T* lf = sweep->lf+(i*K+plan->ray0)*C;
+         T* lf_approx = sweep->lf_approx+(i*K+plan->ray0)*C;
+         unsigned int n = 0;
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+               nz_x[n] = &sweep->nz_H[(i+plan->pix_off[k])*nwords];
+               if(!sparse_any(nz_x[n], nwords))
+                  continue;
+               x[n] = H_data+(i+plan->pix_off[k])*CR;
+               for(unsigned int c=0; c<C; c++){
+                  a[n*C+c] = lf[k*C+c];
+                  b[n*C+c] = lf_approx[k*C+c];
+               }
+               n++;
+            }
+         }
+         T* W_i = W_data+i*CR;
+         NMFBits* nz_i = &sweep->nz_W[i*nwords];
+         if(sweep->any_frozen || sweep->track)
+            memcpy(&W_prev[0], W_i, sizeof(T)*CR);
+         lf_nmf_update_sparse(W_i, nz_i, &x[0], &nz_x[0], &a[0], &b[0], n, R, C, nwords,
+                              &sweep->channel_bits[0], &sweep->lane[0], &D[0]);
+         if(sweep->any_frozen)
+            for(unsigned int c=0; c<C; c++)
+               if(sweep->frozen[c])
+                  memcpy(W_i+c*R, &W_prev[c*R], sizeof(T)*R);
+         nnz += (lf_nmf_sparse_bits(W_i, CR, nz_i) > 0);
+         if(sweep->track)
+            track_update(sweep, 1, W_i, &W_prev[0], &x[0], &a[0], &b[0],
+                         (const T*)NULL, (const T*)NULL, n, stats);
+         for(int dv=plan->row_lo[v]; dv<=plan->row_hi[v]; dv++){
+            unsigned int k = (dv+plan->nHalfAngles[0])*plan->nAngles[1]+
+                             (plan->col_lo[u]+plan->nHalfAngles[1]);
+            for(int du=plan->col_lo[u]; du<=plan->col_hi[u]; du++, k++){
+               unsigned long j = i+plan->pix_off[k];
+               sparse_ray(sweep, W_i, nz_i, H_data+j*CR, &sweep->nz_H[j*nwords],
+                          lf_approx+k*C);
+               if(sweep->accumulate)
+                  for(unsigned int c=0; c<C; c++)
+                     SSE[c] += pow((double)lf[k*C+c] - (double)lf_approx[k*C+c], 2);
+            }
+         }
+      }
+   }
+   sweep->tile_nnz[2*block+1] = nnz;
+}
+
+// Accumulate statistics of the update of one mask pixel (see NMFTileStats).
+// Note: Elements set to one are classified by evaluating their update
+//       ratio again, which is only necessary for these (rare) elements.
+//       The ratio is evaluated from the normal equations G and p instead
+//       of the rays, unless NULL.
+template<typename T>
+static void track_update(const NMFSweep<T>* sweep, unsigned int side,
+                         const T* y, const T* y_prev, const T* const* x,
+                         const T* a, const T* b, const T* G, const T* p,
+                         unsigned int n, NMFTileStats* stats){
+   unsigned long R = sweep->R;
+   unsigned int C = sweep->C;
+   for(unsigned int c=0; c<C; c++){
+      if(sweep->frozen[c])
+         continue;
+      for(unsigned long l=c*R; l<(c+1)*R; l++){
+         double delta = (double)y[l]-(double)y_prev[l];
+         stats[c].change[side] += delta*delta;
+         stats[c].norm[side]   += (double)y[l]*(double)y[l];
+         if(!sweep->count_clamped || y[l] != 1)
+            continue;
+         T num = 0;
+         T den = 0;
+         if(G != NULL){
+            num = p[l];
+            den = lf_nmf_dot(G+l*R, y_prev+c*R, R);
+         }
+         for(unsigned int m=0; m<n; m++){
+            num += x[m][l]*a[m*C+c];
+            den += x[m][l]*b[m*C+c];
+         }
+         T ratio = y_prev[l]*(num/den);
+         if(ratio != ratio)
+            stats[c].reset[side]++;
+         else
+            stats[c].clamped[side]++;
+      }
+   }
+}
+
+// Define function to write one telemetry line (if output is enabled).
+// Note: Update statistics are omitted (i.e., NaN) for channels that stop
+//       before updating.
+static void log_iteration(const NMFOptions* opt, unsigned int iter, unsigned int c,
+                          double MSE, double E, double rel_objective,
+                          const NMFTileStats* stats, double step_time){
+   if(opt->log == NULL)
+      return;
+   char msg[1024];
+   if(stats == NULL)
+      sprintf(msg, "%u,%u,%.9g,%.6f,%.6g,nan,nan,nan,nan,nan\n",
+              iter+1, c+1, MSE, E, rel_objective);
+   else
+      sprintf(msg, "%u,%u,%.9g,%.6f,%.6g,%.6g,%.6g,%lu,%lu,%.6f\n",
+              iter+1, c+1, MSE, E, rel_objective,
+              sqrt(stats->change[1]/stats->norm[1]),
+              opt->fix_H ? 0.0 : sqrt(stats->change[0]/stats->norm[0]),
+              stats->clamped[0]+stats->clamped[1], stats->reset[0]+stats->reset[1],
+              step_time);
+   opt->log(msg);
+}
+
+// Define function to format the PSNR of each channel (e.g., "20.1/21.3").
+static void format_PSNR(char* msg, const double* E, unsigned int C){
+   int len = 0;
+   for(unsigned int c=0; c<C && len<900; c++)
+      len += sprintf(msg+len, (c > 0) ? "/%4.1f" : "%4.1f", E[c]);
+}
+
+// Define function to format status messages (if output is enabled).
+static void lf_nmf_printf(const NMFOptions* opt, const char* format, ...){
+   if(opt->print == NULL)
+      return;
+   char msg[1024];
+   va_list args;
+   va_start(args, format);
+   vsnprintf(msg, sizeof(msg), format, args);
+   va_end(args);
+   opt->print(msg);
+}
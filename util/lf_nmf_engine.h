@@ -0,0 +1,267 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_ENGINE
+//    Factorizes 4D light fields for display on dual-stacked LCDs using
+//    NMF for a frustrum of rays nearly perpendicular to the display.
+//    Implements the weighted multiplicative update rule independently of
+//    Matlab, so that it can be shared by the MEX gateway and the
+//    command-line front end.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_ENGINE_H
+#define LF_NMF_ENGINE_H
+
+// Define included files.
+#include "lf_nmf_plan.h"
+
+// Declare thread pool (see LF_NMF_THREADS).
+class NMFThreadPool;
+
+// Define PSNR evaluation modes.
+// Note: "Full" evaluates every ray in a separate pass, "fused" accumulates
+//       the error during the rear mask update (which refreshes every ray),
+//       and "sampled" estimates the error from a fixed random subset of rays.
+enum {
+   LF_NMF_PSNR_FULL    = 0,
+   LF_NMF_PSNR_FUSED   = 1,
+   LF_NMF_PSNR_SAMPLED = 2
+};
+
+// Define update rules (see LF_NMF_RULES).
+// Note: "MU" is the multiplicative update rule (clamped to one), "HALS" is
+//       hierarchical alternating least squares (clamped to [0,1]), and "AMU"
+//       repeats the multiplicative update for each visit of the rays.
+enum {
+   LF_NMF_RULE_MU   = 0,
+   LF_NMF_RULE_HALS = 1,
+   LF_NMF_RULE_AMU  = 2
+};
+
+// Define update schedules.
+// Note: "Jacobi" updates every front mask pixel, and then every rear mask
+//       pixel (i.e., each half-step only sees the other mask of the previous
+//       half-step). "Gauss-Seidel" updates bands of mask rows in place, one
+//       band at a time, applying both half-steps to each band (i.e., the
+//       front masks of a band see the rear masks already updated in its
+//       neighbors). Bands are colored (even bands first, then odd bands) so
+//       that bands of one color are updated in parallel, and the bands only
+//       depend on the geometry (i.e., not on the number of threads). On the
+//       blocks light field (rank 9), Gauss-Seidel reaches 28 dB in 41 sweeps
+//       instead of 43, but each sweep reconstructs the halos of the bands
+//       again (i.e., ~15% more time per sweep). The out-of-core solver (see
+//       LF_NMF_OOC) always uses the Jacobi schedule.
+enum {
+   LF_NMF_SCHEDULE_JACOBI       = 0,
+   LF_NMF_SCHEDULE_GAUSS_SEIDEL = 1
+};
+
+// Define element types of quantized light fields (see NMFQuantized).
+enum {
+   LF_NMF_QUANT_UINT8  = 0,
+   LF_NMF_QUANT_UINT16 = 1,
+   LF_NMF_QUANT_HALF   = 2
+};
+
+// Declare structure for storing a quantized light field.
+// Note: Elements are stored as 8-bit or 16-bit codes (e.g., the pixels of
+//       the input images, or IEEE half-precision values), in the same order
+//       as a light field of doubles. Each code is normalized to [0,1] (except
+//       half-precision values), raised to "gamma" (e.g., to linearize pixels
+//       stored with gamma compression), and scaled by "gain", through a
+//       lookup table applied when the light field is loaded into the solver.
+//       Elements that map to zero are set to "epsilon" instead (e.g., 1e-9).
+typedef struct {
+   unsigned int  type;          // element type (e.g., LF_NMF_QUANT_UINT8)
+   const void*   data;          // elements (uint8, uint16, or half-precision codes)
+   double        gamma;         // exponent applied to each normalized code
+   double        gain;          // factor applied after the exponent
+   double        epsilon;       // value of elements that map to zero
+} NMFQuantized;
+
+// Declare structure for storing factorization options.
+// Note: Besides the minimum PSNR, each channel stops once the relative
+//       change of its objective (i.e., the mean squared error of the rays)
+//       between evaluations falls below "tol_objective", once the relative
+//       change of its mask pairs in one iteration falls below "tol_factor",
+//       or once its objective has not improved (by more than tol_objective)
+//       for "plateau" iterations. With "levels" > 1, the light field is first
+//       factorized at coarser resolutions (see lf_nmf_2d_Euclidean), using
+//       "level_iter" iterations at each coarser level. If "gram" is set, the
+//       denominators of the update rule (or the normal equations of HALS and
+//       AMU) are evaluated from the Gram matrices of each window, which are
+//       accumulated as separable window sums (see LF_NMF_RULES). If "fix_H"
+//       is set (and the numbers of views are odd), the normal equations of
+//       the rear masks are evaluated once instead (for the multiplicative
+//       update rule, only if 2*R is less than the number of views), and the
+//       PSNR is evaluated from them in fused mode. The Gauss-Seidel schedule
+//       is not used if the front masks are fixed, and it evaluates the PSNR
+//       in full mode instead of fused mode. The sparse kernels give the same
+//       result as the dense kernels (see "sparse_density" and init_sparse).
+//       If enabled, the telemetry
+//       output receives one comma-separated line per iteration and channel
+//       (after a header line), with the objective, PSNR, relative changes,
+//       number of mask elements clamped to one or reset from NaN, and step
+//       time (s).
+typedef struct {
+   unsigned long niter;         // number of iterations
+   bool          fix_H;         // flag to disable front mask update
+   double        min_PSNR;      // minimum PSNR (stop if exceeded)
+   bool          evaluate_PSNR; // flag to evaluate PSNR at each iteration
+   unsigned int  PSNR_mode;     // PSNR evaluation mode (e.g., LF_NMF_PSNR_FULL)
+   unsigned long PSNR_interval; // number of iterations between PSNR evaluations
+   unsigned long PSNR_samples;  // number of rays sampled (per channel)
+   double        tol_objective; // minimum relative objective change (0 to disable)
+   double        tol_factor;    // minimum relative mask change (0 to disable)
+   unsigned long plateau;       // maximum iterations without improvement (0 to disable)
+   unsigned int  levels;        // number of resolution levels (1: full resolution only)
+   unsigned long level_iter;    // number of iterations at each coarser level
+   unsigned int  rule;          // update rule (e.g., LF_NMF_RULE_MU)
+   unsigned int  inner_iter;    // number of inner passes (HALS and AMU only)
+   bool          gram;          // flag to evaluate denominators from window Gram matrices
+   double        sparse_density; // maximum nonzero pixel fraction of sparse kernels (0 to disable)
+   unsigned int  schedule;      // update schedule (e.g., LF_NMF_SCHEDULE_JACOBI)
+   unsigned int  nthreads;      // number of threads (0: all hardware threads)
+   void        (*print)(const char*); // status output (NULL to disable)
+   void        (*log)(const char*);   // telemetry output (NULL to disable)
+} NMFOptions;
+
+// Initialize factorization options to their default values.
+void lf_nmf_default_options(NMFOptions* opt);
+
+// Initialize options for warm-started frames (see lf_nmf_2d_Euclidean_video).
+// Note: Copies "opt", with a quarter of the iterations and (unless already
+//       enabled) a relative objective change of 1e-3 as the stopping rule.
+void lf_nmf_warm_options(const NMFOptions* opt, NMFOptions* opt_warm);
+
+// Apply the weighted multiplicative update rule.
+// Note: The light field "lf" has dimensions lf_dim = [v u b a], stored in
+//       column-major order. The rear masks W (N x R) and front masks H
+//       (R x N) are stored in column-major order, with N = lf_dim[0]*lf_dim[1],
+//       and are updated in place. If PSNR evaluation is enabled, then "E"
+//       must hold "niter" elements (NaN for iterations that are skipped by
+//       the evaluation interval). Returns the number of iterations applied.
+//       If several resolution levels are requested, each coarser level halves
+//       the spatial resolution along the axes with a single view (so at least
+//       one axis must have a single view, e.g., for horizontal-only parallax),
+//       and its masks are replicated to initialize the next finer level, so
+//       that only a few iterations are needed at full resolution.
+unsigned long lf_nmf_2d_Euclidean(
+        const double* lf, const unsigned int* lf_dim,
+        double* W, double* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+
+// Apply the weighted multiplicative update rule (in single precision).
+// Note: Halves the memory traffic and doubles the SIMD width of the update
+//       rules (see LF_NMF_SIMD). The PSNR is evaluated in double precision.
+unsigned long lf_nmf_2d_Euclidean(
+        const float* lf, const unsigned int* lf_dim,
+        float* W, float* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+
+// Apply the weighted multiplicative update rule (using a precomputed plan).
+// Note: The plan (see LF_NMF_PLAN) must be created for the light field
+//       dimensions, and can be reused for each color channel or frame.
+unsigned long lf_nmf_2d_Euclidean_plan(
+        const NMFPlan* plan, const double* lf,
+        double* W, double* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+unsigned long lf_nmf_2d_Euclidean_plan(
+        const NMFPlan* plan, const float* lf,
+        float* W, float* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+
+// Apply the weighted multiplicative update rule to C color channels jointly.
+// Note: The light field "lf" has dimensions [v u b a C] (i.e., one 4D light
+//       field per channel), the rear masks W are N x R x C and the front
+//       masks H are R x N x C. The channels remain independent, but share
+//       one sweep over the neighborhood geometry. If PSNR evaluation is
+//       enabled, then "E" must hold niter x C elements; each channel stops
+//       once its PSNR exceeds the minimum.
+unsigned long lf_nmf_2d_Euclidean_channels(
+        const NMFPlan* plan, const double* lf, unsigned int C,
+        double* W, double* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+unsigned long lf_nmf_2d_Euclidean_channels(
+        const NMFPlan* plan, const float* lf, unsigned int C,
+        float* W, float* H, unsigned long R,
+        const NMFOptions* opt, double* E);
+
+// Apply the weighted multiplicative update rule to a light field sequence.
+// Note: The light field "lf" has dimensions [v u b a C F] (e.g., F video
+//       frames), the rear masks W are N x R x C x F and the front masks H
+//       are R x N x C x F, where the masks of the first frame are also the
+//       initial masks. Each later frame is initialized with the result for
+//       the previous frame (i.e., warm-started), and is factorized using
+//       "opt_warm" instead of "opt". If PSNR evaluation is enabled, then "E"
+//       must hold niter x C x F elements, where niter is the larger of the
+//       two iteration counts (NaN beyond the iterations of each frame).
+//       Reports the throughput (in frames per minute). Returns the total
+//       number of iterations applied.
+unsigned long lf_nmf_2d_Euclidean_video(
+        const NMFPlan* plan, const double* lf, unsigned int C, unsigned int F,
+        double* W, double* H, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E);
+unsigned long lf_nmf_2d_Euclidean_video(
+        const NMFPlan* plan, const float* lf, unsigned int C, unsigned int F,
+        float* W, float* H, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E);
+
+// Apply the weighted multiplicative update rule to a quantized light field.
+// Note: The light field has dimensions [v u b a C F], as for
+//       lf_nmf_2d_Euclidean_video (or lf_nmf_2d_Euclidean_channels, if F is
+//       one, in which case "opt_warm" is not used), but its elements are
+//       quantized (see NMFQuantized). Only the solver's copy of the light
+//       field is stored at full precision (i.e., of the same type as the
+//       masks), so the caller never holds a floating-point light field.
+unsigned long lf_nmf_2d_Euclidean_quantized(
+        const NMFPlan* plan, const NMFQuantized* lf, unsigned int C, unsigned int F,
+        double* W, double* H, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E);
+unsigned long lf_nmf_2d_Euclidean_quantized(
+        const NMFPlan* plan, const NMFQuantized* lf, unsigned int C, unsigned int F,
+        float* W, float* H, unsigned long R,
+        const NMFOptions* opt, const NMFOptions* opt_warm, double* E);
+
+// Evaluate the lookup table of a quantized light field (one entry per code).
+// Note: "lut" holds 256 entries for 8-bit codes, or 65536 otherwise.
+void lf_nmf_quantized_lut(const NMFQuantized* lf, double* lut);
+void lf_nmf_quantized_lut(const NMFQuantized* lf, float* lut);
+
+// Define half-steps of the update rule (see lf_nmf_2d_Euclidean_band).
+enum {
+   LF_NMF_STEP_H        = 0,
+   LF_NMF_STEP_W        = 1,
+   LF_NMF_STEP_EVALUATE = 2
+};
+
+// Apply one half-step of the update rule to a band of mask rows.
+// Note: Used by the out-of-core solver (see LF_NMF_OOC). The plan describes
+//       the band (i.e., a light field with the band's rows, including a halo
+//       of nHalfAngles[0] rows on either side, unless at the display border),
+//       and only rows row0..row1-1 of the band are updated. Unlike the other
+//       routines, the light field is stored as angular bundles (see
+//       LF_NMF_PLAN), with the C channels of each ray interleaved, and the
+//       masks are stored in pixel-major order (i.e., the C*R elements of each
+//       pixel, for pixels in row-major order). Step LF_NMF_STEP_H updates the
+//       front masks, LF_NMF_STEP_W updates the rear masks, and
+//       LF_NMF_STEP_EVALUATE leaves both unchanged. The update rule is taken
+//       from "opt", and the tiles of the band are distributed over the
+//       threads of "pool" (created once by the caller, and reused for every
+//       band and half-step). Unless NULL, "frozen" flags channels that are
+//       not updated, and the squared error of the rays leaving rear mask rows
+//       row0..row1-1 after the step (except for LF_NMF_STEP_H) is added to
+//       "SSE" (one element per channel) row by row, as the full PSNR mode
+//       sums it (i.e., summing consecutive bands yields the in-core value).
+unsigned long lf_nmf_2d_Euclidean_band(
+        const NMFPlan* plan, const double* lf, unsigned int C,
+        double* W, double* H, unsigned long R,
+        unsigned int row0, unsigned int row1, unsigned int step,
+        const char* frozen, const NMFOptions* opt, NMFThreadPool* pool, double* SSE);
+unsigned long lf_nmf_2d_Euclidean_band(
+        const NMFPlan* plan, const float* lf, unsigned int C,
+        float* W, float* H, unsigned long R,
+        unsigned int row0, unsigned int row1, unsigned int step,
+        const char* frozen, const NMFOptions* opt, NMFThreadPool* pool, double* SSE);
+
+#endif
@@ -0,0 +1,270 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_EVAL
+//    Reconstructs and evaluates light field factorizations (see
+//    lf_nmf_eval.h).
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <math.h>
+#include <cstring>
+#include <vector>
+#include "lf_nmf_eval.h"
+#include "lf_nmf_threads.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Define resolution of the brightness gain histogram.
+// Note: Ratios are binned by their binary exponent and the leading bits of
+//       their mantissa (i.e., bins are narrower than one percent), from
+//       2^-NMF_EVAL_MAX_EXP to 2^NMF_EVAL_MAX_EXP. The first bin counts
+//       smaller ratios (e.g., zero), and the last bin larger ones.
+#define NMF_EVAL_MANTISSA_BITS 7
+#define NMF_EVAL_MAX_EXP       32
+#define NMF_EVAL_BINS          ((2*NMF_EVAL_MAX_EXP << NMF_EVAL_MANTISSA_BITS)+2)
+
+// Declare structure for storing the state shared by the view evaluators.
+// Note: Pair index 0 is the reference, and 1 the factorization (if any).
+//       The front masks are transposed to N x R x C (i.e., one contiguous
+//       mask per pair), so that the views are reconstructed row by row.
+//       Each block (i.e., one view and channel) accumulates its own squared
+//       error, maximum, and histogram (of at most N ratios), which are
+//       reduced in block order.
+template<typename T>
+struct NMFEval {
+   const unsigned int*        lf_dim;
+   unsigned int               C;
+   const T*                   W[2];
+   const T*                   H[2];
+   unsigned long              R[2];
+   std::vector<T>             Ht[2];
+   T*                         lf[2];
+   unsigned int               npairs;
+   const NMFEvalOptions*      opt;
+   std::vector<double>        error;
+   std::vector<double>        peak;
+   std::vector<unsigned int>  hist;
+};
+
+// Declare auxiliary functions.
+template<typename T> static void evaluate(const unsigned int*, unsigned int,
+   const T*, const T*, unsigned long, const T*, const T*, unsigned long,
+   const NMFEvalOptions*, T*, T*, NMFEvalResult*, double*);
+template<typename T> static void transpose_block(void*, unsigned int);
+template<typename T> static void evaluate_block(void*, unsigned int);
+static inline unsigned int ratio_bin(double);
+static double ratio_quantile(const unsigned long*, double);
+
+// Initialize evaluation options to their default values.
+void lf_nmf_default_eval_options(NMFEvalOptions* opt){
+   opt->gain     = 1.0;
+   opt->quantile = 0.5;
+   opt->nthreads = 0;
+}
+
+// Reconstruct and evaluate a factorization (for each mask type).
+void lf_nmf_evaluate(const unsigned int* lf_dim, unsigned int C,
+                     const double* W_ref, const double* H_ref, unsigned long R_ref,
+                     const double* W, const double* H, unsigned long R,
+                     const NMFEvalOptions* opt, double* lf_ref, double* lf,
+                     NMFEvalResult* result, double* view_PSNR){
+   evaluate(lf_dim, C, W_ref, H_ref, R_ref, W, H, R, opt, lf_ref, lf, result, view_PSNR);
+}
+void lf_nmf_evaluate(const unsigned int* lf_dim, unsigned int C,
+                     const float* W_ref, const float* H_ref, unsigned long R_ref,
+                     const float* W, const float* H, unsigned long R,
+                     const NMFEvalOptions* opt, float* lf_ref, float* lf,
+                     NMFEvalResult* result, double* view_PSNR){
+   evaluate(lf_dim, C, W_ref, H_ref, R_ref, W, H, R, opt, lf_ref, lf, result, view_PSNR);
+}
+
+// Reconstruct and evaluate a factorization against a reference.
+// Note: The squared errors are reduced in block order, so the results do
+//       not depend on the number of threads.
+template<typename T>
+static void evaluate(const unsigned int* lf_dim, unsigned int C,
+                     const T* W_ref, const T* H_ref, unsigned long R_ref,
+                     const T* W, const T* H, unsigned long R,
+                     const NMFEvalOptions* opt, T* lf_ref, T* lf,
+                     NMFEvalResult* result, double* view_PSNR){
+   NMFEval<T> eval;
+   eval.lf_dim = lf_dim;
+   eval.C      = C;
+   eval.W[0]   = W_ref;
+   eval.H[0]   = H_ref;
+   eval.R[0]   = R_ref;
+   eval.lf[0]  = lf_ref;
+   eval.W[1]   = W;
+   eval.H[1]   = H;
+   eval.R[1]   = (W != NULL && H != NULL) ? R : 0;
+   eval.lf[1]  = lf;
+   eval.npairs = (eval.R[1] > 0) ? 2 : 1;
+   eval.opt    = opt;
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned int nviews = lf_dim[2]*lf_dim[3];
+   unsigned int nblocks = nviews*C;
+   eval.error.assign(nblocks, 0);
+   eval.peak.assign(nblocks, 0);
+   if(eval.npairs > 1)
+      eval.hist.assign((unsigned long)nblocks*NMF_EVAL_BINS, 0);
+   for(unsigned int pair=0; pair<eval.npairs; pair++)
+      eval.Ht[pair].resize(N*eval.R[pair]*C);
+
+   // Transpose the front masks, and reconstruct each view and channel.
+   unsigned int nthreads = (opt->nthreads > 0) ? opt->nthreads : lf_nmf_default_threads();
+   NMFThreadPool pool(MIN(nthreads, nblocks));
+   pool.run(transpose_block<T>, &eval, (unsigned int)((eval.R[0]+eval.R[1])*C));
+   pool.run(evaluate_block<T>, &eval, nblocks);
+   if(eval.npairs == 1)
+      return;
+
+   // Reduce the errors, maxima, and histograms of the blocks.
+   std::vector<unsigned long> hist(NMF_EVAL_BINS, 0);
+   double error = 0, peak = 0;
+   for(unsigned int block=0; block<nblocks; block++){
+      error += eval.error[block];
+      peak = MAX(peak, eval.peak[block]);
+      const unsigned int* hist_block = &eval.hist[(unsigned long)block*NMF_EVAL_BINS];
+      for(unsigned int bin=0; bin<NMF_EVAL_BINS; bin++)
+         hist[bin] += hist_block[bin];
+   }
+   peak *= opt->gain;
+   result->peak       = peak;
+   result->MSE        = error/((double)N*nviews*C);
+   result->PSNR       = 10*log10(peak*peak/result->MSE);
+   result->brightness = ratio_quantile(&hist[0], opt->quantile);
+   if(view_PSNR != NULL){
+      for(unsigned int view=0; view<nviews; view++){
+         double view_error = 0;
+         for(unsigned int ch=0; ch<C; ch++)
+            view_error += eval.error[ch*nviews+view];
+         view_PSNR[view] = 10*log10(peak*peak*N*C/view_error);
+      }
+   }
+}
+
+// Transpose one front mask (for one channel) to a contiguous N-vector.
+template<typename T>
+static void transpose_block(void* ctx, unsigned int block){
+   NMFEval<T>* eval = (NMFEval<T>*)ctx;
+   unsigned long N = (unsigned long)eval->lf_dim[0]*eval->lf_dim[1];
+   unsigned int pair = (block < eval->R[0]*eval->C) ? 0 : 1;
+   if(pair == 1)
+      block -= eval->R[0]*eval->C;
+   unsigned long R = eval->R[pair];
+   unsigned long k  = block%R;
+   unsigned long ch = block/R;
+   const T* H_k = eval->H[pair]+ch*R*N+k;
+   T* Ht_k = &eval->Ht[pair][ch*N*R+k*N];
+   for(unsigned long p=0; p<N; p++)
+      Ht_k[p] = H_k[p*R];
+}
+
+// Reconstruct one view (for one channel), and accumulate its error.
+// Note: View (bIdx,aIdx) sees each rear mask pixel (y,x) through front mask
+//       pixel (y+bIdx-(b+1)/2,x+aIdx-(a+1)/2) (i.e., zero beyond the mask
+//       border, as ZEROSHIFT). Each row is accumulated over the pairs in a
+//       contiguous buffer, so that the inner loop is vectorized.
+template<typename T>
+static void evaluate_block(void* ctx, unsigned int block){
+   NMFEval<T>* eval = (NMFEval<T>*)ctx;
+   const unsigned int* lf_dim = eval->lf_dim;
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned int nviews = lf_dim[2]*lf_dim[3];
+   unsigned int view = block%nviews;
+   unsigned int ch   = block/nviews;
+   int bShift = (int)(view%lf_dim[2])-(int)(lf_dim[2]-1)/2;
+   int aShift = (int)(view/lf_dim[2])-(int)(lf_dim[3]-1)/2;
+   int x0 = MAX(-aShift, 0);
+   int x1 = MIN((int)lf_dim[1]-aShift, (int)lf_dim[1]);
+   std::vector<T> rec[2];
+   double error = 0, peak = 0;
+   unsigned int* hist = (eval->npairs > 1) ? &eval->hist[(unsigned long)block*NMF_EVAL_BINS] : NULL;
+   for(unsigned int pair=0; pair<eval->npairs; pair++)
+      rec[pair].resize(lf_dim[1]);
+   for(unsigned int y=0; y<lf_dim[0]; y++){
+
+      // Reconstruct the row (of the reference and the factorization).
+      int ys = (int)y+bShift;
+      for(unsigned int pair=0; pair<eval->npairs; pair++){
+         T* rec_y = &rec[pair][0];
+         memset(rec_y, 0, sizeof(T)*lf_dim[1]);
+         if(ys < 0 || ys >= (int)lf_dim[0] || x0 >= x1)
+            continue;
+         unsigned long R = eval->R[pair];
+         const T* W_c  = eval->W[pair]+ch*N*R+(unsigned long)y*lf_dim[1];
+         const T* Ht_c = &eval->Ht[pair][ch*N*R+(unsigned long)ys*lf_dim[1]];
+         for(unsigned long k=0; k<R; k++){
+            const T* W_k  = W_c+k*N;
+            const T* Ht_k = Ht_c+k*N;
+            for(int x=x0; x<x1; x++)
+               rec_y[x] += W_k[x]*Ht_k[x+aShift];
+         }
+      }
+
+      // Store the row, and accumulate its error (and brightness ratios).
+      unsigned long offset = y+(unsigned long)view*N+(unsigned long)ch*N*nviews;
+      for(unsigned int pair=0; pair<eval->npairs; pair++){
+         T* lf_y = eval->lf[pair];
+         if(lf_y == NULL)
+            continue;
+         for(unsigned int x=0; x<lf_dim[1]; x++)
+            lf_y[offset+(unsigned long)x*lf_dim[0]] = rec[pair][x];
+      }
+      if(eval->npairs == 1)
+         continue;
+      double gain = eval->opt->gain;
+      for(unsigned int x=0; x<lf_dim[1]; x++){
+         double ref = rec[0][x], value = rec[1][x];
+         double diff = gain*ref-value;
+         error += diff*diff;
+         peak = MAX(peak, ref);
+         if(ref > 0)
+            hist[ratio_bin(value/ref)]++;
+      }
+   }
+   eval->error[block] = error;
+   eval->peak[block]  = peak;
+}
+
+// Return the histogram bin of a brightness ratio.
+static inline unsigned int ratio_bin(double ratio){
+   if(!(ratio >= ldexp(1.0, -NMF_EVAL_MAX_EXP)))
+      return 0;
+   if(ratio >= ldexp(1.0, NMF_EVAL_MAX_EXP))
+      return NMF_EVAL_BINS-1;
+   unsigned long long bits;
+   memcpy(&bits, &ratio, sizeof(bits));
+   int exponent = (int)((bits >> 52) & 0x7FF)-1023+NMF_EVAL_MAX_EXP;
+   unsigned int mantissa = (unsigned int)(bits >> (52-NMF_EVAL_MANTISSA_BITS)) &
+                           ((1 << NMF_EVAL_MANTISSA_BITS)-1);
+   return 1+((unsigned int)exponent << NMF_EVAL_MANTISSA_BITS)+mantissa;
+}
+
+// Return a quantile of the brightness ratios (from their histogram).
+// Note: The ratios are assumed to be spread uniformly within each bin.
+static double ratio_quantile(const unsigned long* hist, double quantile){
+   unsigned long count = 0;
+   for(unsigned int bin=0; bin<NMF_EVAL_BINS; bin++)
+      count += hist[bin];
+   if(count == 0)
+      return NAN;
+   double rank = MIN(MAX(quantile, 0.0), 1.0)*(count-1)+0.5;
+   unsigned long cumulative = 0;
+   unsigned int bin = 0;
+   while(bin < NMF_EVAL_BINS-1 && cumulative+hist[bin] < rank)
+      cumulative += hist[bin++];
+   if(bin == 0)
+      return 0;
+   if(bin == NMF_EVAL_BINS-1)
+      return ldexp(1.0, NMF_EVAL_MAX_EXP);
+   unsigned int index    = bin-1;
+   int exponent          = (int)(index >> NMF_EVAL_MANTISSA_BITS)-NMF_EVAL_MAX_EXP;
+   unsigned int mantissa = index & ((1 << NMF_EVAL_MANTISSA_BITS)-1);
+   double lower = ldexp(1.0+(double)mantissa/(1 << NMF_EVAL_MANTISSA_BITS), exponent);
+   double width = ldexp(1.0/(1 << NMF_EVAL_MANTISSA_BITS), exponent);
+   return lower+width*(rank-cumulative)/hist[bin];
+}
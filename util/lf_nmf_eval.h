@@ -0,0 +1,62 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_EVAL
+//    Reconstructs the views of a light field from mask pairs (i.e., for
+//    each view, the sum over the pairs of the rear mask times the front
+//    mask shifted by the view's offset, as done by generate_masks.m), and
+//    evaluates a factorization against a reference (e.g., the pinhole
+//    array mask pairs). Both are reconstructed in a single parallel pass,
+//    which also measures the PSNR (overall and for each view) and the
+//    brightness gain of the factorization over the reference.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_EVAL_H
+#define LF_NMF_EVAL_H
+
+// Declare structure for storing evaluation options.
+// Note: The factorization is compared against the reference scaled by
+//       "gain" (i.e., the light field amplification factor of the NMF).
+//       The brightness gain is the "quantile" of the ratios between the
+//       reconstructions (e.g., 0.5 for the median), over the rays whose
+//       reference is nonzero. It is estimated from a histogram of the
+//       ratios (with a resolution below one percent), rather than sorted.
+typedef struct {
+   double        gain;          // light field amplification factor of the factorization
+   double        quantile;      // quantile of the brightness gain (e.g., 0.5 for the median)
+   unsigned int  nthreads;      // number of threads (0: all hardware threads)
+} NMFEvalOptions;
+
+// Declare structure for storing evaluation results.
+typedef struct {
+   double        peak;          // maximum of the reference reconstruction (scaled by the gain)
+   double        MSE;           // mean squared error of the factorization
+   double        PSNR;          // peak signal-to-noise ratio of the factorization (dB)
+   double        brightness;    // brightness gain (see NMFEvalOptions)
+} NMFEvalResult;
+
+// Initialize evaluation options to their default values.
+void lf_nmf_default_eval_options(NMFEvalOptions* opt);
+
+// Reconstruct and evaluate a factorization against a reference.
+// Note: The light field has dimensions lf_dim = [v u b a] and C channels.
+//       The mask pairs are stored as for the solver (i.e., the rear masks
+//       have dimensions N x R x C, and the front masks R x N x C), with
+//       R_ref reference pairs and R pairs for the factorization. Without a
+//       factorization (i.e., "W" and "H" are NULL), only the reference is
+//       reconstructed, and "result" and "view_PSNR" are not written. Unless
+//       NULL, "lf_ref" and "lf" receive the reconstructions (with dimensions
+//       [v u b a C], stored in column-major order), and "view_PSNR" receives
+//       the PSNR of each view (with dimensions [b a]).
+void lf_nmf_evaluate(const unsigned int* lf_dim, unsigned int C,
+                     const double* W_ref, const double* H_ref, unsigned long R_ref,
+                     const double* W, const double* H, unsigned long R,
+                     const NMFEvalOptions* opt, double* lf_ref, double* lf,
+                     NMFEvalResult* result, double* view_PSNR);
+void lf_nmf_evaluate(const unsigned int* lf_dim, unsigned int C,
+                     const float* W_ref, const float* H_ref, unsigned long R_ref,
+                     const float* W, const float* H, unsigned long R,
+                     const NMFEvalOptions* opt, float* lf_ref, float* lf,
+                     NMFEvalResult* result, double* view_PSNR);
+
+#endif
@@ -0,0 +1,144 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_EVALUATE_MEX
+//    Reconstructs a light field from the pinhole array mask pairs and
+//    from the NMF mask pairs, and evaluates the NMF reconstruction (see
+//    LF_NMF_EVAL). Replaces the reconstruction loops of generate_masks.m.
+//
+//    [LFpinhole,LFnmf,PSNR,viewPSNR,gain] = ...
+//       lf_nmf_evaluate_mex(dim,Wpinhole,Hpinhole,Wnmf,Hnmf,nmfGain,quantile,numThreads)
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <stdio.h>
+#include "mex.h"
+#include "lf_nmf_eval.h"
+
+// Define pointers to input/output arguments.
+#define DIM_IN       prhs[0] // (input) light field dimensions [v u b a] or [v u b a ch]
+#define W_REF_IN     prhs[1] // (input) pinhole array rear masks (N x R x ch)
+#define H_REF_IN     prhs[2] // (input) pinhole array front masks (R x N x ch)
+#define W_IN         prhs[3] // (input) NMF rear masks (N x R x ch, or empty)
+#define H_IN         prhs[4] // (input) NMF front masks (R x N x ch, or empty)
+#define GAIN_IN      prhs[5] // (input) light field amplification factor of the NMF
+#define QUANTILE_IN  prhs[6] // (input) quantile of the brightness gain (e.g., 0.5 for the median)
+#define THREADS_IN   prhs[7] // (input) number of threads (0: all hardware threads)
+#define LF_REF_OUT   plhs[0] // (output) pinhole array reconstruction
+#define LF_OUT       plhs[1] // (output) NMF reconstruction
+#define PSNR_OUT     plhs[2] // (output) PSNR of the NMF reconstruction (dB)
+#define VIEW_OUT     plhs[3] // (output) PSNR of each view [b a] (dB)
+#define BRIGHT_OUT   plhs[4] // (output) brightness gain of the NMF reconstruction
+
+// Verify that a mask array matches the light field (and the other masks).
+static mwSize check_masks(const mxArray* A, mwSize N, unsigned int C,
+                          bool rear, mxClassID mask_class, const char* name){
+   char msg[256];
+   const mwSize* dim = mxGetDimensions(A);
+   mwSize R = mxGetNumberOfElements(A)/(N*C);
+   if(mxGetClassID(A) != mask_class || mxIsComplex(A)){
+      snprintf(msg, sizeof(msg), "%s must be real, and of the same class as the pinhole masks.", name);
+      mexErrMsgTxt(msg);
+   }
+   if(dim[rear ? 0 : 1] != N || R == 0 || mxGetNumberOfElements(A) != N*R*C){
+      snprintf(msg, sizeof(msg), "%s must have dimensions %s x %u.", name,
+               rear ? "N x R" : "R x N", C);
+      mexErrMsgTxt(msg);
+   }
+   return R;
+}
+
+// Define MEX-file gateway routine.
+void mexFunction(
+    int nlhs, mxArray* plhs[],
+    int nrhs, const mxArray* prhs[]){
+
+   // Verify input arguments.
+   if(nrhs < 5 || nrhs > 8)
+      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected five to eight).");
+   if(nlhs > 5)
+      mexErrMsgTxt("Too many output arguments.");
+   if(!mxIsDouble(DIM_IN) || (mxGetNumberOfElements(DIM_IN) != 4 && mxGetNumberOfElements(DIM_IN) != 5))
+      mexErrMsgTxt("Light field dimensions must be a double vector with four or five elements.");
+   unsigned int lf_dim[4];
+   for(int i=0; i<4; i++)
+      lf_dim[i] = (unsigned int)mxGetPr(DIM_IN)[i];
+   unsigned int C = (mxGetNumberOfElements(DIM_IN) == 5) ? (unsigned int)mxGetPr(DIM_IN)[4] : 1;
+   mwSize N = (mwSize)lf_dim[0]*lf_dim[1];
+   if(N == 0 || C == 0 || lf_dim[2]%2 == 0 || lf_dim[3]%2 == 0)
+      mexErrMsgTxt("Light field must be nonempty, with an odd angular resolution.");
+   mxClassID mask_class = mxGetClassID(W_REF_IN);
+   if(mask_class != mxDOUBLE_CLASS && mask_class != mxSINGLE_CLASS)
+      mexErrMsgTxt("Pinhole masks must be double or single.");
+   mwSize R_ref = check_masks(W_REF_IN, N, C, true, mask_class, "Pinhole rear masks");
+   if(check_masks(H_REF_IN, N, C, false, mask_class, "Pinhole front masks") != R_ref)
+      mexErrMsgTxt("Pinhole masks must have the same number of pairs.");
+   bool has_nmf = !mxIsEmpty(W_IN) || !mxIsEmpty(H_IN);
+   mwSize R = 0;
+   if(has_nmf){
+      R = check_masks(W_IN, N, C, true, mask_class, "NMF rear masks");
+      if(check_masks(H_IN, N, C, false, mask_class, "NMF front masks") != R)
+         mexErrMsgTxt("NMF masks must have the same number of pairs.");
+   }
+   NMFEvalOptions opt;
+   lf_nmf_default_eval_options(&opt);
+   if(nrhs >= 6){
+      if(!mxIsDouble(GAIN_IN) || mxGetNumberOfElements(GAIN_IN) != 1)
+         mexErrMsgTxt("Light field gain must be a double scalar.");
+      opt.gain = mxGetScalar(GAIN_IN);
+   }
+   if(nrhs >= 7){
+      if(!mxIsDouble(QUANTILE_IN) || mxGetNumberOfElements(QUANTILE_IN) != 1)
+         mexErrMsgTxt("Quantile must be a double scalar.");
+      opt.quantile = mxGetScalar(QUANTILE_IN);
+   }
+   if(nrhs == 8){
+      if(!mxIsNumeric(THREADS_IN) || mxGetNumberOfElements(THREADS_IN) != 1)
+         mexErrMsgTxt("Number of threads must be a numerical scalar.");
+      opt.nthreads = (unsigned int)mxGetScalar(THREADS_IN);
+   }
+
+   // Allocate the reconstructions (only if requested) and the measurements.
+   // Note: Without NMF masks, the NMF outputs are empty (or not-a-number).
+   mwSize lf_size[5] = {lf_dim[0], lf_dim[1], lf_dim[2], lf_dim[3], C};
+   mwSize view_size[2] = {lf_dim[2], lf_dim[3]};
+   mwSize empty_size[2] = {0, 0};
+   mwSize lf_ndims = (C > 1) ? 5 : 4;
+   mxArray* lf_ref = mxCreateNumericArray((nlhs > 0) ? lf_ndims : 2,
+                                          (nlhs > 0) ? lf_size : empty_size, mask_class, mxREAL);
+   mxArray* lf = mxCreateNumericArray((nlhs > 1 && has_nmf) ? lf_ndims : 2,
+                                      (nlhs > 1 && has_nmf) ? lf_size : empty_size, mask_class, mxREAL);
+   mxArray* view_PSNR = mxCreateNumericArray(2, view_size, mxDOUBLE_CLASS, mxREAL);
+   NMFEvalResult result;
+   result.PSNR = result.brightness = mxGetNaN();
+   for(mwSize view=0; view<mxGetNumberOfElements(view_PSNR); view++)
+      mxGetPr(view_PSNR)[view] = mxGetNaN();
+
+   // Reconstruct and evaluate the light field.
+   if(mask_class == mxDOUBLE_CLASS)
+      lf_nmf_evaluate(lf_dim, C, mxGetPr(W_REF_IN), mxGetPr(H_REF_IN), R_ref,
+                      has_nmf ? mxGetPr(W_IN) : NULL, has_nmf ? mxGetPr(H_IN) : NULL, R,
+                      &opt, mxIsEmpty(lf_ref) ? NULL : mxGetPr(lf_ref),
+                      mxIsEmpty(lf) ? NULL : mxGetPr(lf), &result, mxGetPr(view_PSNR));
+   else
+      lf_nmf_evaluate(lf_dim, C, (const float*)mxGetData(W_REF_IN), (const float*)mxGetData(H_REF_IN), R_ref,
+                      has_nmf ? (const float*)mxGetData(W_IN) : NULL,
+                      has_nmf ? (const float*)mxGetData(H_IN) : NULL, R,
+                      &opt, mxIsEmpty(lf_ref) ? NULL : (float*)mxGetData(lf_ref),
+                      mxIsEmpty(lf) ? NULL : (float*)mxGetData(lf), &result, mxGetPr(view_PSNR));
+
+   // Return the reconstructions and measurements.
+   LF_REF_OUT = lf_ref;
+   if(nlhs > 1)
+      LF_OUT = lf;
+   else
+      mxDestroyArray(lf);
+   if(nlhs > 2)
+      PSNR_OUT = mxCreateDoubleScalar(result.PSNR);
+   if(nlhs > 3)
+      VIEW_OUT = view_PSNR;
+   else
+      mxDestroyArray(view_PSNR);
+   if(nlhs > 4)
+      BRIGHT_OUT = mxCreateDoubleScalar(result.brightness);
+}
@@ -0,0 +1,170 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_IO
+//    Reads and writes multi-dimensional arrays (e.g., light fields and
+//    mask pairs) exchanged between Matlab and the native NMF tools.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <cstring>
+#include "lf_nmf_io.h"
+
+// Define file signature.
+static const char LF_ARRAY_MAGIC[4] = {'L','F','A','1'};
+
+// Allocate array with the given dimensions (elements set to zero).
+void lf_alloc_array(LFArray* A, unsigned int ndims, const unsigned int* dim){
+   A->ndims = ndims;
+   A->numel = 1;
+   for(unsigned int k=0; k<ndims; k++){
+      A->dim[k] = dim[k];
+      A->numel *= dim[k];
+   }
+   A->data = new double[A->numel];
+   memset(A->data, 0, sizeof(double)*A->numel);
+}
+
+// Release array storage.
+void lf_free_array(LFArray* A){
+   delete[] A->data;
+   A->data  = NULL;
+   A->numel = 0;
+   A->ndims = 0;
+}
+
+// Read array from file (returns false on failure).
+bool lf_read_array(const char* filename, LFArray* A){
+
+   // Open file and verify signature.
+   FILE* fid = fopen(filename, "rb");
+   if(fid == NULL){
+      fprintf(stderr, "Cannot open %s\n", filename);
+      return false;
+   }
+   char magic[4];
+   unsigned int ndims = 0;
+   if(fread(magic, 1, 4, fid) != 4 || memcmp(magic, LF_ARRAY_MAGIC, 4) != 0 ||
+      fread(&ndims, sizeof(unsigned int), 1, fid) != 1 ||
+      ndims < 1 || ndims > LF_ARRAY_MAX_DIMS){
+      fprintf(stderr, "%s is not a valid array file\n", filename);
+      fclose(fid);
+      return false;
+   }
+
+   // Read dimensions and elements.
+   unsigned int dim[LF_ARRAY_MAX_DIMS];
+   if(fread(dim, sizeof(unsigned int), ndims, fid) != ndims){
+      fprintf(stderr, "%s is truncated\n", filename);
+      fclose(fid);
+      return false;
+   }
+   lf_alloc_array(A, ndims, dim);
+   if(fread(A->data, sizeof(double), A->numel, fid) != A->numel){
+      fprintf(stderr, "%s is truncated\n", filename);
+      lf_free_array(A);
+      fclose(fid);
+      return false;
+   }
+   fclose(fid);
+   return true;
+}
+
+// Write array to file (returns false on failure).
+bool lf_write_array(const char* filename, const LFArray* A){
+   FILE* fid = fopen(filename, "wb");
+   if(fid == NULL){
+      fprintf(stderr, "Cannot open %s\n", filename);
+      return false;
+   }
+   bool ok = fwrite(LF_ARRAY_MAGIC, 1, 4, fid) == 4 &&
+             fwrite(&A->ndims, sizeof(unsigned int), 1, fid) == 1 &&
+             fwrite(A->dim, sizeof(unsigned int), A->ndims, fid) == A->ndims &&
+             fwrite(A->data, sizeof(double), A->numel, fid) == A->numel;
+   fclose(fid);
+   if(!ok)
+      fprintf(stderr, "Cannot write %s\n", filename);
+   return ok;
+}
+
+// Open array file for reading its elements incrementally (returns NULL on failure).
+FILE* lf_open_array(const char* filename, LFArray* A){
+   FILE* fid = fopen(filename, "rb");
+   if(fid == NULL){
+      fprintf(stderr, "Cannot open %s\n", filename);
+      return NULL;
+   }
+   char magic[4];
+   unsigned int ndims = 0;
+   if(fread(magic, 1, 4, fid) != 4 || memcmp(magic, LF_ARRAY_MAGIC, 4) != 0 ||
+      fread(&ndims, sizeof(unsigned int), 1, fid) != 1 ||
+      ndims < 1 || ndims > LF_ARRAY_MAX_DIMS ||
+      fread(A->dim, sizeof(unsigned int), ndims, fid) != ndims){
+      fprintf(stderr, "%s is not a valid array file\n", filename);
+      fclose(fid);
+      return NULL;
+   }
+   A->ndims = ndims;
+   A->numel = 1;
+   for(unsigned int k=0; k<ndims; k++)
+      A->numel *= A->dim[k];
+   A->data = NULL;
+   return fid;
+}
+
+// Create array file for writing its elements incrementally (returns NULL on failure).
+FILE* lf_create_array(const char* filename, const LFArray* A){
+   FILE* fid = fopen(filename, "w+b");
+   if(fid == NULL){
+      fprintf(stderr, "Cannot open %s\n", filename);
+      return NULL;
+   }
+   if(fwrite(LF_ARRAY_MAGIC, 1, 4, fid) != 4 ||
+      fwrite(&A->ndims, sizeof(unsigned int), 1, fid) != 1 ||
+      fwrite(A->dim, sizeof(unsigned int), A->ndims, fid) != A->ndims){
+      fprintf(stderr, "Cannot write %s\n", filename);
+      fclose(fid);
+      return NULL;
+   }
+   return fid;
+}
+
+// Read "count" consecutive elements, starting at element "offset" (column-major).
+// Note: The elements follow the header (i.e., the signature, the number of
+//       dimensions, and the dimensions).
+bool lf_read_elements(FILE* fid, const LFArray* A, unsigned long offset,
+                      unsigned long count, double* data){
+   unsigned long long header = 4+sizeof(unsigned int)*(1+A->ndims);
+   return lf_seek_file(fid, header+sizeof(double)*(unsigned long long)offset) &&
+          fread(data, sizeof(double), count, fid) == count;
+}
+
+// Write "count" consecutive elements, starting at element "offset" (column-major).
+bool lf_write_elements(FILE* fid, const LFArray* A, unsigned long offset,
+                       unsigned long count, const double* data){
+   unsigned long long header = 4+sizeof(unsigned int)*(1+A->ndims);
+   return lf_seek_file(fid, header+sizeof(double)*(unsigned long long)offset) &&
+          fwrite(data, sizeof(double), count, fid) == count;
+}
+
+// Return uniform random value in [0,1) for element "index" of stream "key".
+// Note: Mixes the key and index with the SplitMix64 finalizer, and keeps the
+//       53 most significant bits (i.e., the mantissa of a double).
+double lf_random_value(unsigned long long key, unsigned long long index){
+   unsigned long long z = key*0x9E3779B97F4A7C15ULL+index+1;
+   z = (z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+   z = (z^(z>>27))*0x94D049BB133111EBULL;
+   z = z^(z>>31);
+   return (double)(z>>11)/9007199254740992.0;
+}
+
+// Move to the given byte offset of a (possibly larger than 2 GB) file.
+bool lf_seek_file(FILE* fid, unsigned long long offset){
+#ifdef _WIN32
+   return _fseeki64(fid, (__int64)offset, SEEK_SET) == 0;
+#else
+   return fseeko(fid, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
@@ -0,0 +1,72 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_IO
+//    Reads and writes multi-dimensional arrays (e.g., light fields and
+//    mask pairs) exchanged between Matlab and the native NMF tools.
+//    See LF_WRITE_ARRAY and LF_READ_ARRAY for the Matlab counterparts.
+//
+//    File format (little-endian):
+//       char[4]       magic "LFA1"
+//       uint32        number of dimensions (n)
+//       uint32[n]     dimensions
+//       double[prod]  elements, stored in column-major order
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_IO_H
+#define LF_NMF_IO_H
+
+// Define included files.
+#include <stdio.h>
+
+// Define maximum number of array dimensions.
+#define LF_ARRAY_MAX_DIMS 8
+
+// Declare structure for storing a multi-dimensional array.
+typedef struct {
+   unsigned int  ndims;
+   unsigned int  dim[LF_ARRAY_MAX_DIMS];
+   unsigned long numel;
+   double*       data;
+} LFArray;
+
+// Read array from file (returns false on failure).
+bool lf_read_array(const char* filename, LFArray* A);
+
+// Write array to file (returns false on failure).
+bool lf_write_array(const char* filename, const LFArray* A);
+
+// Allocate array with the given dimensions (elements set to zero).
+void lf_alloc_array(LFArray* A, unsigned int ndims, const unsigned int* dim);
+
+// Release array storage.
+void lf_free_array(LFArray* A);
+
+// Open array file for reading its elements incrementally (returns NULL on failure).
+// Note: Only the header is read (i.e., the dimensions of A are set, but no
+//       storage is allocated). See LF_READ_ELEMENTS.
+FILE* lf_open_array(const char* filename, LFArray* A);
+
+// Create array file for writing its elements incrementally (returns NULL on failure).
+// Note: Only the header is written, using the dimensions of A (whose
+//       storage is not used). See LF_WRITE_ELEMENTS.
+FILE* lf_create_array(const char* filename, const LFArray* A);
+
+// Read "count" consecutive elements, starting at element "offset" (column-major).
+bool lf_read_elements(FILE* fid, const LFArray* A, unsigned long offset,
+                      unsigned long count, double* data);
+
+// Write "count" consecutive elements, starting at element "offset" (column-major).
+bool lf_write_elements(FILE* fid, const LFArray* A, unsigned long offset,
+                       unsigned long count, const double* data);
+
+// Move to the given byte offset of a (possibly larger than 2 GB) file.
+bool lf_seek_file(FILE* fid, unsigned long long offset);
+
+// Return uniform random value in [0,1) for element "index" of stream "key".
+// Note: The value only depends on the key and the index (i.e., a counter-based
+//       generator), so the elements of a random array can be drawn in any
+//       order (e.g., band by band) and still match.
+double lf_random_value(unsigned long long key, unsigned long long index);
+
+#endif
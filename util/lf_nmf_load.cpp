@@ -0,0 +1,298 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_LOAD
+//    Loads a light field from its oblique views (see lf_nmf_load.h).
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <math.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <png.h>
+#include "lf_nmf_load.h"
+#include "lf_nmf_threads.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Declare structure for storing the resampling weights along one axis.
+// Note: Output element x is the sum of weight[x*ntaps+p] times input
+//       element index[x*ntaps+p], for p = 0..ntaps-1.
+typedef struct {
+   unsigned int              ntaps;
+   std::vector<unsigned int> index;
+   std::vector<double>       weight;
+} NMFResample;
+
+// Declare structure for storing the state shared by the view loaders.
+// Note: "lut8" and "lut16" linearize 8-bit and 16-bit pixels (i.e., each
+//       code normalized to [0,1] and raised to the input gamma). "error"
+//       holds the message of each view that failed (empty otherwise).
+template<typename T>
+struct NMFLoad {
+   const char*              pattern;
+   const NMFLoadOptions*    opt;
+   T*                       lf;
+   std::vector<double>      lut8;
+   std::vector<double>      lut16;
+   std::vector<std::string> error;
+};
+
+// Declare auxiliary functions.
+template<typename T> static bool load_views(const char*, const NMFLoadOptions*, T*, char*);
+template<typename T> static void load_view_block(void*, unsigned int);
+static bool read_png(const char*, std::vector<unsigned char>*, unsigned int*,
+   unsigned int*, unsigned int*, unsigned int*, std::string*);
+static void resample_weights(unsigned int, unsigned int, NMFResample*);
+static void resample(const double*, unsigned int, unsigned int,
+   const NMFResample*, const NMFResample*, double*, double*);
+template<typename T> static inline T encode(double, const NMFLoadOptions*);
+
+// Initialize loading options to their default values.
+void lf_nmf_default_load_options(NMFLoadOptions* opt){
+   opt->res[0]     = opt->res[1] = 0;
+   opt->nAngles[0] = opt->nAngles[1] = 1;
+   opt->fullColor  = true;
+   opt->inGamma    = 2.2;
+   opt->nthreads   = 0;
+}
+
+// Load the oblique views of a light field (for each element type).
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       double* lf, char* error){
+   return load_views(pattern, opt, lf, error);
+}
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       float* lf, char* error){
+   return load_views(pattern, opt, lf, error);
+}
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       unsigned short* lf, char* error){
+   return load_views(pattern, opt, lf, error);
+}
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       unsigned char* lf, char* error){
+   return load_views(pattern, opt, lf, error);
+}
+
+// Load the oblique views of a light field (one view per parallel block).
+// Note: The first failure (in view order) is reported.
+template<typename T>
+static bool load_views(const char* pattern, const NMFLoadOptions* opt, T* lf, char* error){
+   unsigned int nviews = opt->nAngles[0]*opt->nAngles[1];
+   NMFLoad<T> load;
+   load.pattern = pattern;
+   load.opt     = opt;
+   load.lf      = lf;
+   load.lut8.resize(256);
+   load.lut16.resize(65536);
+   for(unsigned int code=0; code<256; code++)
+      load.lut8[code] = pow(code/255.0, opt->inGamma);
+   for(unsigned int code=0; code<65536; code++)
+      load.lut16[code] = pow(code/65535.0, opt->inGamma);
+   load.error.resize(nviews);
+   unsigned int nthreads = (opt->nthreads > 0) ? opt->nthreads : lf_nmf_default_threads();
+   NMFThreadPool pool(MIN(nthreads, nviews));
+   pool.run(load_view_block<T>, &load, nviews);
+   for(unsigned int view=0; view<nviews; view++){
+      if(load.error[view].empty())
+         continue;
+      if(error != NULL)
+         snprintf(error, 1024, "%s", load.error[view].c_str());
+      else
+         fprintf(stderr, "%s\n", load.error[view].c_str());
+      return false;
+   }
+   return true;
+}
+
+// Load one view (i.e., decode, linearize, resize, and store it).
+// Note: View k = nAngles[1]*(b-1)+a-1 is read from file index k+1.
+template<typename T>
+static void load_view_block(void* ctx, unsigned int view){
+   NMFLoad<T>* load = (NMFLoad<T>*)ctx;
+   const NMFLoadOptions* opt = load->opt;
+   unsigned int bIdx = view/opt->nAngles[1];
+   unsigned int aIdx = view%opt->nAngles[1];
+   char filename[1024];
+   snprintf(filename, sizeof(filename), load->pattern, view+1);
+
+   // Decode the image, and linearize each channel.
+   // Note: Gray images are replicated for full-color light fields, and
+   //       color images are converted to luminance otherwise.
+   std::vector<unsigned char> data;
+   unsigned int width, height, nch, depth;
+   if(!read_png(filename, &data, &width, &height, &nch, &depth, &load->error[view]))
+      return;
+   unsigned int C = opt->fullColor ? 3 : 1;
+   unsigned int nplanes = (opt->fullColor && nch == 3) ? 3 : 1;
+   unsigned long npix = (unsigned long)width*height;
+   std::vector<double> planes(nplanes*npix);
+   for(unsigned long i=0; i<npix; i++){
+      double rgb[3];
+      for(unsigned int c=0; c<nch; c++){
+         unsigned long n = i*nch+c;
+         rgb[c] = (depth == 16) ? load->lut16[(data[2*n] << 8) | data[2*n+1]] :
+                                  load->lut8[data[n]];
+      }
+      if(nplanes == 3)
+         for(unsigned int c=0; c<3; c++)
+            planes[c*npix+i] = rgb[c];
+      else if(nch == 3)
+         planes[i] = 0.3*rgb[0]+0.59*rgb[1]+0.11*rgb[2];
+      else
+         planes[i] = rgb[0];
+   }
+   std::vector<unsigned char>().swap(data);
+
+   // Resize each channel, and store it in the reversed view slot.
+   unsigned int rows = opt->res[0], cols = opt->res[1];
+   NMFResample along_rows, along_cols;
+   resample_weights(height, rows, &along_rows);
+   resample_weights(width, cols, &along_cols);
+   std::vector<double> work((unsigned long)height*cols);
+   std::vector<double> out((unsigned long)rows*cols);
+   unsigned long N = (unsigned long)rows*cols;
+   unsigned int b = opt->nAngles[0]-bIdx-1;
+   unsigned int a = opt->nAngles[1]-aIdx-1;
+   for(unsigned int p=0; p<nplanes; p++){
+      resample(&planes[p*npix], height, width, &along_rows, &along_cols, &work[0], &out[0]);
+      for(unsigned int c=p; c<((nplanes == 1) ? C : p+1); c++){
+         T* lf = load->lf+((c*opt->nAngles[1]+a)*opt->nAngles[0]+b)*N;
+         for(unsigned int v=0; v<rows; v++)
+            for(unsigned int u=0; u<cols; u++)
+               lf[(unsigned long)u*rows+v] = encode<T>(out[(unsigned long)v*cols+u], opt);
+      }
+   }
+}
+
+// Decode a PNG image into 8-bit or 16-bit samples (returns false on failure).
+// Note: Palettes and low bit depths are expanded, and alpha is discarded.
+//       Gamma chunks are ignored (as by Matlab's IMREAD). 16-bit samples are
+//       stored big-endian. Uses the low-level interface, so that no object
+//       with a destructor is created after SETJMP.
+static bool read_png(const char* filename, std::vector<unsigned char>* data,
+                     unsigned int* width, unsigned int* height,
+                     unsigned int* nch, unsigned int* depth, std::string* error){
+   FILE* fid = fopen(filename, "rb");
+   if(fid == NULL){
+      *error = std::string("Cannot open ")+filename;
+      return false;
+   }
+   png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   png_infop info = (png != NULL) ? png_create_info_struct(png) : NULL;
+   std::vector<png_bytep> row_ptr;
+   if(info == NULL || setjmp(png_jmpbuf(png))){
+      png_destroy_read_struct(&png, &info, NULL);
+      fclose(fid);
+      *error = std::string(filename)+" is not a valid PNG image";
+      return false;
+   }
+   png_init_io(png, fid);
+   png_read_info(png, info);
+   png_set_expand(png);
+   png_set_strip_alpha(png);
+   png_read_update_info(png, info);
+   *width  = png_get_image_width(png, info);
+   *height = png_get_image_height(png, info);
+   *nch    = png_get_channels(png, info);
+   *depth  = png_get_bit_depth(png, info);
+   png_size_t row_bytes = png_get_rowbytes(png, info);
+   data->resize(row_bytes*(*height));
+   row_ptr.resize(*height);
+   for(unsigned int y=0; y<*height; y++)
+      row_ptr[y] = &(*data)[y*row_bytes];
+   png_read_image(png, &row_ptr[0]);
+   png_read_end(png, NULL);
+   png_destroy_read_struct(&png, &info, NULL);
+   fclose(fid);
+   return true;
+}
+
+// Evaluate the resampling weights along one axis (as Matlab's IMRESIZE).
+// Note: Uses the triangle (i.e., bilinear) kernel, widened by the inverse
+//       scale when shrinking (i.e., with antialiasing). Input elements
+//       beyond the border are mirrored, and the weights of each output
+//       element are normalized.
+static void resample_weights(unsigned int in_len, unsigned int out_len, NMFResample* r){
+   double scale = (double)out_len/in_len;
+   double width = (scale < 1) ? 2.0/scale : 2.0;
+   r->ntaps = (unsigned int)ceil(width)+2;
+   r->index.resize((unsigned long)out_len*r->ntaps);
+   r->weight.resize((unsigned long)out_len*r->ntaps);
+   for(unsigned int x=0; x<out_len; x++){
+      double u = (x+1)/scale+0.5*(1-1/scale);
+      long left = (long)floor(u-width/2);
+      double sum = 0;
+      for(unsigned int p=0; p<r->ntaps; p++){
+         long idx = left+p;
+         double d = fabs(u-idx)*MIN(scale, 1.0);
+         double w = (d < 1) ? (1-d)*MIN(scale, 1.0) : 0;
+         long m = (idx-1)%(2*(long)in_len);
+         if(m < 0)
+            m += 2*in_len;
+         if(m >= in_len)
+            m = 2*in_len-1-m;
+         r->index[x*r->ntaps+p]  = (unsigned int)m;
+         r->weight[x*r->ntaps+p] = w;
+         sum += w;
+      }
+      for(unsigned int p=0; p<r->ntaps; p++)
+         r->weight[x*r->ntaps+p] /= sum;
+   }
+}
+
+// Resize an image (stored in row-major order) along both axes.
+// Note: Rows are resized first (into "work"), and then each output row
+//       accumulates whole input rows, so the inner loop runs over
+//       contiguous elements (i.e., is vectorized by the compiler).
+static void resample(const double* in, unsigned int height, unsigned int width,
+                     const NMFResample* along_rows, const NMFResample* along_cols,
+                     double* work, double* out){
+   unsigned int cols = (unsigned int)(along_cols->index.size()/along_cols->ntaps);
+   unsigned int rows = (unsigned int)(along_rows->index.size()/along_rows->ntaps);
+   for(unsigned int y=0; y<height; y++){
+      const double* in_y = in+(unsigned long)y*width;
+      double* work_y = work+(unsigned long)y*cols;
+      for(unsigned int x=0; x<cols; x++){
+         const unsigned int* index = &along_cols->index[x*along_cols->ntaps];
+         const double* weight = &along_cols->weight[x*along_cols->ntaps];
+         double sum = 0;
+         for(unsigned int p=0; p<along_cols->ntaps; p++)
+            sum += weight[p]*in_y[index[p]];
+         work_y[x] = sum;
+      }
+   }
+   for(unsigned int y=0; y<rows; y++){
+      double* out_y = out+(unsigned long)y*cols;
+      memset(out_y, 0, sizeof(double)*cols);
+      for(unsigned int p=0; p<along_rows->ntaps; p++){
+         double w = along_rows->weight[y*along_rows->ntaps+p];
+         if(w == 0)
+            continue;
+         const double* work_y = work+(unsigned long)along_rows->index[y*along_rows->ntaps+p]*cols;
+         for(unsigned int x=0; x<cols; x++)
+            out_y[x] += w*work_y[x];
+      }
+   }
+}
+
+// Store a linear intensity (gamma-compressing it for integer light fields).
+template<typename T>
+static inline T encode(double x, const NMFLoadOptions* opt){
+   double max = (double)(T)~(T)0;
+   return (T)floor(max*pow(MIN(MAX(x, 0.0), 1.0), 1/opt->inGamma)+0.5);
+}
+template<>
+inline double encode<double>(double x, const NMFLoadOptions*){
+   return x;
+}
+template<>
+inline float encode<float>(double x, const NMFLoadOptions*){
+   return (float)x;
+}
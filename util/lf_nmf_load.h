@@ -0,0 +1,51 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_LOAD
+//    Loads a light field from its oblique views (i.e., the skewed
+//    orthographic image set, e.g., "images/teapot/teapot-0N.png"), as
+//    done by generate_masks.m: each view is linearized (i.e., raised to
+//    the input gamma), converted to luminance unless full-color, and
+//    resized to the display resolution (bilinear, with antialiasing when
+//    shrinking, as Matlab's IMRESIZE). The views are decoded concurrently.
+//
+//    Requires libpng (i.e., link with -lpng).
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_LOAD_H
+#define LF_NMF_LOAD_H
+
+// Declare structure for storing light field loading options.
+typedef struct {
+   unsigned int  res[2];        // display resolution [height width] (pixels)
+   unsigned int  nAngles[2];    // angular resolution [vertical horizontal] (views)
+   bool          fullColor;     // flag to load three color channels (otherwise luminance)
+   double        inGamma;       // gamma-correction value of the input images
+   unsigned int  nthreads;      // number of threads (0: all hardware threads)
+} NMFLoadOptions;
+
+// Initialize loading options to their default values.
+// Note: The resolution and angular resolution must be set by the caller.
+void lf_nmf_default_load_options(NMFLoadOptions* opt);
+
+// Load the oblique views of a light field (returns false on failure).
+// Note: The file name of each view is "pattern" formatted with its 1-based
+//       index (e.g., "./images/teapot/teapot-0%d.png"), where view (b,a)
+//       has index nAngles[1]*(b-1)+a. The light field "lf" has dimensions
+//       [res[0] res[1] nAngles[0] nAngles[1] C] (C = 3 for full-color, or 1),
+//       stored in column-major order, and view (b,a) is stored in slot
+//       (nAngles[0]-b+1, nAngles[1]-a+1) (i.e., the views are reversed).
+//       Integer light fields store the gamma-compressed intensities (i.e.,
+//       the linear intensities raised to 1/inGamma, see NMFQuantized).
+//       Unless NULL, "error" receives a message on failure (up to 1024
+//       characters); otherwise, the message is printed to standard error.
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       double* lf, char* error);
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       float* lf, char* error);
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       unsigned short* lf, char* error);
+bool lf_nmf_load_views(const char* pattern, const NMFLoadOptions* opt,
+                       unsigned char* lf, char* error);
+
+#endif
@@ -0,0 +1,94 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_LOAD_MEX
+//    Loads a light field from its oblique views (i.e., the skewed
+//    orthographic image set), decoding the views concurrently (see
+//    LF_NMF_LOAD). Replaces the loading loop of generate_masks.m.
+//
+//    LF = lf_nmf_load_mex(pattern,res,nAngles,fullColor,inGamma,class,numThreads)
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <stdio.h>
+#include <cstring>
+#include "mex.h"
+#include "lf_nmf_load.h"
+
+// Define pointers to input/output arguments.
+#define PATTERN_IN    prhs[0] // (input) file name pattern (e.g., './images/teapot/teapot-0%d.png')
+#define RES_IN        prhs[1] // (input) display resolution [height width]
+#define NANGLES_IN    prhs[2] // (input) angular resolution [vertical horizontal]
+#define FULL_COLOR_IN prhs[3] // (input) flag to load three color channels (otherwise luminance)
+#define GAMMA_IN      prhs[4] // (input) gamma-correction value of the input images
+#define CLASS_IN      prhs[5] // (input) class of the light field ('double', 'single', 'uint16', or 'uint8')
+#define THREADS_IN    prhs[6] // (input) number of threads (0: all hardware threads)
+#define LF_OUT        plhs[0] // (output) light field
+
+// Define MEX-file gateway routine.
+void mexFunction(
+    int nlhs, mxArray* plhs[],
+    int nrhs, const mxArray* prhs[]){
+
+   // Verify input arguments.
+   if(nrhs < 5 || nrhs > 7)
+      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected five to seven).");
+   char pattern[1024];
+   if(!mxIsChar(PATTERN_IN) || mxGetString(PATTERN_IN, pattern, sizeof(pattern)))
+      mexErrMsgTxt("File name pattern must be a string.");
+   if(!mxIsDouble(RES_IN) || mxGetNumberOfElements(RES_IN) != 2)
+      mexErrMsgTxt("Display resolution must be a double vector with two elements.");
+   if(!mxIsDouble(NANGLES_IN) || mxGetNumberOfElements(NANGLES_IN) != 2)
+      mexErrMsgTxt("Angular resolution must be a double vector with two elements.");
+   if(mxGetNumberOfElements(FULL_COLOR_IN) != 1 || mxGetNumberOfElements(GAMMA_IN) != 1)
+      mexErrMsgTxt("Full-color flag and gamma-correction value must be scalar.");
+   NMFLoadOptions opt;
+   lf_nmf_default_load_options(&opt);
+   for(int i=0; i<2; i++){
+      opt.res[i]     = (unsigned int)mxGetPr(RES_IN)[i];
+      opt.nAngles[i] = (unsigned int)mxGetPr(NANGLES_IN)[i];
+   }
+   opt.fullColor = mxGetScalar(FULL_COLOR_IN) != 0;
+   opt.inGamma   = mxGetScalar(GAMMA_IN);
+   mxClassID lf_class = mxDOUBLE_CLASS;
+   if(nrhs >= 6){
+      char name[16] = "";
+      if(mxIsChar(CLASS_IN))
+         mxGetString(CLASS_IN, name, sizeof(name));
+      if(!strcmp(name, "single"))
+         lf_class = mxSINGLE_CLASS;
+      else if(!strcmp(name, "uint16"))
+         lf_class = mxUINT16_CLASS;
+      else if(!strcmp(name, "uint8"))
+         lf_class = mxUINT8_CLASS;
+      else if(strcmp(name, "double"))
+         mexErrMsgTxt("Light field class must be 'double', 'single', 'uint16', or 'uint8'.");
+   }
+   if(nrhs == 7){
+      if(!mxIsNumeric(THREADS_IN) || mxGetNumberOfElements(THREADS_IN) != 1)
+         mexErrMsgTxt("Number of threads must be a numerical scalar.");
+      opt.nthreads = (unsigned int)mxGetScalar(THREADS_IN);
+   }
+
+   // Allocate and load the light field.
+   // Note: Luminance light fields are four-dimensional.
+   mwSize lf_dim[5] = {opt.res[0], opt.res[1], opt.nAngles[0], opt.nAngles[1], 3};
+   mxArray* lf = mxCreateNumericArray(opt.fullColor ? 5 : 4, lf_dim, lf_class, mxREAL);
+   char error[1024];
+   bool ok;
+   if(lf_class == mxSINGLE_CLASS)
+      ok = lf_nmf_load_views(pattern, &opt, (float*)mxGetData(lf), error);
+   else if(lf_class == mxUINT16_CLASS)
+      ok = lf_nmf_load_views(pattern, &opt, (unsigned short*)mxGetData(lf), error);
+   else if(lf_class == mxUINT8_CLASS)
+      ok = lf_nmf_load_views(pattern, &opt, (unsigned char*)mxGetData(lf), error);
+   else
+      ok = lf_nmf_load_views(pattern, &opt, mxGetPr(lf), error);
+   if(!ok){
+      mxDestroyArray(lf);
+      mexErrMsgTxt(error);
+   }
+
+   // Return the light field.
+   LF_OUT = lf;
+}
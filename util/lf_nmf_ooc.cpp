@@ -0,0 +1,429 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_OOC
+//    Factorizes light fields that do not fit in memory by streaming bands
+//    of mask rows (with a halo of nHalfAngles[0] rows) from disk.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#define _FILE_OFFSET_BITS 64
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits>
+#include <vector>
+#include "lf_nmf_ooc.h"
+#include "lf_nmf_io.h"
+#include "lf_nmf_threads.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Declare structure for storing the state of the out-of-core solver.
+// Note: The scratch files hold the light field as angular bundles (with
+//       interleaved channels) and the masks in pixel-major order (see
+//       lf_nmf_2d_Euclidean_band), so each band is a contiguous range.
+template<typename T>
+struct NMFStream {
+   const NMFPlan*    plan;      // plan for the whole display
+   NMFPlan*          band_plan; // plan for the current band (including the halo)
+   unsigned int      C;
+   unsigned long     R;
+   unsigned int      band_rows;
+   unsigned int      seed;      // seed of the random initial masks
+   const NMFOptions* opt;       // factorization options
+   NMFThreadPool*    pool;      // threads (shared by every band and half-step)
+   FILE*             lf_file;   // light field (angular bundles)
+   FILE*             W_file;    // rear masks (pixel-major)
+   FILE*             H_file;    // front masks (pixel-major)
+   std::vector<T>    lf;        // light field of the current band
+   std::vector<T>    W;         // rear masks of the current band
+   std::vector<T>    H;         // front masks of the current band
+};
+
+// Declare internal functions.
+template<typename T> static bool lf_nmf_solve_ooc(
+   const char*, const char*, const char*, const char*, const char*,
+   unsigned long, unsigned int, unsigned int, const NMFOptions*, double*);
+template<typename T> static bool load_light_field(NMFStream<T>*, FILE*, const LFArray*,
+                                                  double*, double*);
+template<typename T> static bool load_masks(NMFStream<T>*, const char*, bool);
+template<typename T> static bool save_masks(NMFStream<T>*, const char*, bool);
+template<typename T> static bool sweep_bands(NMFStream<T>*, unsigned int, const char*, double*);
+template<typename T> static bool scratch_io(FILE*, unsigned long, T*, unsigned long, bool);
+
+// Apply the weighted multiplicative update rule to light field files.
+bool lf_nmf_2d_Euclidean_ooc(
+        const char* lf_fn, const char* W0_fn, const char* H0_fn,
+        const char* W_fn, const char* H_fn, unsigned long R,
+        unsigned int band_rows, unsigned int seed, bool single,
+        const NMFOptions* opt, double* E){
+   if(single)
+      return lf_nmf_solve_ooc<float>(lf_fn, W0_fn, H0_fn, W_fn, H_fn, R, band_rows, seed, opt, E);
+   return lf_nmf_solve_ooc<double>(lf_fn, W0_fn, H0_fn, W_fn, H_fn, R, band_rows, seed, opt, E);
+}
+
+// Apply the weighted multiplicative update rule (for either scalar type).
+// Note: Each iteration updates the front masks of every band, and then the
+//       rear masks of every band, as the in-core solver does for the whole
+//       display. The masks are updated in place, since the rows of a band
+//       only depend on the halo rows of the other mask.
+template<typename T>
+static bool lf_nmf_solve_ooc(
+        const char* lf_fn, const char* W0_fn, const char* H0_fn,
+        const char* W_fn, const char* H_fn, unsigned long R,
+        unsigned int band_rows, unsigned int seed, const NMFOptions* opt, double* E_data){
+
+   // Open light field.
+   LFArray A;
+   FILE* fid = lf_open_array(lf_fn, &A);
+   if(fid == NULL)
+      return false;
+   if(A.ndims < 4 || A.ndims > 5){
+      fprintf(stderr, "Input light field must be four- or five-dimensional.\n");
+      fclose(fid);
+      return false;
+   }
+
+   // Verify that the PSNR can be evaluated band by band.
+   // Note: For even numbers of views, the original PSNR pairs rays with
+   //       front pixels that the update rule does not visit (see init_PSNR),
+   //       some of which lie beyond the halo of each band.
+   if(opt->evaluate_PSNR && E_data != NULL && ((A.dim[2]%2) == 0 || (A.dim[3]%2) == 0)){
+      fprintf(stderr, "Out-of-core PSNR evaluation requires odd numbers of views.\n");
+      fclose(fid);
+      return false;
+   }
+
+   // Create plan for the whole display (and the threads for every band).
+   NMFThreadPool pool(opt->nthreads > 0 ? opt->nthreads : lf_nmf_default_threads());
+   NMFStream<T> stream;
+   stream.plan      = lf_nmf_create_plan(A.dim);
+   stream.band_plan = NULL;
+   stream.C         = (A.ndims == 5) ? A.dim[4] : 1;
+   stream.R         = R;
+   stream.band_rows = MAX(band_rows, 1);
+   stream.seed      = seed;
+   stream.opt       = opt;
+   stream.pool      = &pool;
+   stream.lf_file   = tmpfile();
+   stream.W_file    = tmpfile();
+   stream.H_file    = tmpfile();
+   unsigned int C = stream.C;
+   unsigned long niter = opt->niter;
+   bool evaluate = opt->evaluate_PSNR && (E_data != NULL);
+   if(opt->print != NULL){
+      unsigned int rows = MIN(stream.band_rows, A.dim[0])+2*stream.plan->nHalfAngles[0];
+      double band_bytes = (double)rows*A.dim[1]*sizeof(T)*C*(2*stream.plan->K+2*R);
+      char msg[1024];
+      sprintf(msg, "  + Streaming bands of %u rows (%.1f MB per band)...\n",
+              stream.band_rows, band_bytes/(1<<20));
+      opt->print(msg);
+   }
+
+   // Convert the light field into angular bundles and load the initial masks.
+   std::vector<double> peak(C, 0);
+   double nvalid = 0;
+   bool ok = stream.lf_file != NULL && stream.W_file != NULL && stream.H_file != NULL;
+   if(!ok)
+      fprintf(stderr, "Cannot create temporary files\n");
+   ok = ok && load_light_field(&stream, fid, &A, &peak[0], &nvalid);
+   ok = ok && load_masks(&stream, W0_fn, false) && load_masks(&stream, H0_fn, true);
+   fclose(fid);
+
+   // Evaluate the error of the initial mask pairs (if necessary).
+   // Note: Thereafter, the error is evaluated after the rear mask update
+   //       (row by row, matching the full mode of the in-core solver).
+   std::vector<double> SSE(C, 0);
+   if(ok && evaluate)
+      ok = sweep_bands(&stream, LF_NMF_STEP_EVALUATE, NULL, &SSE[0]);
+
+   // Apply the weighted multiplicative update rule.
+   // Note: Each channel stops once its PSNR exceeds the minimum, after which
+   //       its mask pairs are left unchanged by the joint sweeps.
+   const double NaN = std::numeric_limits<double>::quiet_NaN();
+   std::vector<char> frozen(C, 0);
+   std::vector<double> E(C, NaN);
+   unsigned long nactive = C;
+   for(unsigned int iter=0; ok && iter<niter; iter++){
+      char msg[1024];
+      for(unsigned int c=0; c<C && evaluate; c++){
+         if(frozen[c])
+            continue;
+         E[c] = 10.0*log10(pow(peak[c], 2)/(SSE[c]/nvalid));
+         E_data[c*niter+iter] = E[c];
+         if(E[c] > opt->min_PSNR){
+            if(C > 1)
+               sprintf(msg, "  + Stopping channel %d at iteration #%03d (PSNR = %4.1f dB > %4.1f dB)...\n",
+                       c+1, iter+1, E[c], opt->min_PSNR);
+            else
+               sprintf(msg, "  + Stopping at iteration #%03d (PSNR = %4.1f dB > %4.1f dB)...\n",
+                       iter+1, E[c], opt->min_PSNR);
+            if(opt->print != NULL)
+               opt->print(msg);
+            for(unsigned long i=iter; i<niter; i++)
+               E_data[c*niter+i] = E[c];
+            frozen[c] = 1;
+            nactive--;
+         }
+      }
+      if(nactive == 0)
+         break;
+      if((iter%10) == 0 && opt->print != NULL){
+         int len = sprintf(msg, "  + Updating for iteration #%03d", iter+1);
+         for(unsigned int c=0; c<C && evaluate && len<900; c++)
+            len += sprintf(msg+len, (c > 0) ? "/%4.1f" : " (initial PSNR = %4.1f", E[c]);
+         sprintf(msg+len, evaluate ? " dB)...\n" : "...\n");
+         opt->print(msg);
+      }
+      if(!opt->fix_H)
+         ok = sweep_bands(&stream, LF_NMF_STEP_H, &frozen[0], NULL);
+      SSE.assign(C, 0);
+      ok = ok && sweep_bands(&stream, LF_NMF_STEP_W, &frozen[0], evaluate ? &SSE[0] : NULL);
+   }
+
+   // Write optimized mask pairs.
+   ok = ok && save_masks(&stream, W_fn, false) && save_masks(&stream, H_fn, true);
+
+   // Release storage.
+   if(stream.lf_file != NULL)
+      fclose(stream.lf_file);
+   if(stream.W_file != NULL)
+      fclose(stream.W_file);
+   if(stream.H_file != NULL)
+      fclose(stream.H_file);
+   if(stream.band_plan != NULL)
+      lf_nmf_destroy_plan(stream.band_plan);
+   lf_nmf_destroy_plan((NMFPlan*)stream.plan);
+   return ok;
+}
+
+// Convert the light field into angular bundles (band by band).
+// Note: Also evaluates the peak value and number of valid rays (i.e., rays
+//       that intersect both masks) for the PSNR evaluation.
+template<typename T>
+static bool load_light_field(NMFStream<T>* stream, FILE* fid, const LFArray* A,
+                             double* peak, double* nvalid){
+   const NMFPlan* plan = stream->plan;
+   unsigned int C = stream->C;
+   unsigned int rows = plan->lf_dim[0], cols = plan->lf_dim[1];
+   unsigned long K = plan->K;
+   int h0 = (int)plan->nHalfAngles[0], h1 = (int)plan->nHalfAngles[1];
+   std::vector<double> run(stream->band_rows);
+   *nvalid = 0;
+   for(unsigned int v=0; v<rows; v++)
+      for(unsigned int u=0; u<cols; u++)
+         *nvalid += (double)(plan->row_hi[v]-plan->row_lo[v]+1)*(plan->col_hi[u]-plan->col_lo[u]+1);
+   for(unsigned int r0=0; r0<rows; r0+=stream->band_rows){
+      unsigned int r1 = MIN(rows, r0+stream->band_rows);
+      stream->lf.assign((unsigned long)(r1-r0)*cols*K*C, 0);
+      for(unsigned int c=0; c<C; c++){
+         for(unsigned int a=0; a<plan->nAngles[1]; a++){
+            for(unsigned int b=0; b<plan->nAngles[0]; b++){
+               unsigned long q = b*plan->nAngles[1]+a;
+               for(unsigned int u=0; u<cols; u++){
+                  unsigned long offset = (((unsigned long)c*plan->nAngles[1]+a)*plan->nAngles[0]+b)*
+                                         plan->N+(unsigned long)u*rows+r0;
+                  if(!lf_read_elements(fid, A, offset, r1-r0, &run[0])){
+                     fprintf(stderr, "Cannot read light field\n");
+                     return false;
+                  }
+                  bool valid_u = (int)a-h1 >= plan->col_lo[u] && (int)a-h1 <= plan->col_hi[u];
+                  for(unsigned int v=r0; v<r1; v++){
+                     unsigned long i = (unsigned long)(v-r0)*cols+u;
+                     T value = (T)run[v-r0];
+                     stream->lf[(i*K+q)*C+c] = value;
+                     if(valid_u && (int)b-h0 >= plan->row_lo[v] && (int)b-h0 <= plan->row_hi[v])
+                        peak[c] = MAX(peak[c], (double)value);
+                  }
+               }
+            }
+         }
+      }
+      unsigned long count = (unsigned long)(r1-r0)*cols*K*C;
+      if(!scratch_io(stream->lf_file, (unsigned long)r0*cols*K*C, &stream->lf[0], count, true))
+         return false;
+   }
+   return true;
+}
+
+// Load the initial masks (or fill with random noise if not specified).
+// Note: A single matrix is replicated for each of the C channels. The noise
+//       of each element only depends on its column-major index (see
+//       lf_random_value), so it is drawn band by band, and matches the
+//       in-core solver (see LF_NMF_CLI) for the same seed.
+template<typename T>
+static bool load_masks(NMFStream<T>* stream, const char* filename, bool front){
+   const NMFPlan* plan = stream->plan;
+   unsigned int C = stream->C;
+   unsigned long R = stream->R, CR = C*R, N = plan->N;
+   unsigned int rows = plan->lf_dim[0], cols = plan->lf_dim[1];
+   FILE* scratch = front ? stream->H_file : stream->W_file;
+   std::vector<T>& M = front ? stream->H : stream->W;
+   LFArray B;
+   FILE* fid = NULL;
+   if(filename != NULL){
+      fid = lf_open_array(filename, &B);
+      if(fid == NULL)
+         return false;
+      unsigned long dim0 = front ? R : N, dim1 = front ? N : R;
+      if(B.dim[0] != dim0 || B.dim[1] != dim1 || (B.numel != N*R && B.numel != N*CR)){
+         fprintf(stderr, "%s must have dimensions %lux%lu (or %lux%lux%u)\n",
+                 filename, dim0, dim1, dim0, dim1, C);
+         fclose(fid);
+         return false;
+      }
+   }
+   bool ok = true;
+   std::vector<double> run;
+   for(unsigned int r0=0; ok && r0<rows; r0+=stream->band_rows){
+      unsigned int r1 = MIN(rows, r0+stream->band_rows);
+      unsigned long p0 = (unsigned long)r0*cols, np = (unsigned long)(r1-r0)*cols;
+      M.assign(np*CR, 0);
+      if(fid == NULL){
+         unsigned long long key = 2ULL*stream->seed+(front ? 1 : 0);
+         for(unsigned long p=0; p<np; p++){
+            for(unsigned int r=0; r<R; r++){
+               unsigned long index = front ? (p0+p)*R+r : r*N+p0+p;
+               T value = (T)lf_random_value(key, index);
+               for(unsigned int c=0; c<C; c++)
+                  M[p*CR+c*R+r] = value;
+            }
+         }
+      }
+      else if(front){
+         run.resize(np*R);
+         for(unsigned int c=0; ok && c<C; c++){
+            unsigned long c_src = (B.numel == N*CR) ? c : 0;
+            ok = lf_read_elements(fid, &B, c_src*R*N+p0*R, np*R, &run[0]);
+            for(unsigned long p=0; ok && p<np; p++)
+               for(unsigned int r=0; r<R; r++)
+                  M[p*CR+c*R+r] = (T)run[p*R+r];
+         }
+      }
+      else{
+         run.resize(np);
+         for(unsigned int c=0; ok && c<C; c++){
+            unsigned long c_src = (B.numel == N*CR) ? c : 0;
+            for(unsigned int r=0; ok && r<R; r++){
+               ok = lf_read_elements(fid, &B, c_src*N*R+r*N+p0, np, &run[0]);
+               for(unsigned long p=0; ok && p<np; p++)
+                  M[p*CR+c*R+r] = (T)run[p];
+            }
+         }
+      }
+      if(!ok)
+         fprintf(stderr, "%s is truncated\n", filename);
+      ok = ok && scratch_io(scratch, p0*CR, &M[0], np*CR, true);
+   }
+   if(fid != NULL)
+      fclose(fid);
+   return ok;
+}
+
+// Write the optimized masks (band by band, in column-major order).
+template<typename T>
+static bool save_masks(NMFStream<T>* stream, const char* filename, bool front){
+   const NMFPlan* plan = stream->plan;
+   unsigned int C = stream->C;
+   unsigned long R = stream->R, CR = C*R, N = plan->N;
+   unsigned int rows = plan->lf_dim[0], cols = plan->lf_dim[1];
+   FILE* scratch = front ? stream->H_file : stream->W_file;
+   std::vector<T>& M = front ? stream->H : stream->W;
+   LFArray B;
+   B.ndims  = (C > 1) ? 3 : 2;
+   B.dim[0] = front ? (unsigned int)R : (unsigned int)N;
+   B.dim[1] = front ? (unsigned int)N : (unsigned int)R;
+   B.dim[2] = C;
+   B.numel  = N*CR;
+   B.data   = NULL;
+   FILE* fid = lf_create_array(filename, &B);
+   if(fid == NULL)
+      return false;
+   bool ok = true;
+   std::vector<double> run;
+   for(unsigned int r0=0; ok && r0<rows; r0+=stream->band_rows){
+      unsigned int r1 = MIN(rows, r0+stream->band_rows);
+      unsigned long p0 = (unsigned long)r0*cols, np = (unsigned long)(r1-r0)*cols;
+      M.resize(np*CR);
+      ok = scratch_io(scratch, p0*CR, &M[0], np*CR, false);
+      if(front){
+         run.resize(np*R);
+         for(unsigned int c=0; ok && c<C; c++){
+            for(unsigned long p=0; p<np; p++)
+               for(unsigned int r=0; r<R; r++)
+                  run[p*R+r] = M[p*CR+c*R+r];
+            ok = lf_write_elements(fid, &B, c*R*N+p0*R, np*R, &run[0]);
+         }
+      }
+      else{
+         run.resize(np);
+         for(unsigned int c=0; ok && c<C; c++){
+            for(unsigned int r=0; ok && r<R; r++){
+               for(unsigned long p=0; p<np; p++)
+                  run[p] = M[p*CR+c*R+r];
+               ok = lf_write_elements(fid, &B, c*N*R+r*N+p0, np, &run[0]);
+            }
+         }
+      }
+   }
+   fclose(fid);
+   if(!ok)
+      fprintf(stderr, "Cannot write %s\n", filename);
+   return ok;
+}
+
+// Apply one half-step of the update rule to every band.
+// Note: Each band is loaded with its halo (i.e., up to nHalfAngles[0] rows
+//       on either side), and only the updated rows are written back.
+template<typename T>
+static bool sweep_bands(NMFStream<T>* stream, unsigned int step, const char* frozen, double* SSE){
+   const NMFPlan* plan = stream->plan;
+   unsigned int C = stream->C;
+   unsigned long K = plan->K, CR = C*stream->R;
+   unsigned int rows = plan->lf_dim[0], cols = plan->lf_dim[1];
+   unsigned int h0 = plan->nHalfAngles[0];
+   for(unsigned int r0=0; r0<rows; r0+=stream->band_rows){
+      unsigned int r1 = MIN(rows, r0+stream->band_rows);
+      unsigned int g0 = (r0 > h0) ? r0-h0 : 0;
+      unsigned int g1 = MIN(rows, r1+h0);
+      unsigned long p0 = (unsigned long)g0*cols, np = (unsigned long)(g1-g0)*cols;
+      stream->lf.resize(np*K*C);
+      stream->W.resize(np*CR);
+      stream->H.resize(np*CR);
+      if(!scratch_io(stream->lf_file, p0*K*C, &stream->lf[0], np*K*C, false) ||
+         !scratch_io(stream->W_file, p0*CR, &stream->W[0], np*CR, false) ||
+         !scratch_io(stream->H_file, p0*CR, &stream->H[0], np*CR, false))
+         return false;
+      unsigned int band_dim[4] = {g1-g0, cols, plan->nAngles[0], plan->nAngles[1]};
+      if(stream->band_plan == NULL || !lf_nmf_plan_matches(stream->band_plan, band_dim)){
+         if(stream->band_plan != NULL)
+            lf_nmf_destroy_plan(stream->band_plan);
+         stream->band_plan = lf_nmf_create_plan(band_dim);
+      }
+      lf_nmf_2d_Euclidean_band(stream->band_plan, &stream->lf[0], C,
+                               &stream->W[0], &stream->H[0], stream->R,
+                               r0-g0, r1-g0, step, frozen, stream->opt, stream->pool, SSE);
+      unsigned long inner = (unsigned long)(r0-g0)*cols*CR;
+      unsigned long count = (unsigned long)(r1-r0)*cols*CR;
+      if(step == LF_NMF_STEP_H &&
+         !scratch_io(stream->H_file, (unsigned long)r0*cols*CR, &stream->H[inner], count, true))
+         return false;
+      if(step == LF_NMF_STEP_W &&
+         !scratch_io(stream->W_file, (unsigned long)r0*cols*CR, &stream->W[inner], count, true))
+         return false;
+   }
+   return true;
+}
+
+// Read (or write) "count" consecutive elements of a temporary file.
+template<typename T>
+static bool scratch_io(FILE* fid, unsigned long offset, T* data, unsigned long count, bool write){
+   bool ok = lf_seek_file(fid, sizeof(T)*(unsigned long long)offset) &&
+             (write ? fwrite(data, sizeof(T), count, fid) : fread(data, sizeof(T), count, fid)) == count;
+   if(!ok)
+      fprintf(stderr, "Cannot access temporary file\n");
+   return ok;
+}
@@ -0,0 +1,41 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_OOC
+//    Factorizes light fields that do not fit in memory (e.g., full
+//    resolution light fields) by streaming bands of mask rows from disk.
+//    Each band is loaded with a halo of nHalfAngles[0] rows on either side
+//    (i.e., the rows reached by the rays leaving the band), so that the
+//    update rules applied to its rows match those of the in-core solver.
+//    The peak memory is bounded by the band size, rather than the display.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_OOC_H
+#define LF_NMF_OOC_H
+
+// Define included files.
+#include "lf_nmf_engine.h"
+
+// Apply the weighted multiplicative update rule to light field files.
+// Note: The light field file (see LF_NMF_IO) has dimensions [v u b a] or
+//       [v u b a C]. The initial masks are read from W0_fn (N x R, or
+//       N x R x C) and H0_fn (R x N, or R x N x C), or filled with random
+//       noise if NULL (streams 2*seed and 2*seed+1, see lf_random_value),
+//       and the optimized masks are written to W_fn and H_fn.
+//       Each sweep visits bands of "band_rows" mask rows, with the light
+//       field, the masks and the reconstruction of each band held in memory.
+//       The light field (converted into angular bundles) and the masks are
+//       kept in temporary files in between. Each channel stops once its PSNR
+//       exceeds the minimum (evaluated after the rear mask update, and equal
+//       to that of the in-core solver in full mode); the other stopping
+//       rules, the evaluation modes, and the telemetry output are not
+//       supported. If PSNR evaluation is enabled, then "E" must hold
+//       niter x C elements. Returns false on failure (e.g., if a file cannot
+//       be read or written).
+bool lf_nmf_2d_Euclidean_ooc(
+        const char* lf_fn, const char* W0_fn, const char* H0_fn,
+        const char* W_fn, const char* H_fn, unsigned long R,
+        unsigned int band_rows, unsigned int seed, bool single,
+        const NMFOptions* opt, double* E);
+
+#endif
@@ -0,0 +1,164 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_PINHOLE
+//    Generates translated pinhole array mask pairs (see lf_nmf_pinhole.h).
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <cstring>
+#include <vector>
+#include "lf_nmf_pinhole.h"
+#include "lf_nmf_threads.h"
+
+// Define macro for element-wise minimum operation.
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Declare structure for storing the state shared by the mask generators.
+// Note: Light field elements are of type T, or are quantized codes of type
+//       S, dequantized by the lookup table "lut" (see NMFQuantized).
+template<typename T, typename S>
+struct NMFPinhole {
+   const unsigned int* lf_dim;
+   unsigned int        C;
+   const S*            lf;
+   const T*            lut;
+   T*                  W;
+   T*                  H;
+};
+
+// Declare auxiliary functions.
+template<typename T, typename S> static void pinhole_masks(const unsigned int*,
+   unsigned int, const S*, const T*, T*, T*, unsigned int);
+template<typename T, typename S> static void pinhole_W_block(void*, unsigned int);
+template<typename T, typename S> static void pinhole_H_block(void*, unsigned int);
+static int pinhole_view(int, unsigned int, unsigned int, unsigned int);
+template<typename T> static inline T lf_value(T, const T*);
+template<typename T, typename S> static inline T lf_value(S, const T*);
+
+// Generate the translated pinhole array mask pairs (for each element type).
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const double* lf,
+                          double* W, double* H, unsigned int nthreads){
+   pinhole_masks(lf_dim, C, lf, (const double*)NULL, W, H, nthreads);
+}
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const float* lf,
+                          float* W, float* H, unsigned int nthreads){
+   pinhole_masks(lf_dim, C, lf, (const float*)NULL, W, H, nthreads);
+}
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const NMFQuantized* lf,
+                          double* W, double* H, unsigned int nthreads){
+   std::vector<double> lut((lf->type == LF_NMF_QUANT_UINT8) ? 256 : 65536);
+   lf_nmf_quantized_lut(lf, &lut[0]);
+   if(lf->type == LF_NMF_QUANT_UINT8)
+      pinhole_masks(lf_dim, C, (const unsigned char*)lf->data, &lut[0], W, H, nthreads);
+   else
+      pinhole_masks(lf_dim, C, (const unsigned short*)lf->data, &lut[0], W, H, nthreads);
+}
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const NMFQuantized* lf,
+                          float* W, float* H, unsigned int nthreads){
+   std::vector<float> lut((lf->type == LF_NMF_QUANT_UINT8) ? 256 : 65536);
+   lf_nmf_quantized_lut(lf, &lut[0]);
+   if(lf->type == LF_NMF_QUANT_UINT8)
+      pinhole_masks(lf_dim, C, (const unsigned char*)lf->data, &lut[0], W, H, nthreads);
+   else
+      pinhole_masks(lf_dim, C, (const unsigned short*)lf->data, &lut[0], W, H, nthreads);
+}
+
+// Generate the translated pinhole array mask pairs.
+// Note: Each rear mask (and channel) is one parallel block, and each row
+//       of front mask pixels is one parallel block (i.e., both are written
+//       contiguously by a single thread).
+template<typename T, typename S>
+static void pinhole_masks(const unsigned int* lf_dim, unsigned int C, const S* lf,
+                          const T* lut, T* W, T* H, unsigned int nthreads){
+   NMFPinhole<T,S> pinhole;
+   pinhole.lf_dim = lf_dim;
+   pinhole.C      = C;
+   pinhole.lf     = lf;
+   pinhole.lut    = lut;
+   pinhole.W      = W;
+   pinhole.H      = H;
+   unsigned int R = lf_dim[2]*lf_dim[3];
+   if(nthreads == 0)
+      nthreads = lf_nmf_default_threads();
+   NMFThreadPool pool(MIN(nthreads, R*C));
+   pool.run(pinhole_W_block<T,S>, &pinhole, R*C);
+   pool.run(pinhole_H_block<T,S>, &pinhole, lf_dim[0]);
+}
+
+// Generate one rear mask (for one channel).
+// Note: Behind the pinhole of mask k, the pixel offset by (j,i) from it
+//       (i.e., within half the angular resolution) holds the ray of view
+//       (j,i) through the pinhole, which is stored in slot (b-j,a-i) of the
+//       light field (i.e., the views are reversed). Pixels beyond the last
+//       full block of views are not covered by any pinhole, and are zero.
+//       The source of each column is evaluated once, so that each mask row
+//       is a gather from a single light field row.
+template<typename T, typename S>
+static void pinhole_W_block(void* ctx, unsigned int block){
+   NMFPinhole<T,S>* pinhole = (NMFPinhole<T,S>*)ctx;
+   const unsigned int* lf_dim = pinhole->lf_dim;
+   unsigned int R = lf_dim[2]*lf_dim[3];
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned int k  = block%R;
+   unsigned int ch = block/R;
+   unsigned int b  = k/lf_dim[3];
+   unsigned int a  = k%lf_dim[3];
+   std::vector<long> src(lf_dim[1]);
+   for(unsigned int x=0; x<lf_dim[1]; x++){
+      int i = pinhole_view(x, a, lf_dim[3], lf_dim[1]);
+      src[x] = (i < 0) ? -1 : (long)x*lf_dim[0] +
+               (long)(lf_dim[3]-1-i)*lf_dim[0]*lf_dim[1]*lf_dim[2];
+   }
+   const S* lf_c = pinhole->lf+ch*N*R;
+   T* W_k = pinhole->W+ch*N*R+k*N;
+   for(unsigned int y=0; y<lf_dim[0]; y++){
+      T* W_y = W_k+(unsigned long)y*lf_dim[1];
+      int j = pinhole_view(y, b, lf_dim[2], lf_dim[0]);
+      if(j < 0){
+         memset(W_y, 0, sizeof(T)*lf_dim[1]);
+         continue;
+      }
+      const S* lf_y = lf_c+y+(unsigned long)(lf_dim[2]-1-j)*N;
+      const T* lut = pinhole->lut;
+      for(unsigned int x=0; x<lf_dim[1]; x++)
+         W_y[x] = (src[x] < 0) ? (T)0 : lf_value(lf_y[src[x]], lut);
+   }
+}
+
+// Generate one row of front mask pixels (for every mask and channel).
+// Note: Pixel (y,x) is open only in the mask whose pinholes it belongs to.
+template<typename T, typename S>
+static void pinhole_H_block(void* ctx, unsigned int y){
+   NMFPinhole<T,S>* pinhole = (NMFPinhole<T,S>*)ctx;
+   const unsigned int* lf_dim = pinhole->lf_dim;
+   unsigned int R = lf_dim[2]*lf_dim[3];
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   for(unsigned int ch=0; ch<pinhole->C; ch++){
+      T* H_y = pinhole->H+ch*N*R+(unsigned long)y*lf_dim[1]*R;
+      memset(H_y, 0, sizeof(T)*lf_dim[1]*R);
+      for(unsigned int x=0; x<lf_dim[1]; x++)
+         H_y[(unsigned long)x*R+(y%lf_dim[2])*lf_dim[3]+x%lf_dim[3]] = 1;
+   }
+}
+
+// Return the view seen through the pinhole at offset "p" along one axis
+// (or -1 if no pinhole covers pixel "p").
+// Note: Pinhole "k" (0-based) covers pixels k+j-h+m*n for views j = 0..n-1,
+//       where h = (n-1)/2 and m = 0..(res-1)/n (i.e., one block per pinhole).
+static int pinhole_view(int p, unsigned int k, unsigned int n, unsigned int res){
+   int h = (n-1)/2;
+   int j = (((p-(int)k+h)%(int)n)+(int)n)%(int)n;
+   int offset = p-(int)k-j+h;
+   return (offset >= 0 && offset/(int)n <= (int)((res-1)/n)) ? j : -1;
+}
+
+// Read a light field element (dequantizing it, if necessary).
+template<typename T>
+static inline T lf_value(T x, const T*){
+   return x;
+}
+template<typename T, typename S>
+static inline T lf_value(S x, const T* lut){
+   return lut[x];
+}
@@ -0,0 +1,39 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_PINHOLE
+//    Generates the translated pinhole array mask pairs of a light field,
+//    as done by generate_masks.m: front mask k is a pinhole array (i.e.,
+//    one open pixel per block of views), and rear mask k holds, behind
+//    each pinhole, the rays of the views seen through it. The masks are
+//    written in the layout of the NMF solver (see LF_NMF_ENGINE), so that
+//    they can initialize the factorization directly. The mask pairs are
+//    generated concurrently.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_PINHOLE_H
+#define LF_NMF_PINHOLE_H
+
+// Define included files.
+#include "lf_nmf_engine.h"
+
+// Generate the translated pinhole array mask pairs of a light field.
+// Note: The light field has dimensions [v u b a C] (i.e., lf_dim = [v u b a]
+//       and C channels), stored in column-major order, and is linear (i.e.,
+//       not gamma-compressed, unless quantized, see NMFQuantized). There are
+//       R = b*a mask pairs, where pair k = a*(bIdx-1)+aIdx has its pinholes
+//       at rows bIdx:b:v and columns aIdx:a:u. The rear masks "W" have
+//       dimensions N x R x C, and the front masks "H" have dimensions
+//       R x N x C (N = v*u), where mask pixel (y,x) has index u*(y-1)+x,
+//       as for the solver. The angular resolution must be odd (i.e., the
+//       views are centered on the pinholes).
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const double* lf,
+                          double* W, double* H, unsigned int nthreads);
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const float* lf,
+                          float* W, float* H, unsigned int nthreads);
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const NMFQuantized* lf,
+                          double* W, double* H, unsigned int nthreads);
+void lf_nmf_pinhole_masks(const unsigned int* lf_dim, unsigned int C, const NMFQuantized* lf,
+                          float* W, float* H, unsigned int nthreads);
+
+#endif
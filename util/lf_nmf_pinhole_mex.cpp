@@ -0,0 +1,95 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_PINHOLE_MEX
+//    Generates the translated pinhole array mask pairs of a light field
+//    (see LF_NMF_PINHOLE). Replaces the pinhole generation loop of
+//    generate_masks.m, and returns the masks in the layout expected by
+//    LF_NMF_2D_EUCLIDEAN_MEX.
+//
+//    [W,H] = lf_nmf_pinhole_mex(LF,inGamma,numThreads)
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <stdio.h>
+#include "mex.h"
+#include "lf_nmf_pinhole.h"
+
+// Define pointers to input/output arguments.
+#define LF_IN      prhs[0] // (input) light field [v u b a ch] (double, single, uint16, or uint8)
+#define GAMMA_IN   prhs[1] // (input) gamma-correction value of integer light fields
+#define THREADS_IN prhs[2] // (input) number of threads (0: all hardware threads)
+#define W_OUT      plhs[0] // (output) rear masks (N x R x ch)
+#define H_OUT      plhs[1] // (output) front masks (R x N x ch)
+
+// Define MEX-file gateway routine.
+void mexFunction(
+    int nlhs, mxArray* plhs[],
+    int nrhs, const mxArray* prhs[]){
+
+   // Verify input arguments.
+   // Note: Integer light fields store gamma-compressed intensities (see
+   //       NMFQuantized), and yield double-precision masks.
+   if(nrhs < 1 || nrhs > 3)
+      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected one to three).");
+   if(nlhs > 2)
+      mexErrMsgTxt("Too many output arguments.");
+   mxClassID lf_class = mxGetClassID(LF_IN);
+   if(lf_class != mxDOUBLE_CLASS && lf_class != mxSINGLE_CLASS &&
+      lf_class != mxUINT16_CLASS && lf_class != mxUINT8_CLASS)
+      mexErrMsgTxt("Light field must be double, single, uint16, or uint8.");
+   mwSize ndims = mxGetNumberOfDimensions(LF_IN);
+   if(ndims > 5)
+      mexErrMsgTxt("Light field must be four- or five-dimensional.");
+   const mwSize* dims = mxGetDimensions(LF_IN);
+   unsigned int lf_dim[4] = {1, 1, 1, 1};
+   for(mwSize i=0; i<ndims && i<4; i++)
+      lf_dim[i] = (unsigned int)dims[i];
+   unsigned int C = (ndims == 5) ? (unsigned int)dims[4] : 1;
+   if(lf_dim[2]%2 == 0 || lf_dim[3]%2 == 0)
+      mexErrMsgTxt("Angular resolution must be odd.");
+   double gamma = 1;
+   if(nrhs >= 2){
+      if(!mxIsDouble(GAMMA_IN) || mxGetNumberOfElements(GAMMA_IN) != 1)
+         mexErrMsgTxt("Gamma-correction value must be a double scalar.");
+      gamma = mxGetScalar(GAMMA_IN);
+   }
+   unsigned int nthreads = 0;
+   if(nrhs == 3){
+      if(!mxIsNumeric(THREADS_IN) || mxGetNumberOfElements(THREADS_IN) != 1)
+         mexErrMsgTxt("Number of threads must be a numerical scalar.");
+      nthreads = (unsigned int)mxGetScalar(THREADS_IN);
+   }
+
+   // Allocate the mask pairs.
+   mwSize N = (mwSize)lf_dim[0]*lf_dim[1];
+   mwSize R = (mwSize)lf_dim[2]*lf_dim[3];
+   mwSize W_dim[3] = {N, R, C};
+   mwSize H_dim[3] = {R, N, C};
+   mxClassID mask_class = (lf_class == mxSINGLE_CLASS) ? mxSINGLE_CLASS : mxDOUBLE_CLASS;
+   mxArray* W = mxCreateNumericArray((C > 1) ? 3 : 2, W_dim, mask_class, mxREAL);
+   mxArray* H = mxCreateNumericArray((C > 1) ? 3 : 2, H_dim, mask_class, mxREAL);
+
+   // Generate the mask pairs.
+   if(lf_class == mxDOUBLE_CLASS)
+      lf_nmf_pinhole_masks(lf_dim, C, mxGetPr(LF_IN), mxGetPr(W), mxGetPr(H), nthreads);
+   else if(lf_class == mxSINGLE_CLASS)
+      lf_nmf_pinhole_masks(lf_dim, C, (const float*)mxGetData(LF_IN),
+                           (float*)mxGetData(W), (float*)mxGetData(H), nthreads);
+   else{
+      NMFQuantized lf;
+      lf.type    = (lf_class == mxUINT8_CLASS) ? LF_NMF_QUANT_UINT8 : LF_NMF_QUANT_UINT16;
+      lf.data    = mxGetData(LF_IN);
+      lf.gamma   = gamma;
+      lf.gain    = 1;
+      lf.epsilon = 0;
+      lf_nmf_pinhole_masks(lf_dim, C, &lf, mxGetPr(W), mxGetPr(H), nthreads);
+   }
+
+   // Return the mask pairs.
+   W_OUT = W;
+   if(nlhs > 1)
+      H_OUT = H;
+   else
+      mxDestroyArray(H);
+}
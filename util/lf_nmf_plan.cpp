@@ -0,0 +1,84 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_PLAN
+//    Precomputes the neighborhood geometry used by the NMF update rules.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include "lf_nmf_plan.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Create plan for a light field with dimensions lf_dim = [v u b a].
+NMFPlan* lf_nmf_create_plan(const unsigned int* lf_dim){
+   NMFPlan* plan = new NMFPlan;
+   for(int k=0; k<4; k++)
+      plan->lf_dim[k] = lf_dim[k];
+   plan->nAngles[0]     = lf_dim[2];
+   plan->nAngles[1]     = lf_dim[3];
+   plan->nHalfAngles[0] = (lf_dim[2]-1)/2;
+   plan->nHalfAngles[1] = (lf_dim[3]-1)/2;
+   plan->N              = (unsigned long)lf_dim[0]*lf_dim[1];
+   plan->nrays          = plan->N*lf_dim[2]*lf_dim[3];
+   plan->K              = lf_dim[2]*lf_dim[3];
+   int h0 = (int)plan->nHalfAngles[0];
+   int h1 = (int)plan->nHalfAngles[1];
+   long d1 = lf_dim[1];
+
+   // Evaluate range of mask row/column offsets (trimmed at the borders).
+   plan->row_lo.resize(lf_dim[0]);
+   plan->row_hi.resize(lf_dim[0]);
+   for(int t=0; t<(int)lf_dim[0]; t++){
+      plan->row_lo[t] = MAX(0, t-h0)-t;
+      plan->row_hi[t] = MIN((int)lf_dim[0]-1, t+h0)-t;
+   }
+   plan->col_lo.resize(lf_dim[1]);
+   plan->col_hi.resize(lf_dim[1]);
+   for(int s=0; s<(int)lf_dim[1]; s++){
+      plan->col_lo[s] = MAX(0, s-h1)-s;
+      plan->col_hi[s] = MIN((int)lf_dim[1]-1, s+h1)-s;
+   }
+
+   // Evaluate range of mask rows/columns with untrimmed windows.
+   plan->row_in[0] = MIN((unsigned int)h0, lf_dim[0]);
+   plan->row_in[1] = MAX(lf_dim[0]-plan->row_in[0], plan->row_in[0]);
+   plan->col_in[0] = MIN((unsigned int)h1, lf_dim[1]);
+   plan->col_in[1] = MAX(lf_dim[1]-plan->col_in[0], plan->col_in[0]);
+
+   // Evaluate mask and ray offsets for each stencil element.
+   // Note: The k-th neighbor of front pixel (t,s) is the rear pixel
+   //       (t+dv,s+du), which reaches it along the stencil element
+   //       (-dv,-du) of its own bundle (i.e., k_last-k, where k_last is the
+   //       last stencil element). The first view along an axis with an even
+   //       number of views is not part of the stencil (see NMFPlan).
+   long K = plan->K;
+   long k_last = 2*h0*lf_dim[3]+2*h1;
+   plan->ray0 = (lf_dim[2]-1-2*h0)*lf_dim[3]+(lf_dim[3]-1-2*h1);
+   plan->pix_off.resize(K);
+   plan->ray_off_H.resize(K);
+   for(int dv=-h0; dv<=h0; dv++){
+      for(int du=-h1; du<=h1; du++){
+         unsigned int k = (dv+h0)*lf_dim[3]+(du+h1);
+         plan->pix_off[k]   = dv*d1+du;
+         plan->ray_off_H[k] = plan->pix_off[k]*K+plan->ray0+(k_last-k);
+         plan->window.push_back(k);
+      }
+   }
+   return plan;
+}
+
+// Release plan.
+void lf_nmf_destroy_plan(NMFPlan* plan){
+   delete plan;
+}
+
+// Determine if plan matches the given light field dimensions.
+bool lf_nmf_plan_matches(const NMFPlan* plan, const unsigned int* lf_dim){
+   for(int k=0; k<4; k++)
+      if(plan->lf_dim[k] != lf_dim[k])
+         return false;
+   return true;
+}
@@ -0,0 +1,63 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_PLAN
+//    Precomputes the neighborhood geometry used by the NMF update rules.
+//    For a display with nAngles = [vertical horizontal] views, each mask
+//    pixel interacts with a (trimmed) window of nAngles pixels on the
+//    opposite layer. The window offsets, and the corresponding offsets
+//    into the light field, only depend on the light field dimensions, so
+//    a plan can be shared across iterations, color channels and frames.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_PLAN_H
+#define LF_NMF_PLAN_H
+
+// Define included files.
+#include <vector>
+
+// Declare structure for storing the neighborhood geometry.
+// Note: Stencil elements are indexed as k = (dv+nHalfAngles[0])*nAngles[1]+
+//       (du+nHalfAngles[1]), i.e., in the order that neighbors are visited.
+//       Rays are grouped into angular bundles (i.e., the K rays through
+//       each rear mask pixel i, ordered by view q = b*nAngles[1]+a), so that
+//       ray = i*K+q. The k-th neighbor of front mask pixel j is the ray
+//       j*K+ray_off_H[k], and the k-th neighbor of rear mask pixel i is the
+//       ray i*K+ray0+k (i.e., the rays of a bundle are visited in order).
+//       As in the original MEX kernel, neighbor (dv,du) is observed along
+//       view (b,a) = (nAngles[0]-1-nHalfAngles[0]+dv, nAngles[1]-1-
+//       nHalfAngles[1]+du), so ray0 is zero for odd numbers of views, and
+//       skips the first view along each axis with an even number of views
+//       (which the update rule never visits).
+//       Pixels in rows row_in[0]..row_in[1]-1 and columns col_in[0]..
+//       col_in[1]-1 (i.e., the interior) visit every element of "window",
+//       so only a frame of nHalfAngles pixels needs trimmed windows.
+typedef struct {
+   unsigned int      lf_dim[4];      // light field dimensions [v u b a]
+   unsigned int      nAngles[2];     // angular resolution [vertical horizontal]
+   unsigned int      nHalfAngles[2]; // stencil half-width [vertical horizontal]
+   unsigned long     N;              // number of mask pixels
+   unsigned long     nrays;          // number of light field elements
+   unsigned int      K;              // number of views (i.e., rays per bundle)
+   unsigned int      ray0;           // view of the first stencil element
+   std::vector<int>  row_lo;         // first vertical offset (per mask row)
+   std::vector<int>  row_hi;         // last vertical offset (per mask row)
+   std::vector<int>  col_lo;         // first horizontal offset (per mask column)
+   std::vector<int>  col_hi;         // last horizontal offset (per mask column)
+   std::vector<long> pix_off;        // mask index offset (per stencil element)
+   std::vector<long> ray_off_H;      // ray offset from front mask pixel
+   unsigned int      row_in[2];      // first/last+1 row with an untrimmed window
+   unsigned int      col_in[2];      // first/last+1 column with an untrimmed window
+   std::vector<unsigned int> window; // stencil elements of an untrimmed window
+} NMFPlan;
+
+// Create plan for a light field with dimensions lf_dim = [v u b a].
+NMFPlan* lf_nmf_create_plan(const unsigned int* lf_dim);
+
+// Release plan.
+void lf_nmf_destroy_plan(NMFPlan* plan);
+
+// Determine if plan matches the given light field dimensions.
+bool lf_nmf_plan_matches(const NMFPlan* plan, const unsigned int* lf_dim);
+
+#endif
@@ -0,0 +1,239 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_RULES
+//    Update rules (i.e., solver strategies) for the mask pixels. With one
+//    mask fixed, the objective separates into one small least-squares
+//    problem per pixel of the other mask, over the rays through its
+//    (trimmed) window of neighbors. Each rule updates the C*R elements of
+//    one pixel, given the neighbors x[k], light field a[k*C+c], and
+//    reconstruction b[k*C+c] of each of its n rays (see LF_NMF_SIMD), so
+//    every rule shares the stencil geometry of LF_NMF_PLAN. If the Gram
+//    matrices of the window (i.e., G = sum_k x[k]*x[k]' for each channel)
+//    are precomputed, then the reconstruction is not used, and each
+//    denominator reduces to a matrix-vector product. If the right-hand
+//    sides (i.e., p = sum_k a[k]*x[k]) are also precomputed (e.g., for a
+//    fixed front mask), then the rays are not visited at all. Since the
+//    multiplicative rule keeps zero elements at zero, it also skips zero
+//    pixels of sparse masks (see lf_nmf_update_sparse).
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_RULES_H
+#define LF_NMF_RULES_H
+
+// Define included files.
+#include "lf_nmf_simd.h"
+
+// Declare update rule for one mask pixel.
+// Note: "G" holds the C Gram matrices (R x R each) of the window and "p"
+//       the C right-hand sides (R elements each), or either is NULL if not
+//       precomputed (p is only used with G). "work" must hold R*(R+2)
+//       elements, and "inner" is the number of passes over the normal
+//       equations (for rules that use them).
+template<typename T>
+struct NMFRule {
+   typedef void (*Update)(T* y, const T* const* x, const T* a, const T* b,
+                          const T* G, const T* p, unsigned int n, unsigned long R,
+                          unsigned int C, const int* lane, T* work,
+                          unsigned int inner);
+};
+
+// Declare bit masks of the nonzero elements of mask pixels.
+// Note: Element l of a pixel is bit l%64 of word l/64 (i.e., each pixel
+//       spans (C*R+63)/64 words).
+typedef unsigned long long NMFBits;
+
+// Evaluate the bit mask of the nonzero elements of one mask pixel.
+// Note: Returns the number of nonzero elements.
+template<typename T>
+static inline unsigned long lf_nmf_sparse_bits(const T* y, unsigned long L, NMFBits* nz){
+   unsigned long nnz = 0;
+   for(unsigned long w=0; w<(L+63)/64; w++){
+      NMFBits bits = 0;
+      for(unsigned long l=w*64; l<L && l<(w+1)*64; l++){
+         bits |= (NMFBits)(y[l] != 0) << (l-w*64);
+         nnz += (y[l] != 0);
+      }
+      nz[w] = bits;
+   }
+   return nnz;
+}
+
+// Evaluate the normal equations of one channel (i.e., G = sum_k x[k]*x[k]'
+// and p = sum_k a[k]*x[k], over the R elements of channel c).
+// Note: Only p is evaluated if G is NULL.
+template<typename T>
+static inline void lf_nmf_normal(T* G, T* p, const T* const* x, const T* a,
+                                 unsigned int n, unsigned long R, unsigned int C,
+                                 unsigned int c){
+   for(unsigned long r=0; r<R*R && G!=NULL; r++)
+      G[r] = 0;
+   for(unsigned long r=0; r<R; r++)
+      p[r] = 0;
+   for(unsigned int k=0; k<n; k++){
+      const T* x_k = x[k]+c*R;
+      T a_k = a[k*C+c];
+      if(G == NULL){
+         for(unsigned long r=0; r<R; r++)
+            p[r] += a_k*x_k[r];
+         continue;
+      }
+      for(unsigned long r=0; r<R; r++){
+         T x_r = x_k[r];
+         T* G_r = G+r*R;
+         p[r] += a_k*x_r;
+         for(unsigned long s=0; s<R; s++)
+            G_r[s] += x_r*x_k[s];
+      }
+   }
+}
+
+// Select the normal equations of one channel (precomputed, or evaluated in
+// "work" from the rays).
+template<typename T>
+static inline void lf_nmf_select_normal(const T** G_c, const T** p_c,
+                                        const T* G, const T* p, const T* const* x,
+                                        const T* a, unsigned int n, unsigned long R,
+                                        unsigned int C, unsigned int c, T* work){
+   if(G == NULL){
+      lf_nmf_normal(work, work+R*R, x, a, n, R, C, c);
+      *G_c = work;
+      *p_c = work+R*R;
+      return;
+   }
+   *G_c = G+c*R*R;
+   if(p != NULL){
+      *p_c = p+c*R;
+      return;
+   }
+   lf_nmf_normal((T*)NULL, work+R*R, x, a, n, R, C, c);
+   *p_c = work+R*R;
+}
+
+// Evaluate the product of a Gram matrix and one channel (i.e., Gy = G*y).
+// Note: Accumulates the columns of G (i.e., its rows, since G is symmetric),
+//       so the inner loop vectorizes without horizontal sums.
+template<typename T>
+static inline void lf_nmf_gram_product(T* Gy, const T* G, const T* y, unsigned long R){
+   for(unsigned long r=0; r<R; r++)
+      Gy[r] = 0;
+   for(unsigned long s=0; s<R; s++){
+      const T* G_s = G+s*R;
+      T y_s = y[s];
+      for(unsigned long r=0; r<R; r++)
+         Gy[r] += G_s[r]*y_s;
+   }
+}
+
+// Apply the multiplicative update rule (see LF_NMF_SIMD).
+// Note: With precomputed Gram matrices, evaluates y = min(y.*p./(G*y), 1),
+//       with NaN replaced by one.
+template<typename T>
+static void lf_nmf_update_mu(T* y, const T* const* x, const T* a, const T* b,
+                             const T* G, const T* p, unsigned int n, unsigned long R,
+                             unsigned int C, const int* lane, T* work, unsigned int){
+   if(G == NULL){
+      lf_nmf_update(y, x, a, b, n, R, C, lane);
+      return;
+   }
+   T* den = work+R*R+R;
+   for(unsigned int c=0; c<C; c++){
+      T* y_c = y+c*R;
+      const T *G_c, *p_c;
+      lf_nmf_select_normal(&G_c, &p_c, G, p, x, a, n, R, C, c, work);
+      lf_nmf_gram_product(den, G_c, y_c, R);
+      for(unsigned long r=0; r<R; r++){
+         T v = y_c[r]*(p_c[r]/den[r]);
+         y_c[r] = (v > 1 || v != v) ? 1 : v;
+      }
+   }
+}
+
+// Apply the multiplicative update rule, skipping zero pixels.
+// Note: "nz_y" and "nz_x" hold the bit masks of y and each neighbor (see
+//       NMFBits), and "channel_bits" those of each channel (i.e., nwords
+//       words per channel). Neighbors without nonzero elements must be
+//       omitted by the caller, since they only add zero terms. If y has no
+//       nonzero elements, then its numerators are not evaluated: since the
+//       masks and the reconstruction are nonnegative, an element only
+//       changes if its denominator is zero (i.e., if none of its nonzero
+//       neighbors has a positive reconstruction), in which case its ratio is
+//       NaN and it is set to one. Otherwise, the dense kernel is applied (see
+//       LF_NMF_SIMD), so the result is identical. "D" must hold nwords
+//       elements.
+template<typename T>
+static void lf_nmf_update_sparse(T* y, const NMFBits* nz_y, const T* const* x,
+                                 const NMFBits* const* nz_x, const T* a, const T* b,
+                                 unsigned int n, unsigned long R, unsigned int C,
+                                 unsigned long nwords, const NMFBits* channel_bits,
+                                 const int* lane, NMFBits* D){
+   for(unsigned long w=0; w<nwords; w++){
+      if(nz_y[w] != 0){
+         lf_nmf_update(y, x, a, b, n, R, C, lane);
+         return;
+      }
+      D[w] = 0;
+   }
+   for(unsigned int k=0; k<n; k++)
+      for(unsigned int c=0; c<C; c++)
+         if(b[k*C+c] > 0)
+            for(unsigned long w=0; w<nwords; w++)
+               D[w] |= nz_x[k][w] & channel_bits[c*nwords+w];
+   for(unsigned int c=0; c<C; c++)
+      for(unsigned long w=0; w<nwords; w++)
+         for(NMFBits bits=channel_bits[c*nwords+w] & ~D[w]; bits!=0; bits&=bits-1)
+            y[w*64+lf_nmf_ctz(bits)] = 1;
+}
+
+// Apply hierarchical alternating least squares (HALS).
+// Note: Minimizes the error of the pixel's rays one element at a time,
+//       i.e., y[r] = min(max(y[r]+(p[r]-G(r,:)*y)/G(r,r), 0), 1), which
+//       enforces the box constraint [0,1] exactly (unlike the multiplicative
+//       rule, elements can leave zero). Elements without any contribution
+//       (i.e., G(r,r) = 0) are left unchanged.
+template<typename T>
+static void lf_nmf_update_hals(T* y, const T* const* x, const T* a, const T*,
+                               const T* G_win, const T* p_win, unsigned int n,
+                               unsigned long R, unsigned int C, const int*,
+                               T* work, unsigned int inner){
+   for(unsigned int c=0; c<C; c++){
+      T* y_c = y+c*R;
+      const T *G, *p;
+      lf_nmf_select_normal(&G, &p, G_win, p_win, x, a, n, R, C, c, work);
+      for(unsigned int it=0; it<inner; it++){
+         for(unsigned long r=0; r<R; r++){
+            if(!(G[r*R+r] > 0))
+               continue;
+            T v = y_c[r]+(p[r]-lf_nmf_dot(G+r*R, y_c, R))/G[r*R+r];
+            y_c[r] = (v < 0) ? 0 : ((v > 1) ? 1 : v);
+         }
+      }
+   }
+}
+
+// Apply the accelerated multiplicative update rule.
+// Note: Repeats the multiplicative update "inner" times using the normal
+//       equations (i.e., y = min(y.*p./(G*y), 1), with NaN replaced by one),
+//       so the cost of visiting the rays is shared by several updates. The
+//       first pass matches the multiplicative update rule.
+template<typename T>
+static void lf_nmf_update_amu(T* y, const T* const* x, const T* a, const T*,
+                              const T* G_win, const T* p_win, unsigned int n,
+                              unsigned long R, unsigned int C, const int*,
+                              T* work, unsigned int inner){
+   T* den = work+R*R+R;
+   for(unsigned int c=0; c<C; c++){
+      T* y_c = y+c*R;
+      const T *G, *p;
+      lf_nmf_select_normal(&G, &p, G_win, p_win, x, a, n, R, C, c, work);
+      for(unsigned int it=0; it<inner; it++){
+         lf_nmf_gram_product(den, G, y_c, R);
+         for(unsigned long r=0; r<R; r++){
+            T v = y_c[r]*(p[r]/den[r]);
+            y_c[r] = (v > 1 || v != v) ? 1 : v;
+         }
+      }
+   }
+}
+
+#endif
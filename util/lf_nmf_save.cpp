@@ -0,0 +1,283 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_SAVE
+//    Writes mask pairs as images for the player (see lf_nmf_save.h).
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <math.h>
+#include <stdio.h>
+#include <float.h>
+#include <setjmp.h>
+#include <cstring>
+#include <png.h>
+#include "lf_nmf_save.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Define tolerance of the vectorized gamma compression (see quantize).
+#define NMF_SAVE_ROUND_TOL 1e-3
+
+// Declare auxiliary functions.
+static bool write_png(const char*, const NMFMaskSet*, unsigned long, bool, std::string*);
+static void gamma_compress(const double*, float*, unsigned int, double);
+static void quantize(const double*, const float*, unsigned char*, unsigned int, double);
+
+// Create background threads.
+NMFMaskWriter::NMFMaskWriter(unsigned int nthreads) :
+   pending(0), stop(false){
+   if(nthreads == 0)
+      nthreads = 1;
+   for(unsigned int i=0; i<nthreads; i++)
+      threads.push_back(std::thread(&NMFMaskWriter::worker, this));
+}
+
+// Wait for queued images, then stop and join background threads.
+NMFMaskWriter::~NMFMaskWriter(){
+   {
+      std::unique_lock<std::mutex> lock(mutex);
+      done_cv.wait(lock, [this]{ return pending == 0; });
+      stop = true;
+   }
+   task_cv.notify_all();
+   for(unsigned int i=0; i<threads.size(); i++)
+      threads[i].join();
+}
+
+// Queue the mask pairs for writing (for each mask type).
+void NMFMaskWriter::write(const char* W_pattern, const char* H_pattern, const unsigned int* res,
+                          unsigned int C, const double* W, const double* H, unsigned long R,
+                          double gamma){
+   std::shared_ptr<NMFMaskSet> set(new NMFMaskSet);
+   unsigned long numel = (unsigned long)res[0]*res[1]*R*C;
+   set->W.assign(W, W+numel);
+   set->H.assign(H, H+numel);
+   set->W_pattern = W_pattern;
+   set->H_pattern = H_pattern;
+   set->res[0] = res[0];
+   set->res[1] = res[1];
+   set->C      = C;
+   set->R      = R;
+   set->gamma  = gamma;
+   queue(set);
+}
+void NMFMaskWriter::write(const char* W_pattern, const char* H_pattern, const unsigned int* res,
+                          unsigned int C, const float* W, const float* H, unsigned long R,
+                          double gamma){
+   std::shared_ptr<NMFMaskSet> set(new NMFMaskSet);
+   unsigned long numel = (unsigned long)res[0]*res[1]*R*C;
+   set->W.assign(W, W+numel);
+   set->H.assign(H, H+numel);
+   set->W_pattern = W_pattern;
+   set->H_pattern = H_pattern;
+   set->res[0] = res[0];
+   set->res[1] = res[1];
+   set->C      = C;
+   set->R      = R;
+   set->gamma  = gamma;
+   queue(set);
+}
+
+// Queue one task per image (rear masks first).
+void NMFMaskWriter::queue(const std::shared_ptr<NMFMaskSet>& set){
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(int front=0; front<2; front++){
+         for(unsigned long k=0; k<set->R; k++){
+            Task task = {set, k, front != 0};
+            tasks.push_back(task);
+         }
+      }
+      pending += 2*set->R;
+   }
+   task_cv.notify_all();
+}
+
+// Wait for every queued image.
+bool NMFMaskWriter::wait(char* msg){
+   std::unique_lock<std::mutex> lock(mutex);
+   done_cv.wait(lock, [this]{ return pending == 0; });
+   if(error.empty())
+      return true;
+   if(msg != NULL)
+      snprintf(msg, 1024, "%s", error.c_str());
+   else
+      fprintf(stderr, "%s\n", error.c_str());
+   error.clear();
+   return false;
+}
+
+// Encode and write queued images (until stopped).
+// Note: The mask set is released with its last task.
+void NMFMaskWriter::worker(){
+   for(;;){
+      Task task;
+      {
+         std::unique_lock<std::mutex> lock(mutex);
+         task_cv.wait(lock, [this]{ return stop || !tasks.empty(); });
+         if(tasks.empty())
+            return;
+         task = tasks.front();
+         tasks.pop_front();
+      }
+      std::string msg;
+      bool ok = write_png(task.front ? task.set->H_pattern.c_str() : task.set->W_pattern.c_str(),
+                          task.set.get(), task.k, task.front, &msg);
+      task.set.reset();
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         if(!ok && error.empty())
+            error = msg;
+         pending--;
+      }
+      done_cv.notify_all();
+   }
+}
+
+// Write the properties of a set of mask pairs.
+// Note: Lines end with CR-LF, as written by generate_masks.m.
+bool lf_nmf_write_properties(const char* filename, const char* type,
+                             unsigned long R, const unsigned int* nAngles){
+   FILE* fid = fopen(filename, "wb");
+   if(fid == NULL){
+      fprintf(stderr, "Could not open %s for writing.\n", filename);
+      return false;
+   }
+   fprintf(fid, "type = %s\r\nrank = %.2lu\r\nhorizontal views = %.2u\r\nvertical views = %.2u\r\n",
+           type, R, nAngles[1], nAngles[0]);
+   return fclose(fid) == 0;
+}
+
+// Write one mask as an 8-bit image (gray or RGB).
+// Note: Rear mask k is stored as column k of each channel (i.e., rows are
+//       contiguous), and front mask k as row k (i.e., pixels are strided
+//       by R). Uses the low-level interface, so that no object with a
+//       destructor is created after SETJMP.
+static bool write_png(const char* pattern, const NMFMaskSet* set, unsigned long k,
+                      bool front, std::string* error){
+   char filename[1024];
+   snprintf(filename, sizeof(filename), pattern, (int)(k+1));
+   unsigned int width = set->res[1], C = set->C;
+   unsigned long N = (unsigned long)set->res[0]*width, R = set->R;
+   std::vector<double> row(width*C);
+   std::vector<float> code(width*C);
+   std::vector<unsigned char> pixels(width*C);
+   FILE* fid = fopen(filename, "wb");
+   if(fid == NULL){
+      *error = std::string("Cannot open ")+filename+" for writing";
+      return false;
+   }
+   png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+   png_infop info = (png != NULL) ? png_create_info_struct(png) : NULL;
+   if(info == NULL || setjmp(png_jmpbuf(png))){
+      png_destroy_write_struct(&png, &info);
+      fclose(fid);
+      *error = std::string("Cannot write ")+filename;
+      return false;
+   }
+   png_init_io(png, fid);
+   png_set_IHDR(png, info, width, set->res[0], 8,
+                (C == 3) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+   png_write_info(png, info);
+   for(unsigned int y=0; y<set->res[0]; y++){
+      for(unsigned int ch=0; ch<C; ch++){
+         if(front){
+            const double* H_y = &set->H[ch*N*R+(unsigned long)y*width*R+k];
+            for(unsigned int x=0; x<width; x++)
+               row[x*C+ch] = H_y[(unsigned long)x*R];
+         }
+         else{
+            const double* W_y = &set->W[ch*N*R+k*N+(unsigned long)y*width];
+            for(unsigned int x=0; x<width; x++)
+               row[x*C+ch] = W_y[x];
+         }
+      }
+      gamma_compress(&row[0], &code[0], width*C, 1/set->gamma);
+      quantize(&row[0], &code[0], &pixels[0], width*C, 1/set->gamma);
+      png_write_row(png, &pixels[0]);
+   }
+   png_write_end(png, NULL);
+   png_destroy_write_struct(&png, &info);
+   if(fclose(fid) != 0){
+      *error = std::string("Cannot write ")+filename;
+      return false;
+   }
+   return true;
+}
+
+// Evaluate 255*x^p+0.5 for x in (0,1) (i.e., the unrounded 8-bit code).
+// Note: Evaluated in single precision as 2^(p*log2(x)) with polynomial
+//       approximations (i.e., without calls to POW), so that the loop is
+//       vectorized. The absolute error of the code is below 1e-4. Other
+//       elements (e.g., zero, or not-a-number) yield arbitrary values,
+//       which are replaced by quantize(). Elements are clamped through
+//       their bits (i.e., positive floats are ordered as integers), and
+//       to at least 2^(-126/p), so that 2^t remains a normal float.
+static void gamma_compress(const double* x, float* code, unsigned int n, double p){
+   const float c1 = (float)(2/M_LN2), c3 = c1/3, c5 = c1/5, c7 = c1/7, c9 = c1/9;
+   const float ln2 = (float)M_LN2, pf = (float)p;
+   float x_min = (float)MAX(pow(2.0, -125/p), (double)FLT_MIN);
+   unsigned int u_min, u_max = 0x3F800000;
+   memcpy(&u_min, &x_min, sizeof(u_min));
+   for(unsigned int i=0; i<n; i++){
+
+      // Evaluate log2(x) (i.e., the exponent plus the log of the mantissa).
+      // Note: The mantissa is centered on one (i.e., in [sqrt(1/2),sqrt(2))),
+      //       and its log is evaluated by the series of atanh.
+      float xi = (float)x[i];
+      unsigned int u;
+      memcpy(&u, &xi, sizeof(u));
+      u = (u > u_min) ? u : u_min;
+      u = (u < u_max) ? u : u_max;
+      int e = (int)(u >> 23)-127;
+      u = (u & 0x007FFFFF) | 0x3F800000;
+      float large = (float)(u > 0x3FB504F3);
+      float m;
+      memcpy(&m, &u, sizeof(m));
+      m *= 1-0.5f*large;
+      float s  = (m-1)/(m+1);
+      float s2 = s*s;
+      float t  = pf*((float)e+large+s*(c1+s2*(c3+s2*(c5+s2*(c7+s2*c9)))));
+
+      // Evaluate 2^t (i.e., the integer part as an exponent, and the
+      // fractional part by its Taylor series).
+      // Note: The integer part is truncated and corrected, rather than
+      //       evaluated by FLOORF (which is not vectorized by default).
+      int ti = (int)t;
+      ti -= (t < (float)ti);
+      float f = (t-(float)ti)*ln2;
+      float y = 1+f*(1+f*(1.0f/2+f*(1.0f/6+f*(1.0f/24+f*(1.0f/120+f*(1.0f/720+
+                f*(1.0f/5040+f*(1.0f/40320+f*(1.0f/362880)))))))));
+      unsigned int scale_bits = (unsigned int)(ti+127) << 23;
+      float scale;
+      memcpy(&scale, &scale_bits, sizeof(scale));
+      code[i] = 255*y*scale+0.5f;
+   }
+}
+
+// Quantize gamma-compressed elements to 8 bits (i.e., as Matlab's UINT8).
+// Note: Elements that are not positive (or not-a-number) map to zero, and
+//       elements above one saturate. Codes within NMF_SAVE_ROUND_TOL of a
+//       rounding boundary are evaluated exactly (i.e., using POW), so that
+//       the approximation of gamma_compress() never changes the result.
+static void quantize(const double* x, const float* code, unsigned char* pixels,
+                     unsigned int n, double p){
+   for(unsigned int i=0; i<n; i++){
+      if(!(x[i] > 0))
+         pixels[i] = 0;
+      else if(x[i] >= 1)
+         pixels[i] = 255;
+      else{
+         double c = code[i], fc = floor(c);
+         if(c-fc < NMF_SAVE_ROUND_TOL || c-fc > 1-NMF_SAVE_ROUND_TOL){
+            c  = 255*pow(x[i], p)+0.5;
+            fc = floor(c);
+         }
+         pixels[i] = (unsigned char)((fc < 255) ? fc : 255);
+      }
+   }
+}
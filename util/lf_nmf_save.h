@@ -0,0 +1,90 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_SAVE
+//    Writes mask pairs as images for the player, as done by
+//    generate_masks.m: mask k is written to "W/k.png" and "H/k.png" (with
+//    one channel per color channel), after gamma compression for the
+//    display (i.e., raised to 1/outGamma) and 8-bit quantization (i.e.,
+//    rounded as Matlab's UINT8). The images are encoded and written by
+//    background threads, so that the caller can proceed (e.g., with the
+//    next channel or scene) while the masks are saved.
+//
+//    Requires libpng (i.e., link with -lpng).
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_SAVE_H
+#define LF_NMF_SAVE_H
+
+// Define included files.
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Declare structure for storing one set of queued mask pairs.
+// Note: The masks are copied when queued (in the layout of the solver,
+//       i.e., N x R x C rear masks and R x N x C front masks), so that
+//       the caller can release (or update) its masks immediately.
+typedef struct {
+   std::string          W_pattern;  // file name pattern of the rear masks (e.g., "W/%d.png")
+   std::string          H_pattern;  // file name pattern of the front masks (e.g., "H/%d.png")
+   unsigned int         res[2];     // mask resolution [height width]
+   unsigned int         C;          // number of channels (1 or 3)
+   unsigned long        R;          // number of mask pairs
+   double               gamma;      // gamma-correction value of the display
+   std::vector<double>  W;          // rear masks
+   std::vector<double>  H;          // front masks
+} NMFMaskSet;
+
+// Declare asynchronous mask writer.
+// Note: Each image is one task, taken by the first idle background
+//       thread. Failures are reported by the next call to wait(); the
+//       destructor waits for every queued image.
+class NMFMaskWriter {
+public:
+   NMFMaskWriter(unsigned int nthreads);
+   ~NMFMaskWriter();
+
+   // Queue the mask pairs for writing (returns once they are copied).
+   // Note: Mask k (1-based) is written to the pattern formatted with k.
+   void write(const char* W_pattern, const char* H_pattern, const unsigned int* res,
+              unsigned int C, const double* W, const double* H, unsigned long R, double gamma);
+   void write(const char* W_pattern, const char* H_pattern, const unsigned int* res,
+              unsigned int C, const float* W, const float* H, unsigned long R, double gamma);
+
+   // Wait for every queued image (returns false if any failed since the
+   // previous call, with the first message in "error", unless NULL).
+   bool wait(char* error);
+
+   // Return number of background threads.
+   unsigned int size() const { return (unsigned int)threads.size(); }
+
+private:
+   struct Task {
+      std::shared_ptr<NMFMaskSet> set;
+      unsigned long               k;
+      bool                        front;
+   };
+   void worker();
+   void queue(const std::shared_ptr<NMFMaskSet>& set);
+
+   std::vector<std::thread>  threads;
+   std::mutex                mutex;
+   std::condition_variable   task_cv;
+   std::condition_variable   done_cv;
+   std::deque<Task>          tasks;
+   unsigned long             pending;
+   std::string               error;
+   bool                      stop;
+};
+
+// Write the properties of a set of mask pairs (e.g., "masks/NMF/properties.txt").
+// Note: "type" is "pinhole" or "NMF", and nAngles = [vertical horizontal].
+bool lf_nmf_write_properties(const char* filename, const char* type,
+                             unsigned long R, const unsigned int* nAngles);
+
+#endif
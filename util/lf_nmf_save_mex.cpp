@@ -0,0 +1,112 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_SAVE_MEX
+//    Writes mask pairs as images for the player in the background (see
+//    LF_NMF_SAVE). Replaces the mask writing loops of generate_masks.m.
+//    Writes are queued and return immediately; "wait" returns once every
+//    queued image is written (and reports the first failure, if any).
+//
+//    lf_nmf_save_mex('write',Wpattern,Hpattern,res,W,H,outGamma,numThreads)
+//    lf_nmf_save_mex('wait')
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <stdio.h>
+#include <cstring>
+#include "mex.h"
+#include "lf_nmf_save.h"
+#include "lf_nmf_threads.h"
+
+// Define pointers to input arguments.
+#define COMMAND_IN   prhs[0] // (input) command ('write' or 'wait')
+#define W_PATTERN_IN prhs[1] // (input) file name pattern of the rear masks (e.g., './masks/NMF/W/%d.png')
+#define H_PATTERN_IN prhs[2] // (input) file name pattern of the front masks (e.g., './masks/NMF/H/%d.png')
+#define RES_IN       prhs[3] // (input) display resolution [height width]
+#define W_IN         prhs[4] // (input) rear masks (N x R x ch)
+#define H_IN         prhs[5] // (input) front masks (R x N x ch)
+#define GAMMA_IN     prhs[6] // (input) gamma-correction value of the display
+#define THREADS_IN   prhs[7] // (input) number of background threads (0: all hardware threads)
+
+// Declare auxiliary functions.
+static void mex_release_writer();
+
+// Define persistent mask writer.
+// Note: The writer (and its threads) outlive each call, so that images
+//       are written while Matlab proceeds. It is created by the first
+//       write, and released (once every image is written) on exit.
+static NMFMaskWriter* writer = NULL;
+
+// Define MEX-file gateway routine.
+void mexFunction(
+    int nlhs, mxArray* plhs[],
+    int nrhs, const mxArray* prhs[]){
+
+   // Parse command.
+   char command[16] = "";
+   if(nrhs < 1 || !mxIsChar(COMMAND_IN))
+      mexErrMsgTxt("First input argument must be a command ('write' or 'wait').");
+   mxGetString(COMMAND_IN, command, sizeof(command));
+
+   // Wait for every queued image.
+   if(!strcmp(command, "wait")){
+      char error[1024];
+      if(writer != NULL && !writer->wait(error))
+         mexErrMsgTxt(error);
+      return;
+   }
+   if(strcmp(command, "write"))
+      mexErrMsgTxt("Command must be 'write' or 'wait'.");
+
+   // Verify input arguments.
+   if(nrhs < 7 || nrhs > 8)
+      mexErrMsgTxt("Incorrect number of input arguments (i.e., expected seven or eight).");
+   char W_pattern[1024], H_pattern[1024];
+   if(!mxIsChar(W_PATTERN_IN) || mxGetString(W_PATTERN_IN, W_pattern, sizeof(W_pattern)) ||
+      !mxIsChar(H_PATTERN_IN) || mxGetString(H_PATTERN_IN, H_pattern, sizeof(H_pattern)))
+      mexErrMsgTxt("File name patterns must be strings.");
+   if(!mxIsDouble(RES_IN) || mxGetNumberOfElements(RES_IN) != 2)
+      mexErrMsgTxt("Display resolution must be a double vector with two elements.");
+   unsigned int res[2] = {(unsigned int)mxGetPr(RES_IN)[0], (unsigned int)mxGetPr(RES_IN)[1]};
+   mwSize N = (mwSize)res[0]*res[1];
+   mxClassID mask_class = mxGetClassID(W_IN);
+   if((mask_class != mxDOUBLE_CLASS && mask_class != mxSINGLE_CLASS) ||
+      mxGetClassID(H_IN) != mask_class)
+      mexErrMsgTxt("Masks must be both double or both single.");
+   unsigned int C = (mxGetNumberOfDimensions(W_IN) > 2) ? (unsigned int)mxGetDimensions(W_IN)[2] : 1;
+   mwSize R = (N > 0 && C > 0) ? mxGetNumberOfElements(W_IN)/(N*C) : 0;
+   if(N == 0 || (C != 1 && C != 3) || mxGetDimensions(W_IN)[0] != N ||
+      mxGetNumberOfElements(W_IN) != N*R*C || mxGetDimensions(H_IN)[1] != N ||
+      mxGetNumberOfElements(H_IN) != N*R*C)
+      mexErrMsgTxt("Masks must have dimensions N x R x ch and R x N x ch (with one or three channels).");
+   if(!mxIsDouble(GAMMA_IN) || mxGetNumberOfElements(GAMMA_IN) != 1)
+      mexErrMsgTxt("Gamma-correction value must be a double scalar.");
+   double gamma = mxGetScalar(GAMMA_IN);
+   unsigned int nthreads = 0;
+   if(nrhs == 8){
+      if(!mxIsNumeric(THREADS_IN) || mxGetNumberOfElements(THREADS_IN) != 1)
+         mexErrMsgTxt("Number of threads must be a numerical scalar.");
+      nthreads = (unsigned int)mxGetScalar(THREADS_IN);
+   }
+
+   // Create the mask writer (unless created by a previous call).
+   if(writer == NULL){
+      writer = new NMFMaskWriter((nthreads > 0) ? nthreads : lf_nmf_default_threads());
+      mexAtExit(mex_release_writer);
+   }
+
+   // Queue the mask pairs (i.e., copy them, and return).
+   if(mask_class == mxDOUBLE_CLASS)
+      writer->write(W_pattern, H_pattern, res, C, mxGetPr(W_IN), mxGetPr(H_IN), R, gamma);
+   else
+      writer->write(W_pattern, H_pattern, res, C, (const float*)mxGetData(W_IN),
+                    (const float*)mxGetData(H_IN), R, gamma);
+}
+
+// Release the mask writer (once every queued image is written).
+static void mex_release_writer(){
+   if(writer != NULL){
+      delete writer;
+      writer = NULL;
+   }
+}
@@ -0,0 +1,347 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_SIMD
+//    Vectorized kernels for the NMF update rules. Each kernel operates on
+//    R contiguous elements (i.e., one element per mask pair), and is
+//    defined for single and double precision. AVX-512 or AVX2 kernels are
+//    selected at compile time (e.g., using -march=native), otherwise the
+//    kernels reduce to scalar loops.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_SIMD_H
+#define LF_NMF_SIMD_H
+
+// Define included files.
+#if defined(__AVX512F__) || defined(__AVX2__)
+   #include <immintrin.h>
+#endif
+
+// Define name of the instruction set used by the kernels.
+#if defined(__AVX512F__)
+   #define LF_NMF_SIMD "AVX-512"
+#elif defined(__AVX2__)
+   #define LF_NMF_SIMD "AVX2"
+#else
+   #define LF_NMF_SIMD "scalar"
+#endif
+
+// Define fused multiply-add for AVX2 (if supported).
+#if !defined(__AVX512F__) && defined(__AVX2__)
+   #ifdef __FMA__
+      #define LF_NMF_FMADD_PS(a,b,c) _mm256_fmadd_ps(a,b,c)
+      #define LF_NMF_FMADD_PD(a,b,c) _mm256_fmadd_pd(a,b,c)
+   #else
+      #define LF_NMF_FMADD_PS(a,b,c) _mm256_add_ps(_mm256_mul_ps(a,b),c)
+      #define LF_NMF_FMADD_PD(a,b,c) _mm256_add_pd(_mm256_mul_pd(a,b),c)
+   #endif
+#endif
+
+// Apply the multiplicative update rule for one mask pixel.
+// Note: Evaluates y = min(y.*(sum_k a[k]*x[k])./(sum_k b[k]*x[k]), 1), where
+//       x[k] points to the R elements of the k-th neighbor. Numerators and
+//       denominators are accumulated in registers. Undefined ratios (i.e.,
+//       NaN) are replaced by one, since the vector minimum returns its
+//       second operand if either operand is NaN.
+static inline void lf_nmf_update(
+        float* y, const float* const* x,
+        const float* a, const float* b, unsigned int n, unsigned long R){
+   unsigned long r = 0;
+#if defined(__AVX512F__)
+   __m512 one = _mm512_set1_ps(1.0f);
+   for(; r<R; r+=16){
+      __mmask16 m = (R-r >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u<<(R-r))-1);
+      __m512 num = _mm512_setzero_ps();
+      __m512 den = _mm512_setzero_ps();
+      for(unsigned int k=0; k<n; k++){
+         __m512 vx = _mm512_maskz_loadu_ps(m, x[k]+r);
+         num = _mm512_fmadd_ps(vx, _mm512_set1_ps(a[k]), num);
+         den = _mm512_fmadd_ps(vx, _mm512_set1_ps(b[k]), den);
+      }
+      __m512 vy = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, y+r), _mm512_div_ps(num, den));
+      _mm512_mask_storeu_ps(y+r, m, _mm512_maskz_min_ps(m, vy, one));
+   }
+#elif defined(__AVX2__)
+   __m256 one = _mm256_set1_ps(1.0f);
+   for(; r+8<=R; r+=8){
+      __m256 num = _mm256_setzero_ps();
+      __m256 den = _mm256_setzero_ps();
+      for(unsigned int k=0; k<n; k++){
+         __m256 vx = _mm256_loadu_ps(x[k]+r);
+         num = LF_NMF_FMADD_PS(vx, _mm256_set1_ps(a[k]), num);
+         den = LF_NMF_FMADD_PS(vx, _mm256_set1_ps(b[k]), den);
+      }
+      __m256 vy = _mm256_mul_ps(_mm256_loadu_ps(y+r), _mm256_div_ps(num, den));
+      _mm256_storeu_ps(y+r, _mm256_min_ps(vy, one));
+   }
+#endif
+   for(; r<R; r++){
+      float num = 0;
+      float den = 0;
+      for(unsigned int k=0; k<n; k++){
+         num += x[k][r]*a[k];
+         den += x[k][r]*b[k];
+      }
+      float vy = y[r]*(num/den);
+      y[r] = (vy > 1.0f || vy != vy) ? 1.0f : vy;
+   }
+}
+
+// Apply the multiplicative update rule for one mask pixel.
+static inline void lf_nmf_update(
+        double* y, const double* const* x,
+        const double* a, const double* b, unsigned int n, unsigned long R){
+   unsigned long r = 0;
+#if defined(__AVX512F__)
+   __m512d one = _mm512_set1_pd(1.0);
+   for(; r<R; r+=8){
+      __mmask8 m = (R-r >= 8) ? (__mmask8)0xFF : (__mmask8)((1u<<(R-r))-1);
+      __m512d num = _mm512_setzero_pd();
+      __m512d den = _mm512_setzero_pd();
+      for(unsigned int k=0; k<n; k++){
+         __m512d vx = _mm512_maskz_loadu_pd(m, x[k]+r);
+         num = _mm512_fmadd_pd(vx, _mm512_set1_pd(a[k]), num);
+         den = _mm512_fmadd_pd(vx, _mm512_set1_pd(b[k]), den);
+      }
+      __m512d vy = _mm512_mul_pd(_mm512_maskz_loadu_pd(m, y+r), _mm512_div_pd(num, den));
+      _mm512_mask_storeu_pd(y+r, m, _mm512_maskz_min_pd(m, vy, one));
+   }
+#elif defined(__AVX2__)
+   __m256d one = _mm256_set1_pd(1.0);
+   for(; r+4<=R; r+=4){
+      __m256d num = _mm256_setzero_pd();
+      __m256d den = _mm256_setzero_pd();
+      for(unsigned int k=0; k<n; k++){
+         __m256d vx = _mm256_loadu_pd(x[k]+r);
+         num = LF_NMF_FMADD_PD(vx, _mm256_set1_pd(a[k]), num);
+         den = LF_NMF_FMADD_PD(vx, _mm256_set1_pd(b[k]), den);
+      }
+      __m256d vy = _mm256_mul_pd(_mm256_loadu_pd(y+r), _mm256_div_pd(num, den));
+      _mm256_storeu_pd(y+r, _mm256_min_pd(vy, one));
+   }
+#endif
+   for(; r<R; r++){
+      double num = 0;
+      double den = 0;
+      for(unsigned int k=0; k<n; k++){
+         num += x[k][r]*a[k];
+         den += x[k][r]*b[k];
+      }
+      double vy = y[r]*(num/den);
+      y[r] = (vy > 1.0 || vy != vy) ? 1.0 : vy;
+   }
+}
+
+// Define number of elements that the multi-channel kernels may read past
+// the channel values of each ray (i.e., required padding of "a" and "b").
+#define LF_NMF_SIMD_PAD 16
+
+// Apply the multiplicative update rule for one mask pixel (C channels).
+// Note: The pixel holds the R elements of each channel in turn (i.e., C*R
+//       elements), and lane[l] is the channel of the l-th element (padded
+//       to a multiple of LF_NMF_SIMD_PAD). The c-th channel of the k-th ray
+//       is a[k*C+c] (or b[k*C+c]). Channel values are permuted into the
+//       lanes of each vector, so that several channels share one vector
+//       (e.g., three channels with rank three fill nine lanes).
+static inline void lf_nmf_update(
+        float* y, const float* const* x, const float* a, const float* b,
+        unsigned int n, unsigned long R, unsigned int C, const int* lane){
+   if(C == 1){
+      lf_nmf_update(y, x, a, b, n, R);
+      return;
+   }
+   unsigned long L = C*R;
+   unsigned long l = 0;
+#if defined(__AVX512F__)
+   __m512 one = _mm512_set1_ps(1.0f);
+   for(; l<L && C<=16; l+=16){
+      __mmask16 m = (L-l >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u<<(L-l))-1);
+      __m512i idx = _mm512_loadu_si512((const void*)(lane+l));
+      __m512 num = _mm512_setzero_ps();
+      __m512 den = _mm512_setzero_ps();
+      for(unsigned int k=0; k<n; k++){
+         __m512 vx = _mm512_maskz_loadu_ps(m, x[k]+l);
+         num = _mm512_fmadd_ps(vx, _mm512_maskz_permutexvar_ps(0xFFFF, idx, _mm512_loadu_ps(a+k*C)), num);
+         den = _mm512_fmadd_ps(vx, _mm512_maskz_permutexvar_ps(0xFFFF, idx, _mm512_loadu_ps(b+k*C)), den);
+      }
+      __m512 vy = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, y+l), _mm512_div_ps(num, den));
+      _mm512_mask_storeu_ps(y+l, m, _mm512_maskz_min_ps(m, vy, one));
+   }
+#elif defined(__AVX2__)
+   __m256 one = _mm256_set1_ps(1.0f);
+   for(; l+8<=L && C<=8; l+=8){
+      __m256i idx = _mm256_loadu_si256((const __m256i*)(lane+l));
+      __m256 num = _mm256_setzero_ps();
+      __m256 den = _mm256_setzero_ps();
+      for(unsigned int k=0; k<n; k++){
+         __m256 vx = _mm256_loadu_ps(x[k]+l);
+         num = LF_NMF_FMADD_PS(vx, _mm256_permutevar8x32_ps(_mm256_loadu_ps(a+k*C), idx), num);
+         den = LF_NMF_FMADD_PS(vx, _mm256_permutevar8x32_ps(_mm256_loadu_ps(b+k*C), idx), den);
+      }
+      __m256 vy = _mm256_mul_ps(_mm256_loadu_ps(y+l), _mm256_div_ps(num, den));
+      _mm256_storeu_ps(y+l, _mm256_min_ps(vy, one));
+   }
+#endif
+   for(; l<L; l++){
+      float num = 0;
+      float den = 0;
+      for(unsigned int k=0; k<n; k++){
+         num += x[k][l]*a[k*C+lane[l]];
+         den += x[k][l]*b[k*C+lane[l]];
+      }
+      float vy = y[l]*(num/den);
+      y[l] = (vy > 1.0f || vy != vy) ? 1.0f : vy;
+   }
+}
+
+// Apply the multiplicative update rule for one mask pixel (C channels).
+static inline void lf_nmf_update(
+        double* y, const double* const* x, const double* a, const double* b,
+        unsigned int n, unsigned long R, unsigned int C, const int* lane){
+   if(C == 1){
+      lf_nmf_update(y, x, a, b, n, R);
+      return;
+   }
+   unsigned long L = C*R;
+   unsigned long l = 0;
+#if defined(__AVX512F__)
+   __m512d one = _mm512_set1_pd(1.0);
+   for(; l<L && C<=8; l+=8){
+      __mmask8 m = (L-l >= 8) ? (__mmask8)0xFF : (__mmask8)((1u<<(L-l))-1);
+      __m512i idx = _mm512_maskz_cvtepi32_epi64(0xFF, _mm256_loadu_si256((const __m256i*)(lane+l)));
+      __m512d num = _mm512_setzero_pd();
+      __m512d den = _mm512_setzero_pd();
+      for(unsigned int k=0; k<n; k++){
+         __m512d vx = _mm512_maskz_loadu_pd(m, x[k]+l);
+         num = _mm512_fmadd_pd(vx, _mm512_maskz_permutexvar_pd(0xFF, idx, _mm512_loadu_pd(a+k*C)), num);
+         den = _mm512_fmadd_pd(vx, _mm512_maskz_permutexvar_pd(0xFF, idx, _mm512_loadu_pd(b+k*C)), den);
+      }
+      __m512d vy = _mm512_mul_pd(_mm512_maskz_loadu_pd(m, y+l), _mm512_div_pd(num, den));
+      _mm512_mask_storeu_pd(y+l, m, _mm512_maskz_min_pd(m, vy, one));
+   }
+#elif defined(__AVX2__)
+   __m256d one = _mm256_set1_pd(1.0);
+   for(; l+4<=L && C<=4; l+=4){
+      __m256i idx = _mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)(lane+l))), 1);
+      idx = _mm256_or_si256(idx, _mm256_slli_epi64(_mm256_add_epi64(idx, _mm256_set1_epi64x(1)), 32));
+      __m256d num = _mm256_setzero_pd();
+      __m256d den = _mm256_setzero_pd();
+      for(unsigned int k=0; k<n; k++){
+         __m256d vx = _mm256_loadu_pd(x[k]+l);
+         __m256d va = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(_mm256_loadu_pd(a+k*C)), idx));
+         __m256d vb = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(_mm256_loadu_pd(b+k*C)), idx));
+         num = LF_NMF_FMADD_PD(vx, va, num);
+         den = LF_NMF_FMADD_PD(vx, vb, den);
+      }
+      __m256d vy = _mm256_mul_pd(_mm256_loadu_pd(y+l), _mm256_div_pd(num, den));
+      _mm256_storeu_pd(y+l, _mm256_min_pd(vy, one));
+   }
+#endif
+   for(; l<L; l++){
+      double num = 0;
+      double den = 0;
+      for(unsigned int k=0; k<n; k++){
+         num += x[k][l]*a[k*C+lane[l]];
+         den += x[k][l]*b[k*C+lane[l]];
+      }
+      double vy = y[l]*(num/den);
+      y[l] = (vy > 1.0 || vy != vy) ? 1.0 : vy;
+   }
+}
+
+// Evaluate inner product of x and y.
+static inline float lf_nmf_dot(const float* x, const float* y, unsigned long R){
+   unsigned long r = 0;
+   float sum = 0;
+#if defined(__AVX512F__)
+   __m512 acc = _mm512_setzero_ps();
+   for(; r+16<=R; r+=16)
+      acc = _mm512_fmadd_ps(_mm512_loadu_ps(x+r), _mm512_loadu_ps(y+r), acc);
+   if(r < R){
+      __mmask16 m = (__mmask16)((1u<<(R-r))-1);
+      acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, x+r), _mm512_maskz_loadu_ps(m, y+r), acc);
+      r = R;
+   }
+   __m256 acc8 = _mm256_add_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(acc), 0)),
+                               _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(acc), 1)));
+   __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc8), _mm256_extractf128_ps(acc8, 1));
+   acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+   acc4 = _mm_add_ss(acc4, _mm_movehdup_ps(acc4));
+   sum = _mm_cvtss_f32(acc4);
+#elif defined(__AVX2__)
+   __m256 acc = _mm256_setzero_ps();
+   for(; r+8<=R; r+=8)
+      acc = LF_NMF_FMADD_PS(_mm256_loadu_ps(x+r), _mm256_loadu_ps(y+r), acc);
+   __m128 acc4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+   acc4 = _mm_add_ps(acc4, _mm_movehl_ps(acc4, acc4));
+   acc4 = _mm_add_ss(acc4, _mm_movehdup_ps(acc4));
+   sum = _mm_cvtss_f32(acc4);
+#endif
+   for(; r<R; r++)
+      sum += x[r]*y[r];
+   return sum;
+}
+
+// Evaluate inner product of x and y.
+static inline double lf_nmf_dot(const double* x, const double* y, unsigned long R){
+   unsigned long r = 0;
+   double sum = 0;
+#if defined(__AVX512F__)
+   __m512d acc = _mm512_setzero_pd();
+   for(; r+8<=R; r+=8)
+      acc = _mm512_fmadd_pd(_mm512_loadu_pd(x+r), _mm512_loadu_pd(y+r), acc);
+   if(r < R){
+      __mmask8 m = (__mmask8)((1u<<(R-r))-1);
+      acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, x+r), _mm512_maskz_loadu_pd(m, y+r), acc);
+      r = R;
+   }
+   __m256d acc4 = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, acc, 0),
+                                _mm512_maskz_extractf64x4_pd(0xF, acc, 1));
+   __m128d acc2 = _mm_add_pd(_mm256_castpd256_pd128(acc4), _mm256_extractf128_pd(acc4, 1));
+   acc2 = _mm_add_sd(acc2, _mm_unpackhi_pd(acc2, acc2));
+   sum = _mm_cvtsd_f64(acc2);
+#elif defined(__AVX2__)
+   __m256d acc = _mm256_setzero_pd();
+   for(; r+4<=R; r+=4)
+      acc = LF_NMF_FMADD_PD(_mm256_loadu_pd(x+r), _mm256_loadu_pd(y+r), acc);
+   __m128d acc2 = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+   acc2 = _mm_add_sd(acc2, _mm_unpackhi_pd(acc2, acc2));
+   sum = _mm_cvtsd_f64(acc2);
+#endif
+   for(; r<R; r++)
+      sum += x[r]*y[r];
+   return sum;
+}
+
+// Define forced inlining (for kernels specialized at compile time).
+#if defined(_MSC_VER)
+   #define LF_NMF_INLINE __forceinline
+#else
+   #define LF_NMF_INLINE inline __attribute__((always_inline))
+#endif
+
+// Define index of the lowest set bit of a nonzero word.
+#if defined(_MSC_VER)
+   #include <intrin.h>
+   static inline unsigned int lf_nmf_ctz(unsigned long long bits){
+      unsigned long l;
+      _BitScanForward64(&l, bits);
+      return (unsigned int)l;
+   }
+#else
+   static inline unsigned int lf_nmf_ctz(unsigned long long bits){
+      return (unsigned int)__builtin_ctzll(bits);
+   }
+#endif
+
+// Apply the multiplicative update rule for one mask pixel (fixed shape).
+// Note: Instantiated for n neighbors and rank R known at compile time, so
+//       that the neighbor loop of the kernel is unrolled and its lane masks
+//       are constant (i.e., the rank vectors remain in registers).
+template<unsigned int n, unsigned long R, typename T>
+static LF_NMF_INLINE void lf_nmf_update_fixed(
+        T* y, const T* const* x, const T* a, const T* b, unsigned int C, const int* lane){
+   lf_nmf_update(y, x, a, b, n, R, C, lane);
+}
+
+#endif
@@ -0,0 +1,351 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_TEST
+//    Regression tests for the native NMF engine. Each test factorizes a
+//    random light field with a fixed seed and compares the result against
+//    a reference (e.g., the original MEX kernel, transcribed below without
+//    any of the engine's optimizations, the same factorization using a
+//    different number of threads or without the sparse kernels, or the
+//    out-of-core solver). Returns zero if every test passes.
+//
+//    g++ -O3 -pthread lf_nmf_test.cpp lf_nmf_engine.cpp lf_nmf_plan.cpp lf_nmf_threads.cpp lf_nmf_ooc.cpp lf_nmf_io.cpp lf_nmf_pinhole.cpp -o lf_nmf_test
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "lf_nmf_engine.h"
+#include "lf_nmf_io.h"
+#include "lf_nmf_ooc.h"
+#include "lf_nmf_pinhole.h"
+
+// Define macros for element-wise minimum/maximum operations.
+#define MAX(a,b) ((a)>(b)?(a):(b))
+#define MIN(a,b) ((a)>(b)?(b):(a))
+
+// Define tolerance of the comparisons against the reference kernel.
+// Note: The engine sums in a different order (e.g., using SIMD kernels),
+//       so results agree to rounding rather than bitwise.
+#define LF_NMF_TEST_TOL 1e-9
+
+// Declare auxiliary functions.
+static void random_fill(std::vector<double>*, unsigned long, unsigned int);
+static void reference_nmf(const double*, const unsigned int*, double*, double*,
+                          unsigned long, unsigned long, double*);
+static double max_difference(const std::vector<double>&, const std::vector<double>&);
+static bool test_reference(unsigned int, unsigned int, unsigned long, unsigned int);
+static bool test_threads(unsigned int, unsigned int, unsigned long, unsigned int);
+static bool test_ooc(unsigned int, unsigned int, unsigned int, unsigned long, bool);
+static bool test_sparse(unsigned int, unsigned int, unsigned long);
+static unsigned long nonzero_pixels(const double*, unsigned long, unsigned long, bool);
+
+int main(){
+   bool ok = true;
+   ok = test_reference(2, 2, 4, 1) && ok;
+   ok = test_reference(1, 4, 4, 1) && ok;
+   ok = test_reference(2, 2, 4, 0) && ok;
+   ok = test_reference(1, 4, 4, 0) && ok;
+   ok = test_reference(3, 3, 9, 0) && ok;
+   ok = test_reference(1, 3, 3, 0) && ok;
+   ok = test_reference(3, 5, 6, 0) && ok;
+   ok = test_threads(3, 3, 9, LF_NMF_SCHEDULE_JACOBI) && ok;
+   ok = test_threads(3, 3, 9, LF_NMF_SCHEDULE_GAUSS_SEIDEL) && ok;
+   ok = test_ooc(3, 3, 1, 4, false) && ok;
+   ok = test_ooc(3, 3, 1, 4, true) && ok;
+   ok = test_ooc(1, 3, 3, 3, false) && ok;
+   ok = test_ooc(3, 5, 3, 6, true) && ok;
+   ok = test_sparse(3, 3, 2) && ok;
+   ok = test_sparse(3, 5, 4) && ok;
+   printf(ok ? "All tests passed.\n" : "Some tests FAILED.\n");
+   return ok ? 0 : 1;
+}
+
+// Compare the engine against the original MEX kernel for B x A views.
+// Note: Uses a 40x60 display, rank R, 20 iterations and "nthreads" threads
+//       (0: all hardware threads), comparing both mask pairs and the PSNR
+//       of every iteration.
+static bool test_reference(unsigned int B, unsigned int A, unsigned long R, unsigned int nthreads){
+   unsigned int lf_dim[4] = {40, 60, B, A};
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned long niter = 20;
+   std::vector<double> lf, W0, H0;
+   random_fill(&lf, N*B*A, 1);
+   random_fill(&W0, N*R, 2);
+   random_fill(&H0, R*N, 3);
+   std::vector<double> W_ref(W0), H_ref(H0), E_ref(niter);
+   reference_nmf(&lf[0], lf_dim, &W_ref[0], &H_ref[0], R, niter, &E_ref[0]);
+   std::vector<double> W(W0), H(H0), E(niter);
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   opt.niter = niter;
+   opt.evaluate_PSNR = true;
+   opt.nthreads = nthreads;
+   lf_nmf_2d_Euclidean(&lf[0], lf_dim, &W[0], &H[0], R, &opt, &E[0]);
+   double dW = max_difference(W, W_ref);
+   double dH = max_difference(H, H_ref);
+   double dE = max_difference(E, E_ref);
+   bool ok = dW < LF_NMF_TEST_TOL && dH < LF_NMF_TEST_TOL && dE < LF_NMF_TEST_TOL;
+   printf("%s: %ux%u views, rank %lu, %u thread(s): |dW| = %.1e, |dH| = %.1e, |dE| = %.1e dB (final PSNR %.2f dB)\n",
+          ok ? "pass" : "FAIL", B, A, R, nthreads, dW, dH, dE, E[niter-1]);
+   return ok;
+}
+
+// Compare the engine using one and four threads for B x A views.
+// Note: Uses a 80x120 display (i.e., several bands, see partition_bands),
+//       rank R and 5 iterations of the given schedule. The masks must be
+//       identical (i.e., the result must not depend on the number of threads).
+static bool test_threads(unsigned int B, unsigned int A, unsigned long R, unsigned int schedule){
+   unsigned int lf_dim[4] = {80, 120, B, A};
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   std::vector<double> lf, W0, H0;
+   random_fill(&lf, N*B*A, 1);
+   random_fill(&W0, N*R, 2);
+   random_fill(&H0, R*N, 3);
+   std::vector<double> W1(W0), H1(H0), W4(W0), H4(H0);
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   opt.niter = 5;
+   opt.schedule = schedule;
+   opt.nthreads = 1;
+   lf_nmf_2d_Euclidean(&lf[0], lf_dim, &W1[0], &H1[0], R, &opt, NULL);
+   opt.nthreads = 4;
+   lf_nmf_2d_Euclidean(&lf[0], lf_dim, &W4[0], &H4[0], R, &opt, NULL);
+   double dW = max_difference(W1, W4);
+   double dH = max_difference(H1, H4);
+   bool ok = dW == 0 && dH == 0;
+   printf("%s: %ux%u views, rank %lu, %s schedule, 1 vs. 4 threads: |dW| = %.1e, |dH| = %.1e\n",
+          ok ? "pass" : "FAIL", B, A, R,
+          (schedule == LF_NMF_SCHEDULE_GAUSS_SEIDEL) ? "Gauss-Seidel" : "Jacobi", dW, dH);
+   return ok;
+}
+
+// Compare the out-of-core solver against the in-core solver for B x A views.
+// Note: Uses a 40x60 display with C channels, rank R, 5 iterations and
+//       bands of 7 rows (i.e., several bands, each with a halo). The initial
+//       masks are either drawn by the solver (see lf_random_value) or read
+//       from files (one matrix per channel). The mask pairs and the PSNR of
+//       every iteration (in full mode) must be identical.
+static bool test_ooc(unsigned int B, unsigned int A, unsigned int C, unsigned long R, bool files){
+   const char* lf_fn = "lf_nmf_test_lf.lfa";
+   const char* W0_fn = "lf_nmf_test_W0.lfa";
+   const char* H0_fn = "lf_nmf_test_H0.lfa";
+   const char* W_fn  = "lf_nmf_test_W.lfa";
+   const char* H_fn  = "lf_nmf_test_H.lfa";
+   unsigned int lf_dim[5] = {40, 60, B, A, C};
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned long niter = 5;
+   unsigned int seed = 7;
+
+   // Write the light field and the initial masks (if requested).
+   // Note: The solver draws the rear and front masks from streams 2*seed
+   //       and 2*seed+1, replicated for each channel.
+   LFArray lf, W0, H0, W, H;
+   unsigned int W_dim[3] = {(unsigned int)N, (unsigned int)R, C};
+   unsigned int H_dim[3] = {(unsigned int)R, (unsigned int)N, C};
+   lf_alloc_array(&lf, (C > 1) ? 5 : 4, lf_dim);
+   lf_alloc_array(&W0, (C > 1) ? 3 : 2, W_dim);
+   lf_alloc_array(&H0, (C > 1) ? 3 : 2, H_dim);
+   std::vector<double> x;
+   random_fill(&x, lf.numel, 1);
+   std::copy(x.begin(), x.end(), lf.data);
+   if(files){
+      random_fill(&x, W0.numel, 2);
+      std::copy(x.begin(), x.end(), W0.data);
+      random_fill(&x, H0.numel, 3);
+      std::copy(x.begin(), x.end(), H0.data);
+   }
+   else
+      for(unsigned int c=0; c<C; c++)
+         for(unsigned long i=0; i<N*R; i++){
+            W0.data[c*N*R+i] = lf_random_value(2ULL*seed, i);
+            H0.data[c*N*R+i] = lf_random_value(2ULL*seed+1, i);
+         }
+   bool ok = lf_write_array(lf_fn, &lf);
+   ok = ok && (!files || (lf_write_array(W0_fn, &W0) && lf_write_array(H0_fn, &H0)));
+
+   // Factorize the light field in core and out of core.
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   opt.niter = niter;
+   opt.evaluate_PSNR = true;
+   opt.print = NULL;
+   std::vector<double> W_ref(W0.data, W0.data+W0.numel), H_ref(H0.data, H0.data+H0.numel);
+   std::vector<double> E_ref(niter*C), E(niter*C);
+   NMFPlan* plan = lf_nmf_create_plan(lf_dim);
+   lf_nmf_2d_Euclidean_channels(plan, lf.data, C, &W_ref[0], &H_ref[0], R, &opt, &E_ref[0]);
+   lf_nmf_destroy_plan(plan);
+   ok = ok && lf_nmf_2d_Euclidean_ooc(lf_fn, files ? W0_fn : NULL, files ? H0_fn : NULL,
+                                      W_fn, H_fn, R, 7, seed, false, &opt, &E[0]);
+   ok = ok && lf_read_array(W_fn, &W) && lf_read_array(H_fn, &H);
+   double dW = -1, dH = -1, dE = max_difference(E, E_ref);
+   if(ok){
+      dW = max_difference(std::vector<double>(W.data, W.data+W.numel), W_ref);
+      dH = max_difference(std::vector<double>(H.data, H.data+H.numel), H_ref);
+      lf_free_array(&W);
+      lf_free_array(&H);
+   }
+   ok = ok && dW == 0 && dH == 0 && dE == 0;
+   printf("%s: %ux%u views, %u channel(s), rank %lu, %s masks, in core vs. out of core: |dW| = %.1e, |dH| = %.1e, |dE| = %.1e dB\n",
+          ok ? "pass" : "FAIL", B, A, C, R, files ? "file" : "random", dW, dH, dE);
+
+   // Release storage.
+   lf_free_array(&lf);
+   lf_free_array(&W0);
+   lf_free_array(&H0);
+   remove(lf_fn);
+   remove(W0_fn);
+   remove(H0_fn);
+   remove(W_fn);
+   remove(H_fn);
+   return ok;
+}
+
+// Compare the engine with and without the sparse kernels for B x A views.
+// Note: Uses a 40x60 display, 10 iterations, and the first R < B*A pinhole
+//       array mask pairs as the initial masks (i.e., most front pixels are
+//       closed, so the sparse kernels are used). The light field is zero in
+//       a block of 3x3 pixels (i.e., the masks have all-zero pixels). The
+//       closed front pixels open during the iterations, so the solver
+//       returns to the dense kernels (see check_sparse). The masks must be
+//       identical.
+static bool test_sparse(unsigned int B, unsigned int A, unsigned long R){
+   unsigned int lf_dim[4] = {40, 60, B, A};
+   unsigned long N = (unsigned long)lf_dim[0]*lf_dim[1];
+   unsigned long K = B*A;
+   std::vector<double> lf;
+   random_fill(&lf, N*K, 1);
+   for(unsigned long k=0; k<K; k++)
+      for(unsigned int u=10; u<13; u++)
+         for(unsigned int v=10; v<13; v++)
+            lf[k*N+u*lf_dim[0]+v] = 0;
+   std::vector<double> W_pinhole(N*K), H_pinhole(K*N);
+   lf_nmf_pinhole_masks(lf_dim, 1, &lf[0], &W_pinhole[0], &H_pinhole[0], 0);
+   std::vector<double> W0(W_pinhole.begin(), W_pinhole.begin()+N*R), H0(R*N);
+   for(unsigned long i=0; i<N; i++)
+      for(unsigned long r=0; r<R; r++)
+         H0[i*R+r] = H_pinhole[i*K+r];
+   std::vector<double> W_sparse(W0), H_sparse(H0), W_dense(W0), H_dense(H0);
+   NMFOptions opt;
+   lf_nmf_default_options(&opt);
+   opt.niter = 10;
+   lf_nmf_2d_Euclidean(&lf[0], lf_dim, &W_sparse[0], &H_sparse[0], R, &opt, NULL);
+   double density = opt.sparse_density;
+   opt.sparse_density = 0;
+   lf_nmf_2d_Euclidean(&lf[0], lf_dim, &W_dense[0], &H_dense[0], R, &opt, NULL);
+   unsigned long nnz0 = MIN(nonzero_pixels(&W0[0], N, R, true), nonzero_pixels(&H0[0], N, R, false));
+   unsigned long nnz1 = MIN(nonzero_pixels(&W_sparse[0], N, R, true), nonzero_pixels(&H_sparse[0], N, R, false));
+   bool zero = nonzero_pixels(&W0[0], N, R, true) < N && nonzero_pixels(&W_sparse[0], N, R, true) < N;
+   double dW = max_difference(W_sparse, W_dense);
+   double dH = max_difference(H_sparse, H_dense);
+   bool ok = dW == 0 && dH == 0 && nnz0 <= density*N && nnz1 > density*N && zero;
+   printf("%s: %ux%u views, rank %lu, nonzero pixels %.2f -> %.2f%s, sparse vs. dense kernels: |dW| = %.1e, |dH| = %.1e\n",
+          ok ? "pass" : "FAIL", B, A, R, (double)nnz0/N, (double)nnz1/N,
+          zero ? "" : " (no zero pixels)", dW, dH);
+   return ok;
+}
+
+// Return the number of mask pixels with any nonzero element.
+// Note: The rear masks are N x R, and the front masks R x N.
+static unsigned long nonzero_pixels(const double* X, unsigned long N, unsigned long R, bool rear){
+   unsigned long n = 0;
+   for(unsigned long i=0; i<N; i++){
+      bool nonzero = false;
+      for(unsigned long r=0; r<R && !nonzero; r++)
+         nonzero = (rear ? X[r*N+i] : X[i*R+r]) != 0;
+      n += nonzero;
+   }
+   return n;
+}
+
+// Fill a vector with uniform random values in (0,1] (using a fixed seed).
+static void random_fill(std::vector<double>* x, unsigned long n, unsigned int seed){
+   srand(seed);
+   x->resize(n);
+   for(unsigned long i=0; i<n; i++)
+      (*x)[i] = (rand()+1.0)/(RAND_MAX+1.0);
+}
+
+// Return the largest absolute difference between two vectors.
+static double max_difference(const std::vector<double>& x, const std::vector<double>& y){
+   double d = 0;
+   for(unsigned long i=0; i<x.size(); i++)
+      d = MAX(d, fabs(x[i]-y[i]));
+   return d;
+}
+
+// Apply the weighted multiplicative update rule (original MEX kernel).
+// Note: Transcribed from the first version of lf_nmf_2d_Euclidean_mex.cpp,
+//       including its geometry for even numbers of views (i.e., the update
+//       pairs view a with mask offset a-(nAngles-1-nHalfAngles), and the
+//       PSNR pairs it with offset a-nHalfAngles).
+static void reference_nmf(const double* lf, const unsigned int* lf_dim,
+                          double* W_data, double* H_data, unsigned long R,
+                          unsigned long niter, double* E_data){
+   int nAngles[2] = {(int)lf_dim[2], (int)lf_dim[3]};
+   int nHalfAngles[2] = {(nAngles[0]-1)/2, (nAngles[1]-1)/2};
+   int rows = (int)lf_dim[0], cols = (int)lf_dim[1];
+   unsigned long N = (unsigned long)rows*cols;
+   std::vector<double> W0(N*R), H0(R*N);
+   for(unsigned long iter=0; iter<niter; iter++){
+
+      // Evaluate PSNR of light field approximation.
+      double MSE = 0, max_elem = 0, num_elem = 0;
+      for(int b=0; b<nAngles[0]; b++){
+         for(int a=0; a<nAngles[1]; a++){
+            for(int v=0; v<rows; v++){
+               for(int u=0; u<cols; u++){
+                  int s = u+(a-nHalfAngles[1]);
+                  int t = v+(b-nHalfAngles[0]);
+                  if(s < 0 || s >= cols || t < 0 || t >= rows)
+                     continue;
+                  double lf_approx = 0;
+                  for(unsigned long r=0; r<R; r++)
+                     lf_approx += W_data[r*N+v*cols+u]*H_data[(t*cols+s)*R+r];
+                  double x = lf[rows*(cols*(nAngles[0]*a+b)+u)+v];
+                  MSE += pow(x-lf_approx, 2);
+                  max_elem = MAX(max_elem, x);
+                  num_elem++;
+               }
+            }
+         }
+      }
+      E_data[iter] = 10.0*log10(pow(max_elem, 2)/(MSE/num_elem));
+
+      // Update the front mask pairs, and then the rear mask pairs.
+      for(int side=0; side<2; side++){
+         W0.assign(W_data, W_data+N*R);
+         H0.assign(H_data, H_data+R*N);
+         for(unsigned long p=0; p<N; p++){
+            int y = (int)(p/cols), x = (int)(p%cols);
+            for(unsigned long r=0; r<R; r++){
+               double num = 0, den = 0;
+               for(int y2=MAX(0, y-nHalfAngles[0]); y2<=MIN(rows-1, y+nHalfAngles[0]); y2++){
+                  for(int x2=MAX(0, x-nHalfAngles[1]); x2<=MIN(cols-1, x+nHalfAngles[1]); x2++){
+                     unsigned long q = (unsigned long)y2*cols+x2;
+                     unsigned long i = (side == 0) ? q : p;
+                     unsigned long j = (side == 0) ? p : q;
+                     int u = (int)(i%cols), v = (int)(i/cols);
+                     int s = (int)(j%cols), t = (int)(j/cols);
+                     int a = (nAngles[1]-1)-((u-s+nHalfAngles[1])%nAngles[1]);
+                     int b = (nAngles[0]-1)-((v-t+nHalfAngles[0])%nAngles[0]);
+                     double dotp = 0;
+                     for(unsigned long dp=0; dp<R; dp++)
+                        dotp += W0[dp*N+i]*H0[j*R+dp];
+                     double x_r = (side == 0) ? W0[r*N+i] : H0[j*R+r];
+                     num += x_r*lf[rows*(cols*(nAngles[0]*a+b)+u)+v];
+                     den += x_r*dotp;
+                  }
+               }
+               double* y_r = (side == 0) ? &H_data[p*R+r] : &W_data[r*N+p];
+               *y_r = ((side == 0) ? H0[p*R+r] : W0[r*N+p])*(num/den);
+               *y_r = MIN(*y_r, 1);
+               if(*y_r != *y_r)
+                  *y_r = 1.0;
+            }
+         }
+      }
+   }
+}
@@ -0,0 +1,91 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_THREADS
+//    Fixed-size pool of worker threads used to split the NMF sweeps into
+//    independent blocks of mask pixels.
+//
+//-------------------------------------------------------------------------
+
+// Define included files.
+#include "lf_nmf_threads.h"
+
+// Return default number of threads (i.e., number of hardware threads).
+unsigned int lf_nmf_default_threads(){
+   unsigned int n = std::thread::hardware_concurrency();
+   return (n > 0) ? n : 1;
+}
+
+// Create worker threads (the calling thread acts as the remaining worker).
+NMFThreadPool::NMFThreadPool(unsigned int n) :
+   nthreads(n > 0 ? n : 1), task(NULL), ctx(NULL), nblocks(0),
+   next_block(0), active(0), generation(0), stop(false){
+   for(unsigned int i=1; i<nthreads; i++)
+      threads.push_back(std::thread(&NMFThreadPool::worker, this));
+}
+
+// Stop and join worker threads.
+NMFThreadPool::~NMFThreadPool(){
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+   }
+   start_cv.notify_all();
+   for(unsigned int i=0; i<threads.size(); i++)
+      threads[i].join();
+}
+
+// Evaluate task for blocks 0..nblocks-1 (returns once all are complete).
+void NMFThreadPool::run(NMFTask t, void* c, unsigned int n){
+   if(threads.empty()){
+      for(unsigned int block=0; block<n; block++)
+         t(c, block);
+      return;
+   }
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      task       = t;
+      ctx        = c;
+      nblocks    = n;
+      next_block = 0;
+      active     = (unsigned int)threads.size();
+      generation++;
+   }
+   start_cv.notify_all();
+   drain();
+   std::unique_lock<std::mutex> lock(mutex);
+   done_cv.wait(lock, [this]{ return active == 0; });
+}
+
+// Claim and evaluate blocks until none remain.
+void NMFThreadPool::drain(){
+   while(true){
+      unsigned int block;
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         if(next_block >= nblocks)
+            return;
+         block = next_block++;
+      }
+      task(ctx, block);
+   }
+}
+
+// Define worker thread routine.
+void NMFThreadPool::worker(){
+   unsigned long seen = 0;
+   while(true){
+      {
+         std::unique_lock<std::mutex> lock(mutex);
+         start_cv.wait(lock, [&]{ return stop || generation != seen; });
+         if(stop)
+            return;
+         seen = generation;
+      }
+      drain();
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         if(--active == 0)
+            done_cv.notify_one();
+      }
+   }
+}
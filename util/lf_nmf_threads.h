@@ -0,0 +1,56 @@
+
+//-------------------------------------------------------------------------
+// LF_NMF_THREADS
+//    Fixed-size pool of worker threads used to split the NMF sweeps into
+//    independent blocks of mask pixels.
+//
+//-------------------------------------------------------------------------
+
+#ifndef LF_NMF_THREADS_H
+#define LF_NMF_THREADS_H
+
+// Define included files.
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Declare task routine (evaluated for each block index in a parallel loop).
+typedef void (*NMFTask)(void* ctx, unsigned int block);
+
+// Declare thread pool.
+// Note: The calling thread participates in each parallel loop, so a pool
+//       of size one runs every block on the caller without synchronization.
+class NMFThreadPool {
+public:
+   NMFThreadPool(unsigned int nthreads);
+   ~NMFThreadPool();
+
+   // Return number of threads (including the calling thread).
+   unsigned int size() const { return nthreads; }
+
+   // Evaluate task for blocks 0..nblocks-1 (returns once all are complete).
+   void run(NMFTask task, void* ctx, unsigned int nblocks);
+
+private:
+   void worker();
+   void drain();
+
+   unsigned int             nthreads;
+   std::vector<std::thread> threads;
+   std::mutex               mutex;
+   std::condition_variable  start_cv;
+   std::condition_variable  done_cv;
+   NMFTask                  task;
+   void*                    ctx;
+   unsigned int             nblocks;
+   unsigned int             next_block;
+   unsigned int             active;
+   unsigned long            generation;
+   bool                     stop;
+};
+
+// Return default number of threads (i.e., number of hardware threads).
+unsigned int lf_nmf_default_threads();
+
+#endif
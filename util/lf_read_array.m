@@ -0,0 +1,25 @@
+function A = lf_read_array(filename)
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% LF_READ_ARRAY
+%    Reads a multi-dimensional array (e.g., optimized mask pairs) written
+%    by the native NMF tools (see lf_nmf_io.h).
+%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Open input file and verify signature.
+fid = fopen(filename,'r','ieee-le');
+if fid < 0
+   error(['Cannot open ',filename,'!']);
+end
+if ~strcmp(fread(fid,[1 4],'char=>char'),'LFA1')
+   fclose(fid);
+   error([filename,' is not a valid array file!']);
+end
+
+% Read header and elements (in column-major order).
+n   = fread(fid,1,'uint32');
+dim = fread(fid,[1 n],'uint32');
+A   = fread(fid,prod(dim),'double');
+A   = reshape(A,[dim 1]);
+fclose(fid);
@@ -0,0 +1,21 @@
+function lf_write_array(filename,A)
+
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+% LF_WRITE_ARRAY
+%    Writes a multi-dimensional array (e.g., a light field or mask pair)
+%    for use with the native NMF tools (see lf_nmf_io.h).
+%
+%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+% Open output file.
+fid = fopen(filename,'w','ieee-le');
+if fid < 0
+   error(['Cannot open ',filename,'!']);
+end
+
+% Write header and elements (in column-major order).
+fwrite(fid,'LFA1','char');
+fwrite(fid,ndims(A),'uint32');
+fwrite(fid,size(A),'uint32');
+fwrite(fid,double(A),'double');
+fclose(fid);
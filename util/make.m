@@ -9,7 +9,33 @@
 % Display compilation details.
 clear all; clc;
 disp('Compiling lf_nmf_2d_Euclidean_mex...');
-eval('mex -largeArrayDims lf_nmf_2d_Euclidean_mex.cpp');
+if ispc
+   flags = '';
+else
+   flags = 'CXXFLAGS=''$CXXFLAGS -march=native'' '; % enable vectorized kernels
+end
+eval(['mex -largeArrayDims ',flags,...
+   'lf_nmf_2d_Euclidean_mex.cpp lf_nmf_engine.cpp lf_nmf_plan.cpp lf_nmf_threads.cpp']);
+
+% Compile the native light field loader (requires libpng).
+disp('Compiling lf_nmf_load_mex...');
+eval(['mex -largeArrayDims ',flags,...
+   'lf_nmf_load_mex.cpp lf_nmf_load.cpp lf_nmf_threads.cpp -lpng']);
+
+% Compile the native pinhole array mask generator.
+disp('Compiling lf_nmf_pinhole_mex...');
+eval(['mex -largeArrayDims ',flags,...
+   'lf_nmf_pinhole_mex.cpp lf_nmf_pinhole.cpp lf_nmf_engine.cpp lf_nmf_plan.cpp lf_nmf_threads.cpp']);
+
+% Compile the native reconstruction evaluator.
+disp('Compiling lf_nmf_evaluate_mex...');
+eval(['mex -largeArrayDims ',flags,...
+   'lf_nmf_evaluate_mex.cpp lf_nmf_eval.cpp lf_nmf_threads.cpp']);
+
+% Compile the asynchronous mask writer (requires libpng).
+disp('Compiling lf_nmf_save_mex...');
+eval(['mex -largeArrayDims ',flags,...
+   'lf_nmf_save_mex.cpp lf_nmf_save.cpp lf_nmf_threads.cpp -lpng']);
 
 % Test compiled NMF function.
 LF.dim  = [15 21 5 3];